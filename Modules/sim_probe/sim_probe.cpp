@@ -8,6 +8,9 @@
 //              altitude AGL, are used to calculate a lift factor to apply to the
 //              user aircraft.
 //
+//              The lift model and the file formats shared with the offline tools are
+//              in sim_probe_lib.cpp, main() is in sim_probe_main.cpp.
+//
 //              Written by Ian Forster-Lewis www.forsterlewis.com
 //------------------------------------------------------------------------------
 
@@ -18,16 +21,10 @@
 #include <math.h>
 #include <time.h>
 
-#include "SimConnect.h"
-
-// sim_probe version (sent in client data)
-double version = 3.00;
+#include "sim_probe.h"
 
-// 'debug' parameters from command line that control various levels of diagnostic output
-bool debug_info = false; // default 'debug' level - prints out startup, lift, errors
-bool debug = false; // prints out lift factors as sim_probe runs
-bool debug_calls = false; // greater level of debug - procedure calls
-bool debug_events = false; // greater level of debug - events
+// procedure calls and events are no longer printed as they happen, they are recorded by the
+// binary trace (see TRACE below) - 'calls' or 'events' on the command line prints the trace at quit
 
 bool menu_show_text = false; // boolean to decide whether to display debug text in FSX window
 const int MENU_TICK_COUNT = 2; // only update FSX window ridgelift value every 2 seconds
@@ -35,14 +32,12 @@ int menu_tick_counter = 0; // variable to keep track of how many ticks we've cou
 
 // 'heartbeat' is the 'system ok' flag that is tested every 4 seconds from the EVENT_4S_TIMER event
 bool heartbeat = true;
-
-// profile_count is the number of samples in the profile
-const int PROFILE_COUNT = 5;
+bool probe_asked = false; // a probe was moved (or read by test_heartbeat()) since the last test
 
 int     quit = 0;
 HANDLE  hSimConnect = NULL;
 
-static enum EVENT_ID {
+enum EVENT_ID {
     EVENT_SIM_START,
 	EVENT_OBJECT_REMOVED,
 	EVENT_4S_TIMER,
@@ -64,32 +59,6 @@ static enum EVENT_ID {
 //  EVENT_B
 };
 
-static enum DATA_REQUEST_ID {
-//    REQUEST_1,
-    REQUEST_PROBE_CREATE1,
-    REQUEST_PROBE_CREATE2,
-    REQUEST_PROBE_CREATE3,
-    REQUEST_PROBE_CREATE4,
-    //REQUEST_PROBE_CREATE5,
-    REQUEST_PROBE_REMOVE1,
-    REQUEST_PROBE_REMOVE2,
-    REQUEST_PROBE_REMOVE3,
-    REQUEST_PROBE_REMOVE4,
-    //REQUEST_PROBE_REMOVE5,
-    REQUEST_PROBE_RELEASE1,
-    REQUEST_PROBE_RELEASE2,
-    REQUEST_PROBE_RELEASE3,
-    REQUEST_PROBE_RELEASE4,
-    REQUEST_PROBE_POS1,
-    REQUEST_PROBE_POS2,
-    REQUEST_PROBE_POS3,
-    REQUEST_PROBE_POS4,
-    //REQUEST_PROBE_POS5,
-    REQUEST_USER_POS,
-    REQUEST_USER_POS_AND_PROFILE,
-	REQUEST_STARTUP_DATA
-};
-
 DATA_REQUEST_ID request_probe_release[PROFILE_COUNT] = {REQUEST_PROBE_RELEASE1, // this one is not used
 														REQUEST_PROBE_RELEASE1,
 														REQUEST_PROBE_RELEASE2,
@@ -97,53 +66,371 @@ DATA_REQUEST_ID request_probe_release[PROFILE_COUNT] = {REQUEST_PROBE_RELEASE1,
 														REQUEST_PROBE_RELEASE4};
 
 // GROUP_ID and INPUT_ID are used for keystroke events in testing
-static enum GROUP_ID {
+enum GROUP_ID {
     GROUP_ZX,
 	GROUP_MENU
 };
 
-static enum INPUT_ID {
+enum INPUT_ID {
     INPUT_ZX
 };
 
-static enum DEFINITION_ID {
+enum DEFINITION_ID {
 //    DEFINITION_1,
     DEFINITION_MOVE,
     DEFINITION_PROBE_POS,
     DEFINITION_USER_POS,
 	DEFINITION_SIMLIFT, // struct for lift value in client data area
-	DEFINITION_STARTUP
+	DEFINITION_STARTUP,
+	DEFINITION_SIMLIFT_MULTI, // struct for lift values of other aircraft in client data area
+	DEFINITION_SIMLIFT_STATS // struct for the flight statistics in client data area
 };
 
-struct ProbeStruct {
-    double ground_elevation;
-    double latitude;
-    double longitude;
+//*******************************************************************************
+// TRACE
+// low-overhead binary trace of the hot path.  Each trace point writes one fixed-size record
+// (timestamp, trace id, request/event id, probe index) into a preallocated ring buffer and
+// nothing is formatted until the buffer is dumped at quit.  The dump is decoded offline
+// with "sim_probe_replay decode=<trace file>", optionally exporting Chrome/Perfetto JSON with
+// "json=<file>".
+
+enum TRACE_ID {
+	TRACE_ENTER,          // id = TRACE_FN
+	TRACE_LEAVE,          // id = TRACE_FN
+	TRACE_EVENT,          // id = EVENT_ID received
+	TRACE_SEND,           // id = DATA_REQUEST_ID sent to FSX
+	TRACE_REPLY,          // id = DATA_REQUEST_ID reply received
+	TRACE_MOVE,           // probe moved
+	TRACE_PROBE_LATE,     // probe missed its reply deadline
+	TRACE_PROBE_STALE,    // probe reply position didn't match the move, re-read
+	TRACE_LIFT,           // lift sent to client data area, id = status, probe = aircraft
+	TRACE_SNAPSHOT,       // profile snapshot handed to the compute thread, probe = aircraft
+	TRACE_HEARTBEAT_LOST, // heartbeat failed, probes recreated
+	TRACE_EXCEPTION,      // id = SIMCONNECT_EXCEPTION
+	TRACE_OBJECT_REMOVED, // id = object id
+	TRACE_ID_COUNT
 };
 
-struct UserStruct {
-    double latitude;
-    double longitude;
-    double altitude; // meters
-    double ground_elevation;
-    double wind_velocity; // m/s
-    double wind_direction; // degrees
-	INT32  sim_on_ground;
-	INT32  zulu_time; // seconds
+const char *trace_name[TRACE_ID_COUNT] = {
+	"enter", "leave", "event", "send", "reply", "move", "probe_late", "probe_stale",
+	"lift", "snapshot", "heartbeat_lost", "exception", "object_removed"
 };
 
-struct MoveStruct {
-    double latitude;
-    double longitude;
-	double altitude;
+// function ids for TRACE_ENTER and TRACE_LEAVE
+enum TRACE_FN {
+	FN_RIDGE_LIFT,
+	FN_REMOVE_PROBES,
+	FN_CREATE_PROBES,
+	FN_GET_PROFILE,
+	FN_GET_USER_POS_AND_PROFILE,
+	FN_PROCESS_PROFILE,
+	FN_COMPUTE_PROFILE,
+	TRACE_FN_COUNT
 };
 
-struct StartupStruct {
-	char atc_id[32];
-	char atc_type[32];
-	INT32 start_time;
+const char *trace_fn_name[TRACE_FN_COUNT] = {
+	"ridge_lift", "remove_probes", "create_probes", "get_profile",
+	"get_user_pos_and_profile", "process_profile", "compute_profile"
 };
 
+// request names in DATA_REQUEST_ID order, used by the trace decoder
+const char *request_name[REQUEST_ID_COUNT] = {
+	"PROBE_CREATE1", "PROBE_CREATE2", "PROBE_CREATE3", "PROBE_CREATE4",
+	"PROBE_REMOVE1", "PROBE_REMOVE2", "PROBE_REMOVE3", "PROBE_REMOVE4",
+	"PROBE_RELEASE1", "PROBE_RELEASE2", "PROBE_RELEASE3", "PROBE_RELEASE4",
+	"PROBE_POS1", "PROBE_POS2", "PROBE_POS3", "PROBE_POS4",
+	"USER_POS_AND_PROFILE", "STARTUP_DATA", "AIRCRAFT_POS", "RECORDER_ID",
+	"USER_POS_NEAR_RIDGE", "PROBE_ALIVE"
+};
+
+
+TraceRecord trace_buf[TRACE_BUF_SIZE];
+volatile LONG trace_count = 0; // total records written (ring index is trace_count % TRACE_BUF_SIZE)
+__declspec(thread) BYTE trace_thread = 0; // set to 1 by the compute thread
+bool tracing = false; // set by 'trace=', 'calls' or 'events' on the command line
+bool trace_console = false; // print the decoded trace at quit ('calls' or 'events')
+const char *trace_file = ""; // binary trace dump file written at quit ('trace=<file>')
+
+inline void trace(TRACE_ID trace_id, DWORD id, int probe) {
+	if (!tracing) return;
+	// the compute thread traces too, so claim the slot atomically
+	DWORD k = (DWORD)InterlockedIncrement(&trace_count) - 1;
+	TraceRecord *r = &trace_buf[k & (TRACE_BUF_SIZE-1)];
+	r->time = perf_now();
+	r->trace_id = (WORD)trace_id;
+	r->probe = (BYTE)probe;
+	r->thread = trace_thread;
+	r->id = id;
+}
+
+// request_probe() returns the probe index for a probe create/remove/release/pos request, else 0
+inline int request_probe(DWORD request_id) {
+	if (request_id>=REQUEST_PROBE_CREATE1 && request_id<=REQUEST_PROBE_POS4) {
+		return (request_id - REQUEST_PROBE_CREATE1) % (PROFILE_COUNT-1) + 1;
+	}
+	return 0;
+}
+
+// trace_output() formats count records from buf (oldest first, starting at index start) as
+// text lines to text and/or as Chrome trace events (chrome://tracing, ui.perfetto.dev) to json
+void trace_output(const TraceRecord *buf, DWORD start, DWORD count, DWORD mask, LONGLONG frequency,
+				  FILE *text, FILE *json) {
+	if (count==0) return;
+	LONGLONG t0 = buf[start & mask].time;
+	if (json) fprintf(json, "{\"traceEvents\":[\n");
+	for (DWORD k=0; k<count; k++) {
+		const TraceRecord *r = &buf[(start + k) & mask];
+		double us = double(r->time - t0) * 1000000.0 / double(frequency);
+		const char *tname = (r->trace_id<TRACE_ID_COUNT) ? trace_name[r->trace_id] : "?";
+		char idname[40];
+		if (r->trace_id==TRACE_ENTER || r->trace_id==TRACE_LEAVE) {
+			sprintf_s(idname, "%s", (r->id<TRACE_FN_COUNT) ? trace_fn_name[r->id] : "?");
+		} else if ((r->trace_id==TRACE_SEND || r->trace_id==TRACE_REPLY || r->trace_id==TRACE_PROBE_LATE
+			       || r->trace_id==TRACE_PROBE_STALE)
+			       && r->id<REQUEST_ID_COUNT) {
+			sprintf_s(idname, "%s", request_name[r->id]);
+		} else {
+			sprintf_s(idname, "%d", r->id);
+		}
+		if (text) fprintf(text, "%14.1f us  %-14s %-24s probe=%d%s\n", us, tname, idname, r->probe,
+						  r->thread ? " (compute)" : "");
+		if (json) {
+			// enter/leave become duration slices, send/reply become async slices keyed by request id
+			char ph = 'i';
+			if (r->trace_id==TRACE_ENTER) ph = 'B';
+			else if (r->trace_id==TRACE_LEAVE) ph = 'E';
+			else if (r->trace_id==TRACE_SEND) ph = 'b';
+			else if (r->trace_id==TRACE_REPLY) ph = 'e';
+			const char *name = (ph=='i') ? tname : idname;
+			fprintf(json, "%s{\"name\":\"%s\",\"cat\":\"sim_probe\",\"ph\":\"%c\",\"ts\":%.1f,\"pid\":1,\"tid\":%d",
+				    (k==0) ? "" : ",\n", name, ph, us, r->thread + 1);
+			if (ph=='b' || ph=='e') fprintf(json, ",\"id\":%d", r->id);
+			if (ph=='i') fprintf(json, ",\"s\":\"t\"");
+			fprintf(json, ",\"args\":{\"id\":\"%s\",\"probe\":%d}}", idname, r->probe);
+		}
+	}
+	if (json) fprintf(json, "\n]}\n");
+}
+
+// trace_dump() is called at quit: writes the ring buffer to trace_file and/or the console
+void trace_dump() {
+	if (!tracing) return;
+	DWORD total = (DWORD)trace_count;
+	DWORD count = min(total, TRACE_BUF_SIZE);
+	DWORD start = total - count;
+	if (trace_console) trace_output(trace_buf, start, count, TRACE_BUF_SIZE-1, perf_frequency, stdout, NULL);
+	if (trace_file[0]==0) return;
+	FILE *f;
+	if (fopen_s(&f, trace_file, "wb") != 0) {
+		printf("\nError: couldn't open trace file %s for writing.\n", trace_file);
+		return;
+	}
+	TraceHeader h = { {'S','P','T','R'}, TRACE_VERSION, perf_frequency, count, total - count };
+	fwrite(&h, sizeof(h), 1, f);
+	for (DWORD k=0; k<count; k++) fwrite(&trace_buf[(start + k) & (TRACE_BUF_SIZE-1)], sizeof(TraceRecord), 1, f);
+	fclose(f);
+}
+
+// END OF TRACE
+//*******************************************************************************
+
+//*******************************************************************************
+// CAPTURE
+// "record=<file>" writes every SIMCONNECT_RECV delivered to MyDispatchProcSO, and a compact
+// record of each outgoing request, probe move and client data write, to <file>.  The capture
+// is played back through MyDispatchProcSO by "sim_probe_replay replay=<file>", which needs
+// no FSX connection.  While replaying, the logic clock tick_count() is the recorded time and
+// the outgoing calls are checked against the recorded ones instead of being written.
+
+const char *call_name[CALL_ID_COUNT] = { "requests", "probe moves", "client data writes" };
+
+FILE *capture_file = NULL; // open while recording ('record=<file>')
+
+bool replaying = false;
+DWORD replay_clock = 0; // recorded time of the message being replayed
+
+// recorded calls of each kind, checked in order as the replay makes them.  Calls are compared
+// per kind because the order between kinds depends on thread timing, e.g. when the compute
+// thread's lift is picked up by the main loop.
+CaptureCall *replay_calls[CALL_ID_COUNT] = {NULL};
+DWORD replay_call_count[CALL_ID_COUNT] = {0};
+DWORD replay_call_next[CALL_ID_COUNT] = {0};
+DWORD replay_mismatch_count = 0;
+
+// tick_count() is GetTickCount() for the program logic (deadlines, sample intervals), so a
+// replay sees the same times as the recording
+inline DWORD tick_count() {
+	return replaying ? replay_clock : GetTickCount();
+}
+
+void capture_write(CAPTURE_TYPE type, const void *data, DWORD size) {
+	CaptureRecord r = { (WORD)type, 0, GetTickCount(), size };
+	fwrite(&r, sizeof(r), 1, capture_file);
+	fwrite(data, size, 1, capture_file);
+}
+
+// capture_open() starts recording to fn ('record=<file>'), the header holds the options that
+// change the message flow so the replay can set them the same way
+bool capture_open(const char *fn) {
+	if (fopen_s(&capture_file, fn, "wb") != 0) {
+		printf("Error: couldn't open capture file %s for writing\n", fn);
+		capture_file = NULL;
+		return false;
+	}
+	CaptureHeader h = { {'S','P','R','C'}, CAPTURE_VERSION, (DWORD)multi_aircraft, aircraft_radius, {0},
+						(DWORD)flight_stats, (DWORD)flight_recorder, (DWORD)wind_field, (DWORD)surface_fit,
+						ridge_cell_count };
+	strcpy_s(h.stencil, stencil_name);
+	fwrite(&h, sizeof(h), 1, capture_file);
+	return true;
+}
+
+// record_call() is called for each outgoing call: written to the capture when recording,
+// compared with the recorded call when replaying
+void record_call(CAPTURE_CALL_ID call, DWORD id, INT32 arg) {
+	if (capture_file) {
+		CaptureCall c = { call, id, arg };
+		capture_write(CAPTURE_CALL, &c, sizeof(c));
+	}
+	if (!replaying) return;
+	DWORD k = replay_call_next[call]++;
+	if (k >= replay_call_count[call]) {
+		if (replay_mismatch_count++ < 10) printf("\nReplay: extra %s call (id %d, arg %d)", call_name[call], id, arg);
+		return;
+	}
+	const CaptureCall *c = &replay_calls[call][k];
+	if (c->id != id || c->arg != arg) {
+		if (replay_mismatch_count++ < 10) {
+			printf("\nReplay: %s call %d differs: recorded id %d arg %d, replayed id %d arg %d",
+				   call_name[call], k, c->id, c->arg, id, arg);
+		}
+	}
+}
+
+// END OF CAPTURE
+//*******************************************************************************
+
+//*******************************************************************************
+// LATENCY HISTOGRAMS
+// the send time of each request is recorded at the call site (request_sent()) and the
+// turnaround is added to a log-linear (HDR-style) histogram for that request id when the reply
+// is dispatched (request_done()).  Probe moves have no reply of their own, so a move is timed
+// until the first elevation reply from the probe at its new position (move_done()).  The
+// histograms are printed every LATENCY_DUMP_TICKS 4-second ticks and at quit (debug or info mode).
+
+const int HIST_SUB_BITS = 3; // 8 sub-buckets per power of 2, i.e. 12.5% resolution
+const int HIST_SUB = 1 << HIST_SUB_BITS;
+const int HIST_BUCKETS = HIST_SUB * 25; // microsecond values up to ~2^27 (134 seconds)
+const int LATENCY_DUMP_TICKS = 15; // print histograms every 15 x 4 seconds
+
+struct Histogram {
+	INT32 count[HIST_BUCKETS];
+	INT32 total;
+	double sum_us;
+	LONGLONG max_us;
+};
+
+Histogram request_latency[REQUEST_ID_COUNT]; // turnaround per request id
+Histogram move_latency; // probe move to next elevation reply from that probe
+Histogram publish_latency; // profile complete (dispatch thread) to lift sent (main loop)
+LONGLONG request_sent_time[REQUEST_ID_COUNT] = {0}; // 0 => no request outstanding
+LONGLONG move_sent_time[PROFILE_COUNT] = {0};
+int latency_tick_counter = 0;
+
+// message counts, reported per lift sample with the probe stats
+INT32 msg_sent_count = 0; // requests, moves and client data writes sent to FSX
+INT32 msg_recv_count = 0; // messages received by MyDispatchProcSO
+
+// hist_bucket() maps microseconds to a bucket: values below HIST_SUB are exact, above that
+// each power of 2 is split into HIST_SUB linear sub-buckets
+int hist_bucket(LONGLONG us) {
+	if (us < HIST_SUB) return (int)max(us, 0);
+	int msb = 0;
+	while ((us >> (msb+1)) != 0) msb++;
+	int shift = msb - HIST_SUB_BITS;
+	int b = (shift+1) * HIST_SUB + (int)((us >> shift) & (HIST_SUB-1));
+	return min(b, HIST_BUCKETS-1);
+}
+
+// hist_bucket_value() is the lowest value (microseconds) that falls in bucket b
+LONGLONG hist_bucket_value(int b) {
+	if (b < HIST_SUB) return b;
+	int shift = b / HIST_SUB - 1;
+	return (LONGLONG)(HIST_SUB + b % HIST_SUB) << shift;
+}
+
+void hist_add(Histogram *h, LONGLONG us) {
+	h->count[hist_bucket(us)]++;
+	h->total++;
+	h->sum_us += double(us);
+	if (us > h->max_us) h->max_us = us;
+}
+
+// hist_percentile() returns the bucket value (microseconds) below which p percent of values fall
+LONGLONG hist_percentile(const Histogram *h, double p) {
+	INT32 target = INT32(ceil(double(h->total) * p / 100.0));
+	INT32 seen = 0;
+	for (int b=0; b<HIST_BUCKETS; b++) {
+		seen += h->count[b];
+		if (seen >= target && seen > 0) return hist_bucket_value(b);
+	}
+	return h->max_us;
+}
+
+// request_sent() is called just before each SimConnect request is sent
+inline void request_sent(DATA_REQUEST_ID request_id, int probe) {
+	msg_sent_count++;
+	trace(TRACE_SEND, request_id, probe);
+	record_call(CALL_REQUEST, request_id, probe);
+	request_sent_time[request_id] = perf_now();
+}
+
+// request_done() is called from the dispatch procedure as each reply arrives
+inline void request_done(DWORD request_id) {
+	int probe = request_probe(request_id);
+	trace(TRACE_REPLY, request_id, probe);
+	if (request_id >= REQUEST_ID_COUNT) return;
+	LONGLONG now = perf_now();
+	if (request_sent_time[request_id] != 0) {
+		hist_add(&request_latency[request_id], perf_us(now - request_sent_time[request_id]));
+		request_sent_time[request_id] = 0;
+	}
+}
+
+// move_sent() is called just before each probe move (SimConnect_SetDataOnSimObject)
+inline void move_sent(int probe) {
+	msg_sent_count++;
+	trace(TRACE_MOVE, DEFINITION_MOVE, probe);
+	record_call(CALL_MOVE, probe, 0);
+	move_sent_time[probe] = perf_now();
+}
+
+// move_done() is called when a probe reply confirms the probe is at its new position
+inline void move_done(int probe) {
+	if (move_sent_time[probe] == 0) return;
+	hist_add(&move_latency, perf_us(perf_now() - move_sent_time[probe]));
+	move_sent_time[probe] = 0;
+}
+
+void print_histogram(const char *name, const Histogram *h) {
+	if (h->total==0) return;
+	printf("\n%-22s n=%6d  mean=%8.2f  p50=%8.2f  p90=%8.2f  p99=%8.2f  max=%8.2f ms",
+		   name, h->total, h->sum_us / h->total / 1000.0,
+		   hist_percentile(h, 50.0) / 1000.0, hist_percentile(h, 90.0) / 1000.0,
+		   hist_percentile(h, 99.0) / 1000.0, h->max_us / 1000.0);
+}
+
+void print_latency() {
+	printf("\nRequest latency:");
+	for (int i=0; i<REQUEST_ID_COUNT; i++) print_histogram(request_name[i], &request_latency[i]);
+	print_histogram("PROBE_MOVE", &move_latency);
+	print_histogram("DISPATCH_TO_PUBLISH", &publish_latency);
+	printf("\n");
+}
+
+// END OF LATENCY HISTOGRAMS
+//*******************************************************************************
+
 //*******************************************************************************
 // client data definitions
 
@@ -151,14 +438,55 @@ const char* SIMLIFT_NAME = "b21_sim_probe";
 
 SIMCONNECT_CLIENT_DATA_ID SIMLIFT_ID = 4179368;
 
-// structure for lift value client data
-struct SimLift {
+SimLift sim_lift = {0.0, 0, version}; // variable to hold the lift client data
+
+// lift values for the other (AI and multiplayer) aircraft being probed, see AIRCRAFT below
+const char* SIMLIFT_MULTI_NAME = "b21_sim_probe_multi";
+
+SIMCONNECT_CLIENT_DATA_ID SIMLIFT_MULTI_ID = 4179369;
+
+const int MAX_AIRCRAFT = 64; // maximum aircraft tracked, including the user aircraft
+
+struct SimLiftAircraft {
+	DWORD object_id;
 	double lift;
-	int status; // 0 = ok, 1 = problem, others = reserved
-	double version;
 };
 
-SimLift sim_lift = {0.0, 0, version}; // variable to hold the lift client data
+struct SimLiftMulti {
+	int count; // number of valid entries in aircraft[]
+	SimLiftAircraft aircraft[MAX_AIRCRAFT-1];
+};
+
+SimLiftMulti sim_lift_multi;
+
+// live flight statistics for the user aircraft ('stats' on the command line), see FLIGHT STATS
+const char* SIMLIFT_STATS_NAME = "b21_sim_probe_stats";
+
+SIMCONNECT_CLIENT_DATA_ID SIMLIFT_STATS_ID = 4179370;
+
+enum STATS_MODE {
+	STATS_GROUND,
+	STATS_CRUISE,
+	STATS_RIDGE, // in ridge lift, not circling
+	STATS_THERMAL // circling and climbing
+};
+
+struct SimLiftStats {
+	int mode; // STATS_MODE
+	int ridge_count; // ridge segments flown
+	int thermal_count; // thermals flown
+	double climb_rate; // m/s, smoothed over a few seconds
+	double climb_average; // m/s, over STATS_WINDOW_SECS
+	double lift_average; // m/s ridge lift from sim_probe, over STATS_WINDOW_SECS
+	double ground_speed; // m/s, over STATS_WINDOW_SECS
+	double distance; // meters flown
+	double lift_climb_correlation; // -1..1, ridge lift against climb rate over the flight
+	double flight_seconds; // airborne time
+	double ridge_seconds;
+	double thermal_seconds;
+};
+
+SimLiftStats sim_lift_stats;
 
 // end of client data definitions
 //*******************************************************************************
@@ -174,17 +502,116 @@ StartupStruct startup_data;
 double wind_direction = 0.0;
 double wind_velocity = 0.0;
 
+//*******************************************************************************
+// AIRCRAFT
+// with 'multi' on the command line, other aircraft within aircraft_radius are enumerated each
+// second with a by-type request and get a ridge lift value too.  All aircraft share the same
+// four probes (and elevation cache): one profile is sampled at a time and the scheduler in
+// next_sample_aircraft() gives the user aircraft a sample every second and fills the time in
+// between with the other aircraft in round-robin order.
+
+struct AircraftState {
+	DWORD object_id;
+	UserStruct pos;
+	double lift;
+	DWORD pos_time; // tick_count() of last position update
+	DWORD sample_time; // tick_count() of last lift sample
+	INT32 sample_count; // lift samples since startup
+	bool active;
+};
+
+const DWORD AI_SAMPLE_INTERVAL_MS = 1000; // sample each other aircraft at most once a second
+const DWORD AIRCRAFT_TIMEOUT_MS = 5000; // forget aircraft not reported for 5 seconds
+
+AircraftState aircraft[MAX_AIRCRAFT]; // aircraft[0] is the user aircraft
+int aircraft_count = 1; // aircraft[0..aircraft_count-1] are in use
+bool multi_aircraft = false; // set by 'multi' on the command line
+double aircraft_radius = 20000.0; // meters, set by 'radius=' on the command line
+
+bool user_sample_due = false; // user position has arrived, sample user as soon as probes are free
+int next_ai = 1; // round-robin position in aircraft[] for the other aircraft
+DWORD multi_start_time = 0; // tick_count() of the first sample, for the stats
+
 int cycle_count = 0; // modulo 4 counter for rotating symbols on console output
 const char *cycle_char = "|/-\\"; // these are the characters cycled through
 
+//*******************************************************************************
+// PROFILE SNAPSHOTS
+// the dispatch thread only decodes messages and drives the probes.  When a profile is complete
+// it is copied into a ProfileSnapshot for that aircraft, and the compute thread calculates the
+// lift from the snapshot (plus the console output and IGC log for the user aircraft) and hands
+// back a LiftResult.  The main loop sends the results to the client data areas, so all the
+// SimConnect calls stay on the main thread.
+//
+// Each aircraft has a seqlock over a pair of slots: the writer fills the slot readers aren't
+// using and then bumps the sequence number, so a reader only retries if the writer has come
+// round to the reader's slot again while it was copying.
+
+struct ProfileSnapshot {
+	UserStruct pos; // aircraft position and wind when the profile was sampled
+	double ground_elevation[PROFILE_COUNT]; // [0] under the aircraft, [i] at probe[i]
+	double wind[PROFILE_COUNT]; // wind along the profile line at each point (with 'windfield')
+	DWORD object_id;
+	int substituted; // probe elevations substituted after a missed deadline
+	bool warm; // taken from the restored state before the probes were ready
+	LONGLONG dispatch_time; // perf_now() when the profile completed
+};
+
+struct LiftResult {
+	double lift;
+	int status; // as SimLift.status
+	bool warm; // from the snapshot
+	DWORD object_id; // from the snapshot, in case aircraft[a] has since been reused
+	LONGLONG dispatch_time; // from the snapshot
+};
+
+ProfileSnapshot snapshot[MAX_AIRCRAFT][2];
+volatile LONG snapshot_seq[MAX_AIRCRAFT] = {0}; // written by the dispatch thread
+LiftResult lift_result[MAX_AIRCRAFT][2];
+volatile LONG lift_result_seq[MAX_AIRCRAFT] = {0}; // written by the compute thread
+
+HANDLE compute_event = NULL; // signalled when there is work for the compute thread
+HANDLE compute_thread_handle = NULL;
+volatile bool compute_quit = false;
+
+// IGC log commands for the compute thread, which owns the IGC log while it is running
+volatile bool igc_write_requested = false;
+volatile bool igc_restart_requested = false;
+
+// igc_startup (see sim_probe_lib.h) is the id and type written into IGC and track files, read
+// by whoever owns the IGC log.  The dispatch thread publishes startup_data to the compute
+// thread in igc_startup_slots[] when the REQUEST_STARTUP_DATA reply arrives.
+StartupStruct igc_startup_slots[2];
+volatile LONG igc_startup_seq = 0; // written by the dispatch thread
+
+// seqlock_write() copies value into the free slot of slots[2] and publishes it (single writer)
+void seqlock_write(volatile LONG *seq, void *slots, size_t size, const void *value) {
+	LONG s = *seq;
+	InterlockedIncrement(seq); // odd while writing slot ((s/2)+1)&1
+	memcpy((char *)slots + size * (((s >> 1) + 1) & 1), value, size);
+	MemoryBarrier();
+	InterlockedIncrement(seq); // even again, the slot just written is the latest
+}
+
+// seqlock_read() copies the latest published slot of slots[2] to value and returns its
+// sequence number (0 => nothing published yet)
+LONG seqlock_read(volatile LONG *seq, const void *slots, size_t size, void *value) {
+	for (;;) {
+		LONG s = *seq & ~1;
+		MemoryBarrier();
+		memcpy(value, (const char *)slots + size * ((s >> 1) & 1), size);
+		MemoryBarrier();
+		// the writer only reaches this slot again once it has finished the other one
+		if (*seq - s < 3) return s;
+	}
+}
+
 //*******************************************************************************
 //*******************************************************************************
 // PROBE DATA
 
-char *probe_model="SimProbe";
+const char *probe_model="SimProbe";
 
-// profile[] is the array of samples of ground elevation (in meters), each set by move_probe(i)
-ProbeStruct profile[PROFILE_COUNT];
 
 DWORD   probe_id[PROFILE_COUNT];            // object id of probe[i]
 
@@ -196,10 +623,6 @@ bool	profile_valid[PROFILE_COUNT] = {false};
 // creation request comes back
 bool	probe_created[PROFILE_COUNT] = {false}; 
 
-// profile_distance is the array of sample distances (in meters) upwind of the user aircraft
-double profile_distance[PROFILE_COUNT] = {0.0, 250.0, 750.0, 2000.0, -100.0 }; //, 5000.0};
-// profile_bearing is the degrees offset relative to wind to apply to the bearing of the probe
-double profile_bearing[PROFILE_COUNT] = {0.0, 0.0, 0.0, 0.0, 0.0}; //, 0.0};
 
 // Struct for probe initial position use when created. (testing: set for Seatac)
 SIMCONNECT_DATA_INITPOSITION probe_position;
@@ -208,88 +631,560 @@ SIMCONNECT_DATA_INITPOSITION probe_position;
 
 bool suppress_object_id_exceptions = false;
 
+// each probe reply must arrive within PROBE_TIMEOUT_MS of the probes being moved, otherwise
+// the elevation for that probe is substituted (from the elevation cache or the previous sample)
+// so that the lift value is still sent on time
+const DWORD PROBE_TIMEOUT_MS = 500;
+
+const double PROBE_PARK_ALTITUDE = 10000.0; // meters, the probes are moved at this altitude
+
+// flag to show the elevation for probe[i] was substituted rather than read from the probe
+bool	profile_substituted[PROFILE_COUNT] = {false};
+// flag to show the elevation for probe[i] came from the along-wind history or the terrain
+// pyramid, and the probe wasn't moved
+bool	profile_reused[PROFILE_COUNT] = {false};
+// flag to show probe[i] has returned at least one real ground elevation since startup
+bool	profile_seen[PROFILE_COUNT] = {false};
+
+// counters for probe replies that missed their deadline
+INT32	probe_miss_count[PROFILE_COUNT] = {0}; // deadline misses for probe[i]
+INT32	probe_cache_count = 0; // misses substituted from the elevation cache
+INT32	probe_prev_count = 0; // misses substituted from the previous sample
+INT32	profile_degraded_count = 0; // lift values sent with status 2 (degraded)
+INT32	profile_count = 0; // total lift values sent
+
+// a probe reply more than PROBE_POSITION_TOLERANCE meters from where the probe was moved is a
+// 'stale' read (sent before FSX applied the move) and is ignored - the subscription will
+// deliver the probe again when it arrives at its new position.  A probe already within
+// PROBE_POSITION_TOLERANCE of its next target is not moved at all.
+const double PROBE_POSITION_TOLERANCE = 10.0;
+INT32	probe_stale_count[PROFILE_COUNT] = {0}; // stale reads of probe[i]
+
+// probe elevations arrive from a per-probe subscription (SIMCONNECT_PERIOD_SIM_FRAME with
+// SIMCONNECT_DATA_REQUEST_FLAG_CHANGED | TAGGED) so only the fields that changed are sent
+// (PROBE_DATUM_ID), and are merged into probe_state[i]
+ProbeStruct probe_state[PROFILE_COUNT]; // latest values received for probe[i]
+MoveStruct	probe_target[PROFILE_COUNT]; // last position probe[i] was moved to
+bool		probe_moved[PROFILE_COUNT] = {false}; // false until probe[i] has been moved once
+INT32	moves_skipped_count = 0; // probe moves not needed, probe already at target
+
+// the sampling cycle (run_sample_cycle()) is one straight-line sequence - pick an aircraft,
+// move the probes, wait for the elevations or the deadline, hand over the profile - that is
+// suspended at each wait and resumed from the step recorded here.  There is one cycle, not one
+// per aircraft or stencil: every profile is taken with the same PROFILE_COUNT-1 AI probes, and
+// profile[], profile_valid[] and the probe targets describe the profile those probes are
+// sampling, so a second cycle could only wait for the first to release them.  Aircraft are
+// sampled in turn (next_sample_aircraft()) and no two samples are ever in flight together.
+enum CYCLE_STEP {
+	CYCLE_IDLE,   // waiting for an aircraft to be due a sample
+	CYCLE_PROBES  // waiting for the probe elevations (or the reply deadline)
+};
+
+struct SampleCycle {
+	CYCLE_STEP step; // where run_sample_cycle() resumes
+	int aircraft; // index in aircraft[] of the aircraft being sampled
+	DWORD start_time; // tick_count() when the probes were moved, for the reply deadline
+};
+
+SampleCycle sample_cycle = { CYCLE_IDLE, 0, 0 };
+
 // END OF PROBE DATA
 //*******************************************************************************
 //*******************************************************************************
 
-const double M_PI = 4.0*atan(1.0); // pi
-const double EARTH_RAD = 6366710.0; // earth's radius in meters
+// elevation cache counters (see ELEVATION CACHE in sim_probe_lib.h)
+INT32 probe_pyramid_count = 0; // far probes answered from the pyramid instead of moved
+INT32 probe_pyramid_sub_count = 0; // late probes substituted from the pyramid
 
-//**********************************************************************************
-// now we have a number of functions to do lat/long calculations to work
-// out the lat/long needed for each probe.
+// along-wind history of each aircraft (see ALONG-WIND HISTORY in sim_probe_lib.h)
+AlongWindHistory wind_history[MAX_AIRCRAFT];
 
-// convert radians at the center of the earth to meters on the surface
-inline double rad2m(double rad)
-{
-    return EARTH_RAD * rad;
+INT32 history_reuse_count = 0; // probe moves saved by interpolating from the history
+//*******************************************************************************
+// WIND FIELD
+// with 'windfield' on the command line each probe also reports its altitude and the ambient
+// wind where it is, in the same tagged subscription message as its ground elevation, and the
+// probes are moved at the aircraft's altitude instead of parked at PROBE_PARK_ALTITUDE.  These
+// samples, and the user aircraft's own wind, go into a direct-mapped wind cache keyed on a
+// lat/long cell and an altitude band.  Each slope of the lift model then uses the wind
+// component along the profile line at its two ends, interpolated from the cache at the
+// aircraft's altitude, instead of the wind at the aircraft.
+
+bool wind_field = false; // set by 'windfield' on the command line
+
+const int WIND_CACHE_SIZE = 1024; // number of cache slots (must be a power of 2)
+const double WIND_CACHE_CELL = 0.01; // grid cell size in degrees (about 1.1km north-south)
+const double WIND_CACHE_BAND = 300.0; // meters of altitude per band
+const double WIND_CACHE_WEIGHT = 0.3; // weight of a new sample in the running mean of a cell
+const DWORD WIND_CACHE_MAX_AGE_MS = 120000; // older cells are not used
+const double PROBE_WIND_CLEARANCE = 100.0; // meters above the known ground for a probe
+
+struct WindCacheEntry {
+	INT32 lat_cell;
+	INT32 long_cell;
+	INT32 band;
+	double north; // mean wind vector, m/s, pointing where the wind comes from
+	double east;
+	DWORD time; // tick_count() of the last sample
+	bool valid;
+};
+
+WindCacheEntry wind_cache[WIND_CACHE_SIZE];
+
+INT32 wind_sample_count = 0; // probe and aircraft winds added
+INT32 wind_point_count = 0; // profile points given a wind from the cache
+INT32 wind_fallback_count = 0; // profile points given the aircraft's wind
+
+inline int wind_cache_slot(INT32 lat_cell, INT32 long_cell, INT32 band) {
+	return (int)((UINT32)(lat_cell * 73856093) ^ (UINT32)(long_cell * 19349663) ^ (UINT32)(band * 83492791)) & (WIND_CACHE_SIZE-1);
 }
 
-// convert metres on earths surface to radians subtended at the centre
-inline double m2rad(double distance)
-{
-    return distance / EARTH_RAD;
+// wind_cache_put() adds a wind sample at a point and altitude to the running mean of its cell
+void wind_cache_put(double latitude, double longitude, double altitude, double velocity, double direction) {
+	INT32 lat_cell = INT32(floor(latitude / WIND_CACHE_CELL));
+	INT32 long_cell = INT32(floor(longitude / WIND_CACHE_CELL));
+	INT32 band = INT32(floor(altitude / WIND_CACHE_BAND));
+	double north = velocity * cos(deg2rad(direction));
+	double east = velocity * sin(deg2rad(direction));
+	WindCacheEntry *e = &wind_cache[wind_cache_slot(lat_cell, long_cell, band)];
+	DWORD now = tick_count();
+	wind_sample_count++;
+	if (e->valid && e->lat_cell==lat_cell && e->long_cell==long_cell && e->band==band &&
+		now - e->time <= WIND_CACHE_MAX_AGE_MS) {
+		e->north += (north - e->north) * WIND_CACHE_WEIGHT;
+		e->east += (east - e->east) * WIND_CACHE_WEIGHT;
+	} else {
+		e->lat_cell = lat_cell;
+		e->long_cell = long_cell;
+		e->band = band;
+		e->north = north;
+		e->east = east;
+		e->valid = true;
+	}
+	e->time = now;
 }
 
-// convert degrees to radians
-inline double deg2rad(double deg)
-{
-    return deg * (M_PI / 180.0);
+// wind_cache_get() interpolates the wind vector at a point and altitude between the centres of
+// the surrounding cells and bands (trilinear, over the ones that are cached), returns false if
+// none of them is
+bool wind_cache_get(double latitude, double longitude, double altitude, double *north, double *east) {
+	double x = latitude / WIND_CACHE_CELL - 0.5;
+	double y = longitude / WIND_CACHE_CELL - 0.5;
+	double z = altitude / WIND_CACHE_BAND - 0.5;
+	INT32 lat0 = INT32(floor(x)), long0 = INT32(floor(y)), band0 = INT32(floor(z));
+	double fx = x - lat0, fy = y - long0, fz = z - band0;
+	DWORD now = tick_count();
+	double weight = 0.0, n = 0.0, e = 0.0;
+	for (int k=0; k<8; k++) {
+		INT32 lat_cell = lat0 + (k & 1), long_cell = long0 + ((k >> 1) & 1), band = band0 + (k >> 2);
+		const WindCacheEntry *c = &wind_cache[wind_cache_slot(lat_cell, long_cell, band)];
+		if (!c->valid || c->lat_cell!=lat_cell || c->long_cell!=long_cell || c->band!=band ||
+			now - c->time > WIND_CACHE_MAX_AGE_MS) continue;
+		double w = ((k & 1) ? fx : 1.0 - fx) * (((k >> 1) & 1) ? fy : 1.0 - fy) * ((k >> 2) ? fz : 1.0 - fz);
+		weight += w;
+		n += w * c->north;
+		e += w * c->east;
+	}
+	if (weight < 1e-6) return false;
+	*north = n / weight;
+	*east = e / weight;
+	return true;
 }
 
-// convert radians to degrees
+// wind_along() is the wind component (m/s) at a profile point along the aircraft's wind line,
+// from the cache at the aircraft's altitude, or the aircraft's wind if it isn't cached
+double wind_along(const UserStruct *pos, double latitude, double longitude) {
+	double north, east;
+	if (!wind_cache_get(latitude, longitude, pos->altitude, &north, &east)) {
+		wind_fallback_count++;
+		return pos->wind_velocity;
+	}
+	wind_point_count++;
+	double b = deg2rad(pos->wind_direction);
+	return north * cos(b) + east * sin(b);
+}
 
-inline double rad2deg(double rad)
-{
-    return rad * (180.0 / M_PI);
-}
-
-// distance_and_bearing(...) returns a new lat/long a distance and bearing from lat1,lon1.
-// lat, longs and bearings in degrees, distance in meters
-MoveStruct distance_and_bearing(double lat1, double long1, double distance, double bearing) {
-	double rlat1, rlong1, rbearing, rdistance, rlat2, rlong2;
-	MoveStruct r;
-	rlat1 = deg2rad(lat1);
-	rlong1 = deg2rad(long1);
-	rdistance = m2rad(distance);
-	rbearing = deg2rad(bearing);
-	rlat2 = asin(sin(rlat1)*cos(rdistance)+cos(rlat1)*sin(rdistance)*cos(rbearing));
-	if (cos(rlat2)==0) {
-        rlong2 = rlong1;      // endpoint a pole
-	}
-	else {
-		rlong2 = fmod((rlong1+asin(sin(rbearing)*sin(rdistance)/cos(rlat2))+M_PI),(2*M_PI))-M_PI;
-	}
-	r.latitude = rad2deg(rlat2);
-	r.longitude = rad2deg(rlong2);
-	return r;
+// END OF WIND FIELD
+//*******************************************************************************
+
+//*******************************************************************************
+// SURFACE FIT
+// with 'surfacefit' on the command line the measured ground elevations are also fitted with a
+// quadratic surface z = a + bx + cy + dx^2 + exy + fy^2 in each tile of a grid over the terrain
+// (x and y from -1 to 1 across the tile).  The tiles are a direct-mapped table like the
+// elevation cache, shared by every aircraft.  The fit is recursive least squares: each sample
+// is a rank-one update of the coefficients and of P (the inverse of the normal matrix), so a
+// sample costs the same however many the tile already has.  A profile point in a tile whose fit
+// is well determined there, and has been predicting its new samples well, is answered from the
+// fit instead of moving a probe.  Unlike the elevation cache and the along-wind history, the
+// fit doesn't need an earlier sample at the point or on its wind line, so it still answers
+// after a wind shift or a turn.  One probe still moves for each profile (in turn) so the fits
+// keep being checked against the ground.
+
+bool surface_fit = false; // set by 'surfacefit' on the command line
+
+const int SURFACE_FIT_TILES = 1024; // number of tile slots (must be a power of 2)
+const int SURFACE_FIT_TERMS = 6; // 1, x, y, x^2, xy, y^2
+const double SURFACE_FIT_PRIOR = 1.0e4; // initial P diagonal, i.e. next to no prior
+const INT32 SURFACE_FIT_MIN_SAMPLES = 8; // before the fit of a tile is used
+const double SURFACE_FIT_MAX_RMS = 5.0; // meters, error of the fit predicting its new samples
+const double SURFACE_FIT_RMS_WEIGHT = 0.2; // weight of a new squared error in the running mean
+const double SURFACE_FIT_MAX_LEVERAGE = 0.5; // variance of the fit at a point, relative to a sample's
+
+struct SurfaceFitTile {
+	INT32 lat_cell;
+	INT32 long_cell;
+	double theta[SURFACE_FIT_TERMS]; // coefficients, meters
+	double P[SURFACE_FIT_TERMS][SURFACE_FIT_TERMS];
+	double mean_square; // running mean of the squared prediction error of new samples (m^2)
+	INT32 count; // samples in the fit, 0 => slot empty
+};
+
+SurfaceFitTile surface_fit_tiles[SURFACE_FIT_TILES];
+
+int surface_fit_live = 0; // probe that moves whatever the fit says, in turn
+INT32 surface_fit_point_count = 0; // profile points answered from the fit
+INT32 surface_fit_sample_count = 0; // elevations added to the fit
+
+// surface_fit_tile() returns the slot of the tile containing a point, and sets phi to the terms
+// of the quadratic at the point
+SurfaceFitTile *surface_fit_tile(double latitude, double longitude, INT32 *lat_cell, INT32 *long_cell, double *phi) {
+	double u = latitude / SURFACE_FIT_TILE, v = longitude / SURFACE_FIT_TILE;
+	*lat_cell = INT32(floor(u));
+	*long_cell = INT32(floor(v));
+	double x = 2.0 * (v - *long_cell) - 1.0;
+	double y = 2.0 * (u - *lat_cell) - 1.0;
+	phi[0] = 1.0;
+	phi[1] = x;
+	phi[2] = y;
+	phi[3] = x * x;
+	phi[4] = x * y;
+	phi[5] = y * y;
+	return &surface_fit_tiles[elev_cache_slot(*lat_cell, *long_cell) & (SURFACE_FIT_TILES-1)];
 }
 
-//*******************************************************************
-// igc file logger vars
-//*******************************************************************
-const int IGC_TICK_COUNT = 4; // log every 4 seconds
-const INT32 IGC_MAX_RECORDS = 20000; // log a maximum of this many 'B' records.
-const INT32 IGC_MIN_RECORDS = 20; // don't record an IGC file if it is shorter than 20 B records long
-const INT32 IGC_MIN_FLIGHT_SECS_TO_LANDING = 80; // don't trigger a log save on landing unless
-                                                 // airborne for at least 80 seconds
+// surface_fit_add() adds a measured elevation to the fit of its tile (one recursive least
+// squares step), starting the tile if the slot held another one
+void surface_fit_add(double latitude, double longitude, double ground_elevation) {
+	INT32 lat_cell, long_cell;
+	double phi[SURFACE_FIT_TERMS], u[SURFACE_FIT_TERMS];
+	SurfaceFitTile *t = surface_fit_tile(latitude, longitude, &lat_cell, &long_cell, phi);
+	if (t->count==0 || t->lat_cell!=lat_cell || t->long_cell!=long_cell) {
+		memset(t, 0, sizeof(*t));
+		t->lat_cell = lat_cell;
+		t->long_cell = long_cell;
+		for (int j=0; j<SURFACE_FIT_TERMS; j++) t->P[j][j] = SURFACE_FIT_PRIOR;
+	}
+	double predicted = 0.0, leverage = 0.0;
+	for (int j=0; j<SURFACE_FIT_TERMS; j++) {
+		predicted += t->theta[j] * phi[j];
+		u[j] = 0.0;
+		for (int k=0; k<SURFACE_FIT_TERMS; k++) u[j] += t->P[j][k] * phi[k];
+		leverage += phi[j] * u[j];
+	}
+	// the error only says how good the fit is once it has as many samples as terms
+	double error = ground_elevation - predicted;
+	if (t->count==SURFACE_FIT_TERMS) t->mean_square = error * error;
+	else if (t->count>SURFACE_FIT_TERMS) t->mean_square += (error * error - t->mean_square) * SURFACE_FIT_RMS_WEIGHT;
+	double gain = 1.0 / (1.0 + leverage);
+	for (int j=0; j<SURFACE_FIT_TERMS; j++) {
+		t->theta[j] += u[j] * gain * error;
+		for (int k=0; k<SURFACE_FIT_TERMS; k++) t->P[j][k] -= u[j] * u[k] * gain;
+	}
+	t->count++;
+	surface_fit_sample_count++;
+}
+
+// surface_fit_get() returns true and the elevation of the fit at a point, if the tile has
+// enough samples, has been predicting them well and its fit is well determined at the point
+bool surface_fit_get(double latitude, double longitude, double *ground_elevation) {
+	INT32 lat_cell, long_cell;
+	double phi[SURFACE_FIT_TERMS];
+	const SurfaceFitTile *t = surface_fit_tile(latitude, longitude, &lat_cell, &long_cell, phi);
+	if (t->count<SURFACE_FIT_MIN_SAMPLES || t->lat_cell!=lat_cell || t->long_cell!=long_cell ||
+		t->mean_square > SURFACE_FIT_MAX_RMS * SURFACE_FIT_MAX_RMS) return false;
+	double z = 0.0, leverage = 0.0;
+	for (int j=0; j<SURFACE_FIT_TERMS; j++) {
+		z += t->theta[j] * phi[j];
+		double u = 0.0;
+		for (int k=0; k<SURFACE_FIT_TERMS; k++) u += t->P[j][k] * phi[k];
+		leverage += phi[j] * u;
+	}
+	if (leverage > SURFACE_FIT_MAX_LEVERAGE) return false;
+	*ground_elevation = z;
+	return true;
+}
 
-int igc_tick_counter = 0; // variable to keep track of how many ticks we've counted 0..MENU_TICK_COUNT
-INT32 igc_record_count = 0; // count of how many 'B' records we've recorded
+// END OF SURFACE FIT
+//*******************************************************************************
 
-INT32 igc_takeoff_time; // note time of last "SIM ON GROUND"->!(SIM ON GROUND) transition
-INT32 igc_prev_on_ground = 0;
+// ridge index state (see RIDGE INDEX in sim_probe_lib.h)
+bool ridge_user_near = true; // the last profile of the user aircraft crossed the index
+DWORD ridge_pos_time = 0; // tick_count() of the last user position subscription reply
+DWORD ridge_fast_sent = 0; // extra user position requests since then
+INT32 ridge_probed_count = 0; // profiles near a ridge
+INT32 ridge_flat_count = 0; // profiles taken as flat
+INT32 ridge_fast_count = 0; // extra user position requests
+
+//*******************************************************************************
+// WARM START
+// the first lift of a session used to wait for the four probes to be created, then for the
+// position subscription, then for a full probe cycle.  Now the position subscription starts
+// with the probe creation, and until the probes are ready the user aircraft's profile is
+// answered (if it can be) from the elevation cache, terrain pyramid and along-wind history
+// left by the previous session: 'state=<file>' restores them at startup and saves them at
+// quit.  These 'warm' lifts are sent with status 2 (degraded).
+//
+// The time from the connection to each startup stage is kept in startup_time[] and printed
+// when the first probed lift is sent, and at quit.
+
+enum STARTUP_STAGE {
+	STARTUP_CONNECT,      // SIMCONNECT_RECV_ID_OPEN
+	STARTUP_SIM_START,    // EVENT_SIM_START
+	STARTUP_POSITION,     // first user position
+	STARTUP_PROBES_READY, // all probes created
+	STARTUP_FIRST_LIFT,   // first user lift sent (warm or probed)
+	STARTUP_PROBED_LIFT,  // first user lift sent from the probes
+	STARTUP_STAGE_COUNT
+};
+
+const char *startup_stage_name[STARTUP_STAGE_COUNT] = {
+	"connect", "sim start", "first position", "probes ready", "first lift", "first probed lift"
+};
+
+DWORD startup_time[STARTUP_STAGE_COUNT]; // tick_count() when each stage was reached
+bool startup_reached[STARTUP_STAGE_COUNT] = {false};
+
+INT32 warm_lift_count = 0; // user lifts sent before the probes were ready
+
+// startup_mark() records the first time a stage is reached
+void startup_mark(STARTUP_STAGE stage) {
+	if (startup_reached[stage]) return;
+	startup_reached[stage] = true;
+	startup_time[stage] = tick_count();
+}
+
+void print_startup_times() {
+	printf("\nStartup:");
+	for (int k=1; k<STARTUP_STAGE_COUNT; k++) {
+		if (startup_reached[k]) printf(" %s +%dms", startup_stage_name[k], int(startup_time[k] - startup_time[STARTUP_CONNECT]));
+		else printf(" %s -", startup_stage_name[k]);
+	}
+	printf(" (%d warm lift(s))", warm_lift_count);
+}
+
+const char *state_file = ""; // set by 'state=' on the command line
+bool state_restored = false;
+
+// state_restore() installs a WarmState, returns false if it is from an incompatible build
+bool state_restore(const WarmState *w) {
+	if (!state_check(w)) return false;
+	state_restore_elevations(w);
+	wind_history[0] = w->wind_history;
+	wind_direction = w->wind_direction;
+	wind_velocity = w->wind_velocity;
+	state_restored = true;
+	return true;
+}
+
+// state_load() restores the state saved by the previous session, if there is one
+bool state_load(const char *fn) {
+	return state_read(fn, &warm_state) && state_restore(&warm_state);
+}
+
+// state_save() writes the elevation cache, pyramid and user wind history for the next session
+void state_save(const char *fn) {
+	FILE *f;
+	memcpy(warm_state.magic, "SPST", 4);
+	warm_state.version = WARM_STATE_VERSION;
+	warm_state.elev_cache_size = ELEV_CACHE_SIZE;
+	warm_state.elev_pyramid_size = ELEV_PYRAMID_SIZE;
+	warm_state.elev_pyramid_levels = ELEV_PYRAMID_LEVELS;
+	warm_state.along_wind_samples = ALONG_WIND_SAMPLES;
+	warm_state.wind_direction = wind_direction;
+	warm_state.wind_velocity = wind_velocity;
+	memcpy(warm_state.elev_cache, elev_cache, sizeof(elev_cache));
+	memcpy(warm_state.elev_pyramid, elev_pyramid, sizeof(elev_pyramid));
+	warm_state.wind_history = wind_history[0];
+	if (fopen_s(&f, fn, "wb") != 0) {
+		printf("\nError: couldn't open state file %s for writing.\n", fn);
+		return;
+	}
+	fwrite(&warm_state, sizeof(warm_state), 1, f);
+	fclose(f);
+}
+
+// END OF WARM START
+//*******************************************************************************
 
-struct igc_b {
-	INT32 zulu_time;
-	double latitude;
-	double longitude;
-	double altitude;
+//*******************************************************************************
+// FLIGHT STATS
+// flight_stats_add() takes each user fix with its computed lift, on the compute thread, and
+// updates SimLiftStats in constant time and memory: running sums over a ring of the last
+// STATS_WINDOW_SECS of fixes for the window averages and the turn, and whole-flight sums for
+// the distance, times and the lift/climb correlation.  Circling through STATS_CIRCLE_DEGREES
+// in the window while climbing is a thermal; otherwise a window average ridge lift of
+// STATS_RIDGE_LIFT without sinking is ridge soaring.  The main loop publishes the stats to the
+// "b21_sim_probe_stats" client data area when 'stats' is on the command line.
+//*******************************************************************************
+
+bool flight_stats = false; // set by 'stats' on the command line
+
+const int STATS_WINDOW_SECS = 30;
+const int STATS_RING = 64; // fixes in the window, more than one per second
+const int STATS_MAX_GAP_SECS = 10; // a longer gap (pause, slew) restarts the window
+const double STATS_CLIMB_TIME_CONSTANT = 4.0; // seconds
+const double STATS_CIRCLE_DEGREES = 300.0;
+const double STATS_RIDGE_LIFT = 0.5; // m/s
+const double STATS_RIDGE_MIN_CLIMB = -0.3; // m/s
+
+struct StatsFix {
+	INT32 time;
+	double climb; // m/s since the previous fix
+	double dt; // seconds since the previous fix
+	double distance; // meters since the previous fix
+	double lift;
+	double turn; // degrees since the previous fix, clockwise positive
 };
 
-igc_b igc_pos[IGC_MAX_RECORDS];
+struct FlightStatsState {
+	bool have_prev;
+	UserStruct prev;
+	double prev_track; // degrees, ground track into prev (-1 if unknown)
+	StatsFix ring[STATS_RING];
+	int ring_start;
+	int ring_count;
+	double window_dt, window_climb, window_distance, window_lift, window_turn; // sums over ring
+	double n, sum_x, sum_y, sum_xx, sum_yy, sum_xy; // lift (x) against climb (y), whole flight
+	SimLiftStats stats;
+};
+
+FlightStatsState flight_stats_state;
+SimLiftStats flight_stats_slots[2];
+volatile LONG flight_stats_seq = 0; // written by the compute thread
+
+void flight_stats_window_reset(FlightStatsState *f) {
+	f->ring_start = f->ring_count = 0;
+	f->window_dt = f->window_climb = f->window_distance = f->window_lift = f->window_turn = 0.0;
+	f->prev_track = -1.0;
+}
+
+void flight_stats_reset() {
+	memset(&flight_stats_state, 0, sizeof(flight_stats_state));
+	flight_stats_window_reset(&flight_stats_state);
+}
+
+void flight_stats_window_drop(FlightStatsState *f) {
+	StatsFix *old = &f->ring[f->ring_start];
+	f->window_dt -= old->dt;
+	f->window_climb -= old->climb * old->dt;
+	f->window_distance -= old->distance;
+	f->window_lift -= old->lift * old->dt;
+	f->window_turn -= old->turn;
+	f->ring_start = (f->ring_start + 1) % STATS_RING;
+	f->ring_count--;
+}
+
+// flight_stats_add() updates the stats with fix pos and the lift computed for it, returns true
+// if the stats changed
+bool flight_stats_add(const UserStruct *pos, double lift) {
+	FlightStatsState *f = &flight_stats_state;
+	SimLiftStats *st = &f->stats;
+	if (!f->have_prev || pos->zulu_time - f->prev.zulu_time > STATS_MAX_GAP_SECS || pos->zulu_time < f->prev.zulu_time) {
+		flight_stats_window_reset(f);
+		f->have_prev = true;
+		f->prev = *pos;
+		return false;
+	}
+	double dt = double(pos->zulu_time - f->prev.zulu_time);
+	if (dt <= 0.0) return false; // same second (zulu time resolution), wait for the next
+	StatsFix fix;
+	fix.time = pos->zulu_time;
+	fix.dt = dt;
+	fix.climb = (pos->altitude - f->prev.altitude) / dt;
+	fix.distance = approx_distance(f->prev.latitude, f->prev.longitude, pos->latitude, pos->longitude);
+	fix.lift = lift;
+	fix.turn = 0.0;
+	if (fix.distance > 1.0) {
+		double x = deg2rad(pos->longitude - f->prev.longitude) * cos(deg2rad(pos->latitude));
+		double y = deg2rad(pos->latitude - f->prev.latitude);
+		double track = rad2deg(atan2(x, y));
+		if (f->prev_track >= 0.0) {
+			fix.turn = fmod(track - f->prev_track + 540.0, 360.0) - 180.0;
+		}
+		f->prev_track = track<0.0 ? track + 360.0 : track;
+	}
+	f->prev = *pos;
+
+	// window
+	while (f->ring_count>0 && (f->ring_count==STATS_RING || fix.time - f->ring[f->ring_start].time >= STATS_WINDOW_SECS)) {
+		flight_stats_window_drop(f);
+	}
+	f->ring[(f->ring_start + f->ring_count) % STATS_RING] = fix;
+	f->ring_count++;
+	f->window_dt += fix.dt;
+	f->window_climb += fix.climb * fix.dt;
+	f->window_distance += fix.distance;
+	f->window_lift += fix.lift * fix.dt;
+	f->window_turn += fix.turn;
+
+	double alpha = 1.0 - exp(-dt / STATS_CLIMB_TIME_CONSTANT);
+	st->climb_rate += (fix.climb - st->climb_rate) * alpha;
+	st->climb_average = f->window_climb / f->window_dt;
+	st->lift_average = f->window_lift / f->window_dt;
+	st->ground_speed = f->window_distance / f->window_dt;
+
+	// mode and flight totals
+	int mode;
+	if (pos->sim_on_ground) mode = STATS_GROUND;
+	else if (fabs(f->window_turn) >= STATS_CIRCLE_DEGREES && st->climb_average > 0.0) mode = STATS_THERMAL;
+	else if (st->lift_average >= STATS_RIDGE_LIFT && st->climb_average >= STATS_RIDGE_MIN_CLIMB) mode = STATS_RIDGE;
+	else mode = STATS_CRUISE;
+	if (mode==STATS_RIDGE && st->mode!=STATS_RIDGE) st->ridge_count++;
+	if (mode==STATS_THERMAL && st->mode!=STATS_THERMAL) st->thermal_count++;
+	st->mode = mode;
+	if (mode!=STATS_GROUND) {
+		st->flight_seconds += dt;
+		st->distance += fix.distance;
+		if (mode==STATS_RIDGE) st->ridge_seconds += dt;
+		if (mode==STATS_THERMAL) st->thermal_seconds += dt;
+		f->n += 1.0;
+		f->sum_x += lift;
+		f->sum_y += fix.climb;
+		f->sum_xx += lift * lift;
+		f->sum_yy += fix.climb * fix.climb;
+		f->sum_xy += lift * fix.climb;
+		double var_x = f->n * f->sum_xx - f->sum_x * f->sum_x;
+		double var_y = f->n * f->sum_yy - f->sum_y * f->sum_y;
+		if (var_x > 0.0 && var_y > 0.0) {
+			st->lift_climb_correlation = (f->n * f->sum_xy - f->sum_x * f->sum_y) / sqrt(var_x * var_y);
+		}
+	}
+	return true;
+}
+
+const char *stats_mode_name[] = { "ground", "cruise", "ridge", "thermal" };
+
+void print_flight_stats() {
+	const SimLiftStats *st = &flight_stats_state.stats;
+	printf("\nFlight: %.1f km in %.0f s, ridge %d segments %.0f s, thermal %d %.0f s, lift/climb correlation %.2f",
+		   st->distance / 1000.0, st->flight_seconds, st->ridge_count, st->ridge_seconds,
+		   st->thermal_count, st->thermal_seconds, st->lift_climb_correlation);
+	printf("\nNow %s, climb %+.1f m/s (%+.1f avg), ridge lift %+.1f avg, %.0f km/h\n",
+		   stats_mode_name[st->mode], st->climb_rate, st->climb_average, st->lift_average, st->ground_speed * 3.6);
+}
+
+// END OF FLIGHT STATS
+//*******************************************************************************
+
+//*******************************************************************
+// igc file logger vars
+//*******************************************************************
+INT32 igc_takeoff_time; // note time of last "SIM ON GROUND"->!(SIM ON GROUND) transition
+INT32 igc_prev_on_ground = 0;
 
-char *igc_log_directory = "";
+const char *igc_log_directory = "";
+bool track_log = false; // write the binary track log instead of the IGC file ('track')
 
 //**********************************************************************************
 //******* IGC FILE ROUTINES                                                 ********
@@ -302,35 +1197,44 @@ void igc_start_log() {
 }
 
 void get_startup_data() {
-    HRESULT hr;
     // set data request
-    hr = SimConnect_RequestDataOnSimObject(hSimConnect, 
-                                            REQUEST_STARTUP_DATA, 
-                                            DEFINITION_STARTUP, 
-                                            SIMCONNECT_OBJECT_ID_USER,
-                                            SIMCONNECT_PERIOD_ONCE); 
+    request_sent(REQUEST_STARTUP_DATA, 0);
+    SimConnect_RequestDataOnSimObject(hSimConnect, 
+                                       REQUEST_STARTUP_DATA, 
+                                       DEFINITION_STARTUP, 
+                                       SIMCONNECT_OBJECT_ID_USER,
+                                       SIMCONNECT_PERIOD_ONCE); 
 
 }
 
-void igc_log_point(UserStruct p) {
+// igc_log_point() logs the snapshot position with the lift computed from it, the wind and the
+// probe elevations, all already in hand so the extra channels cost no SimConnect traffic
+void igc_log_point(const ProfileSnapshot *snap, double lift) {
+	const UserStruct &p = snap->pos;
 	if (igc_record_count<IGC_MAX_RECORDS) {
 		if (igc_record_count==0 || p.zulu_time!=igc_pos[igc_record_count-1].zulu_time) {
-			igc_pos[igc_record_count].latitude = p.latitude;
-			igc_pos[igc_record_count].longitude = p.longitude;
-			igc_pos[igc_record_count].altitude = p.altitude;
-			igc_pos[igc_record_count].zulu_time =p.zulu_time;
+			igc_b *b = &igc_pos[igc_record_count];
+			b->latitude = p.latitude;
+			b->longitude = p.longitude;
+			b->altitude = p.altitude;
+			b->ground_elevation = p.ground_elevation;
+			b->lift = lift;
+			b->wind_velocity = p.wind_velocity;
+			b->wind_direction = p.wind_direction;
+			for (int i=1; i<PROFILE_COUNT; i++) b->probe_elevation[i-1] = snap->ground_elevation[i];
+			b->zulu_time =p.zulu_time;
 			igc_record_count++;
 		}
 	}
 }
 
 void igc_write_file() {
-	FILE *f;
 	const int MAXBUF = 1000;
 	char buf[MAXBUF];
 	char fn[MAXBUF];
-	errno_t err;
 
+	// no IGC files from a replayed capture
+	if (replaying) return;
 	// do NOT write a file if it would be smaller than threshold, to avoid lots of small files
 	if (igc_record_count<IGC_MIN_RECORDS) {
 		if (debug) printf("\nigc_write_file suppressed: IGC record count below minimum.\n");
@@ -342,63 +1246,15 @@ void igc_write_file() {
     time(&ltime);
     _localtime64_s( &today, &ltime );
 	strcpy_s(fn, MAXBUF, igc_log_directory);
-	strcat_s(fn, startup_data.atc_id);
-	strftime(buf, MAXBUF, "_%Y-%m-%d_%H%M.igc", &today );
+	strcat_s(fn, igc_startup.atc_id);
+	strftime(buf, MAXBUF, track_log ? "_%Y-%m-%d_%H%M.spt" : "_%Y-%m-%d_%H%M.igc", &today );
 	strcat_s(fn, buf);
 
 	// debug
-	if (debug) printf("\nWriting IGC file: %s\n",fn);
-
-	if( (err = fopen_s(&f, fn, "w")) != 0 ) {
-		printf( "\nError: couldn't open log file %s for writing.\n", fn);
-		return;
-	} else {
-		// ok we've opened the log file - lets write all the data to it
-		fprintf(f,         "AXXXb21_sim_probe %.2f\n", version); // manufacturer
-		strftime( buf, 50, "HFDTE%d%m%y\n", &today );            // date
-		fprintf(f,buf);
-		fprintf(f,         "HFFXA035\n");                        // gps accuracy
-		fprintf(f,         "HFPLTPILOTINCHARGE: not recorded\n");
-		fprintf(f,         "HFCM2CREW2: not recorded\n");
-		fprintf(f,         "HFGTYGLIDERTYPE:%s\n", startup_data.atc_type);
-		fprintf(f,         "HFGIDGLIDERID:%s\n", startup_data.atc_id);
-		fprintf(f,         "HFDTM100GPSDATUM: WGS-1984\n");
-		fprintf(f,         "HFRFWFIRMWAREVERSION: %.2f\n", version);
-		fprintf(f,         "HFRHWHARDWAREVERSION: 2008\n");
-		fprintf(f,         "HFFTYFRTYPE: sim_probe by Ian Forster-Lewis\n");
-		fprintf(f,         "HFGPSGPS:Microsoft Flight Simulator\n");
-		fprintf(f,         "HFPRSPRESSALTSENSOR: Microsoft Flight Simulator\n");
-		fprintf(f,         "HFCIDCOMPETITIONID:%s\n", startup_data.atc_id);
-		fprintf(f,         "HFCCLCOMPETITIONCLASS:Microsoft Flight Simulator\n");
-		fprintf(f,         "I013638FXA\n"); // extension record to say gps accuracy at end of 'B' recs
-		// now do the 'B' location records
-		for (INT32 i=0; i<igc_record_count; i++) {
-			int hours = igc_pos[i].zulu_time / 3600;
-			int minutes = (igc_pos[i].zulu_time - hours * 3600 ) / 60;
-			int secs = igc_pos[i].zulu_time % 60;
-			char NS = (igc_pos[i].latitude>0.0) ? 'N' : 'S';
-			char EW = (igc_pos[i].longitude>0.0) ? 'E' : 'W';
-			double abs_latitude = fabs(igc_pos[i].latitude);
-			double abs_longitude = fabs(igc_pos[i].longitude);
-			int lat_DD = int(abs_latitude);
-			int lat_MM = int( (abs_latitude - float(lat_DD)) * 60.0);
-			int lat_mmm = int( (abs_latitude - float(lat_DD) - (float(lat_MM) / 60.0)) * 60000.0);
-			int long_DDD = int(abs_longitude);
-			int long_MM = int((abs_longitude - float(long_DDD)) * 60.0);
-			int long_mmm = int((abs_longitude - float(long_DDD) - (float(long_MM) / 60.0)) * 60000.0);
-			int altitude = int(igc_pos[i].altitude);
-
-//			fprintf(f,     "B %02.2d %02.2d %02.2d %02.2d %02.2d %03.3d %c %03.3d %02.2d %03.3d %c A %05.5d %05.5d 000\n",
-			fprintf(f,     "B%02.2d%02.2d%02.2d%02.2d%02.2d%03.3d%c%03.3d%02.2d%03.3d%cA%05.5d%05.5d000\n",
-				    hours, minutes, secs,
-					lat_DD, lat_MM, lat_mmm, NS,
-					long_DDD, long_MM, long_mmm, EW,
-					altitude, altitude);
-		}
-		fprintf(f,         "G123456789\n");
+	if (debug) printf("\nWriting %s file: %s\n", track_log ? "track" : "IGC", fn);
 
-		fclose(f);
-	}
+	if (track_log) track_write(fn, &today);
+	else igc_write_igc(fn, &today);
 }
 
 void igc_ground_check(INT32 on_ground, INT32 zulu_time) {
@@ -425,112 +1281,383 @@ void igc_ground_check(INT32 on_ground, INT32 zulu_time) {
 }
 
 //**********************************************************************************
+// FLIGHT RECORDER
+// 'recorder' on the command line logs every aircraft within aircraft_radius (the user aircraft
+// included) to its own IGC file, <log dir><atc id>_<date>_<object id>.igc, for races and
+// group flights.  The positions come from the REQUEST_AIRCRAFT_POS by-type request made for
+// each user position (about 1Hz).  The dispatch thread only copies each fix into a
+// single-producer/single-consumer ring; the recorder thread formats the B records and owns
+// the files.  Each track is streamed to disk through a fixed RECORDER_BUFFER byte buffer, so
+// memory stays bounded however long the flight.  The ATC id/type come from a by-type
+// DEFINITION_STARTUP request made when an unknown aircraft appears; a track holds up to
+// RECORDER_HOLD_FIXES fixes for its id before the file is opened regardless.  The dispatch
+// thread keeps the aircraft it has seen in recorder_known[]: an id that arrives before the
+// aircraft's first fix is kept there and sent with that fix, and an aircraft not reported for
+// RECORDER_TIMEOUT_MS is dropped and its track closed (all tracks are closed at quit), so if
+// it comes back it is identified again.  A replay makes the same ATC id requests but writes
+// no files.
 //**********************************************************************************
-//******* NOW WE HAVE THE LIFT CALCULATION FORMULA
-
-double agl_factor(double user_alt, double ground_elevation) {
-	// agl_factor (0..1) is the multiple to apply to base lift to take into
-	// account the user altitude AGL, i.e. the lift drops off with height AGL
-	// agl_factor is linear from zero to BOUNDARY1 (40 meters)
-	// agl_factor is 1 from BOUNDARY1 to BOUNDARY2 (80 meters)
-	// agl_factor decays exponentially from BOUNDARY2 upwards
-	const double ZERO_FACTOR = 0.5; // agl_factor at zero meters AGL
-	const double BOUNDARY1 = 40.0; // agl altitude (meters) where agl_factor=1
-	const double BOUNDARY2 = 130.0; // agl altitude (meters) where agl_factor=1
-
-	double agl_alt = max(user_alt - ground_elevation,0.0);
-
-	if (agl_alt<BOUNDARY1) { return ZERO_FACTOR + (1-ZERO_FACTOR)*agl_alt/BOUNDARY1; }
-	else if (agl_alt<BOUNDARY2) { return 1.0; }
-	return exp(-(2+2*ground_elevation/4000)*(agl_alt-BOUNDARY2)/max(ground_elevation, 200));
-}
-
-double adj_slope(double slope) {
-	double s = sin(atan(5.0 * pow(fabs(slope),1.7)));
-	if (slope<0) { s = -s;}
-	return s;
-}
-
-// ***************************************************************************************
-// HERE IS THE FORMULA THAT CALCULATES THE RIDGE LIFT GIVEN THE PROBE HEIGHTS & WIND ETC.
-// ***************************************************************************************
-double ridge_lift() {
-	if (debug_calls) printf(" ..entering ridge_lift()..");
-	// we have the probe values in ProbeStruct profile[PROFILE_COUNT];
-	// i.e. ground elevation at probe[i] is profile[i].ground_elevation
-	//
-	// probe[i] horizontal distance from user aircraft is profile_distance[i]
-	//
-	// horizontal wind speed is wind_velocity
-	double slope[PROFILE_COUNT-1];
-	double factor[PROFILE_COUNT-1];
-	// after the factors for each slope are calculated, multiply each by a weighting:
-	double weight[PROFILE_COUNT-1] = {0.2, 0.2, 0.5, 0.2};
-	// first set slope[i] to real slope from probe[i] to probe[i+1]
-	// (+ve slope => +ve lift)
-	// the last probe will have slope calculated to user aircraft ground
-	slope[0]= (profile[0].ground_elevation - profile[1].ground_elevation)/profile_distance[1];
-	slope[1]= (profile[1].ground_elevation - profile[2].ground_elevation)/(profile_distance[2]-profile_distance[1]);
-	slope[2]= (profile[2].ground_elevation - profile[3].ground_elevation)/(profile_distance[3]-profile_distance[2]);
-	// the last probe will have slope calculated to user aircraft ground
-	// and profile_distance will be negative
-	slope[3]= (profile[4].ground_elevation - profile[0].ground_elevation)/(-profile_distance[4]);
-
-	// now update factors to normalise between -1 and 1
-	factor[0] = adj_slope(slope[0]) * weight[0];
-
-	factor[1] = adj_slope(slope[1]) * weight[1];
-
-	factor[2] = 0.0; // factor[2] (upwind distance) is always 0 or negative
-	if (slope[2]<0.0) factor[2] = adj_slope(slope[2]) * weight[2];
-
-	factor[3] = 0.0; // factor[3] (back slope) cannot reduce positive slope[0]
-	if (slope[3]>0.0 || slope[0]<0.0) factor[3] = adj_slope(slope[3]) * weight[3];
-
-	double aircraft_agl_factor = agl_factor(user_pos.altitude, user_pos.ground_elevation);
-
-	//debug
-	if (debug) {
-		printf("\n agl_factor = ,%.3f, Factors ,%.3f,%.3f,%.3f,%.3f,",aircraft_agl_factor,factor[0],factor[1],factor[2],factor[3]);
+
+bool flight_recorder = false; // set by 'recorder' on the command line
+
+const int RECORDER_RING = 4096; // fixes in flight between the threads
+const int RECORDER_MAX_TRACKS = 128;
+const int RECORDER_HOLD_FIXES = 8;
+const int RECORDER_BUFFER = 4096; // stdio buffer per track
+const DWORD RECORDER_TIMEOUT_MS = 30000;
+const DWORD RECORDER_FLUSH_MS = 5000;
+const DWORD RECORDER_ID_INTERVAL_MS = 5000; // least time between ATC id requests
+
+enum RECORDER_ENTRY {
+	RECORDER_FIX,
+	RECORDER_ID, // always followed by the track's first fix, or sent to a track already open
+	RECORDER_CLOSE
+};
+
+struct RecorderEntry {
+	DWORD type; // RECORDER_ENTRY
+	DWORD object_id;
+	DWORD time; // tick_count()
+	igc_b fix; // RECORDER_FIX
+	char atc_id[32]; // RECORDER_ID
+	char atc_type[32];
+};
+
+struct RecorderTrack {
+	DWORD object_id; // 0 => free
+	FILE *f; // NULL if not opened, or the open failed
+	bool opened;
+	bool identified;
+	char atc_id[32];
+	char atc_type[32];
+	igc_b held[RECORDER_HOLD_FIXES]; // fixes waiting for the ATC id
+	int held_count;
+	INT32 last_zulu;
+	DWORD last_time; // tick_count() of the last fix
+	INT32 fix_count;
+	char buffer[RECORDER_BUFFER];
+};
+
+RecorderEntry recorder_ring[RECORDER_RING];
+volatile LONG recorder_head = 0; // entries written, by the dispatch thread
+volatile LONG recorder_tail = 0; // entries consumed, by the recorder thread
+RecorderTrack recorder_track[RECORDER_MAX_TRACKS]; // owned by the recorder thread
+HANDLE recorder_event = NULL;
+HANDLE recorder_thread_handle = NULL;
+volatile bool recorder_quit = false;
+
+// an aircraft known to the dispatch thread, which has a track on the recorder thread once a
+// fix has been sent for it
+struct RecorderKnown {
+	DWORD object_id;
+	DWORD last_time; // tick_count() of the last fix (or of the ATC id, before the first fix)
+	bool has_track; // an entry has been queued for it, so the recorder thread has a track
+	bool identified; // ATC id received
+	char atc_id[32];
+	char atc_type[32];
+};
+
+// dispatch thread state
+RecorderKnown recorder_known[RECORDER_MAX_TRACKS];
+int recorder_known_count = 0;
+DWORD recorder_id_request_time = 0;
+bool recorder_id_requested = false;
+INT32 recorder_drop_count = 0; // fixes dropped with the ring full
+
+// stats, written by the recorder thread
+INT32 recorder_fix_count = 0;
+INT32 recorder_track_count = 0;
+
+// recorder_push() claims the next ring entry for the dispatch thread, or returns NULL if full
+RecorderEntry *recorder_push() {
+	if (recorder_head - recorder_tail >= RECORDER_RING) {
+		recorder_drop_count++;
+		return NULL;
 	}
-	if (debug_calls) printf(" ..leaving ridge_lift()..\n");
-	return wind_velocity * (factor[0] + factor[1] + factor[2] + factor[3])  * aircraft_agl_factor;
+	return &recorder_ring[recorder_head % RECORDER_RING];
 }
 
-//*********************************************************************************************
+// recorder_publish() hands the entry from recorder_push() to the recorder thread
+void recorder_publish() {
+	MemoryBarrier(); // entry contents before the head
+	InterlockedIncrement(&recorder_head);
+}
+
+// recorder_known_find() returns the dispatch thread's entry for the aircraft, adding it if
+// there is room, or NULL
+RecorderKnown *recorder_known_find(DWORD object_id) {
+	for (int k=0; k<recorder_known_count; k++) {
+		if (recorder_known[k].object_id==object_id) return &recorder_known[k];
+	}
+	if (recorder_known_count==RECORDER_MAX_TRACKS) return NULL;
+	RecorderKnown *r = &recorder_known[recorder_known_count++];
+	memset(r, 0, sizeof(*r));
+	r->object_id = object_id;
+	r->last_time = tick_count();
+	return r;
+}
+
+// recorder_send_id() queues the ATC id of an aircraft for its track, returns false if the
+// ring is full
+bool recorder_send_id(const RecorderKnown *r) {
+	if (replaying) return true;
+	RecorderEntry *e = recorder_push();
+	if (e==NULL) return false;
+	e->type = RECORDER_ID;
+	e->object_id = r->object_id;
+	e->time = tick_count();
+	strcpy_s(e->atc_id, r->atc_id);
+	strcpy_s(e->atc_type, r->atc_type);
+	recorder_publish();
+	return true;
+}
+
+// recorder_expire() drops the aircraft not reported for RECORDER_TIMEOUT_MS and closes
+// their tracks
+void recorder_expire() {
+	for (int k=0; k<recorder_known_count; ) {
+		RecorderKnown *r = &recorder_known[k];
+		if (tick_count() - r->last_time <= RECORDER_TIMEOUT_MS) {
+			k++;
+			continue;
+		}
+		if (r->has_track && !replaying) {
+			RecorderEntry *e = recorder_push();
+			if (e==NULL) return; // tried again with the next fix
+			e->type = RECORDER_CLOSE;
+			e->object_id = r->object_id;
+			e->time = tick_count();
+			recorder_publish();
+		}
+		*r = recorder_known[--recorder_known_count];
+	}
+}
+
+// recorder_fix() queues a REQUEST_AIRCRAFT_POS reply, and asks for the ATC ids if the
+// aircraft is new (dispatch thread)
+void recorder_fix(DWORD object_id, const UserStruct *pos, double lift) {
+	recorder_expire();
+	RecorderKnown *r = recorder_known_find(object_id);
+	if (r==NULL) return; // RECORDER_MAX_TRACKS aircraft already
+	r->last_time = tick_count();
+	if (!r->has_track && r->identified) {
+		// an ATC id that arrived before the first fix goes just ahead of it
+		if (!recorder_send_id(r)) return;
+		r->has_track = true;
+	}
+	RecorderEntry *e = replaying ? NULL : recorder_push();
+	if (e!=NULL || replaying) r->has_track = true;
+	if (e!=NULL) {
+		e->type = RECORDER_FIX;
+		e->object_id = object_id;
+		e->time = tick_count();
+		memset(&e->fix, 0, sizeof(e->fix));
+		e->fix.zulu_time = pos->zulu_time;
+		e->fix.latitude = pos->latitude;
+		e->fix.longitude = pos->longitude;
+		e->fix.altitude = pos->altitude;
+		e->fix.ground_elevation = pos->ground_elevation;
+		e->fix.lift = lift;
+		e->fix.wind_velocity = pos->wind_velocity;
+		e->fix.wind_direction = pos->wind_direction;
+		recorder_publish();
+		SetEvent(recorder_event);
+	}
+	if (!r->identified &&
+		(!recorder_id_requested || tick_count() - recorder_id_request_time >= RECORDER_ID_INTERVAL_MS)) {
+		recorder_id_requested = true;
+		recorder_id_request_time = tick_count();
+		request_sent(REQUEST_RECORDER_ID, 0);
+		SimConnect_RequestDataOnSimObjectType(hSimConnect, REQUEST_RECORDER_ID, DEFINITION_STARTUP,
+											  DWORD(aircraft_radius), SIMCONNECT_SIMOBJECT_TYPE_AIRCRAFT);
+	}
+}
+
+// recorder_id() takes a REQUEST_RECORDER_ID reply, and queues it for the aircraft's track if
+// it has one; otherwise it is kept until the first fix (dispatch thread)
+void recorder_id(DWORD object_id, const StartupStruct *s) {
+	RecorderKnown *r = recorder_known_find(object_id);
+	if (r==NULL || r->identified) return;
+	strcpy_s(r->atc_id, s->atc_id);
+	strcpy_s(r->atc_type, s->atc_type);
+	// if the ring is full the id is asked for again when the next fix arrives
+	r->identified = !r->has_track || recorder_send_id(r);
+}
+
+// the rest runs on the recorder thread
+
+// recorder_find() returns the aircraft's track, or a new one if create, or NULL
+RecorderTrack *recorder_find(DWORD object_id, bool create) {
+	RecorderTrack *free_track = NULL;
+	for (int k=0; k<RECORDER_MAX_TRACKS; k++) {
+		if (recorder_track[k].object_id==object_id) return &recorder_track[k];
+		if (recorder_track[k].object_id==0 && free_track==NULL) free_track = &recorder_track[k];
+	}
+	if (free_track==NULL || !create) return NULL;
+	memset(free_track, 0, offsetof(RecorderTrack, buffer));
+	free_track->object_id = object_id;
+	free_track->last_zulu = -1;
+	return free_track;
+}
+
+void recorder_write_fix(RecorderTrack *t, const igc_b *fix) {
+	char buf[200];
+	igc_format_b_record(buf, sizeof(buf), fix);
+	fputs(buf, t->f);
+	t->fix_count++;
+	recorder_fix_count++;
+}
+
+// recorder_open() opens the track's file and writes the held fixes
+void recorder_open(RecorderTrack *t) {
+	t->opened = true;
+	if (!t->identified) sprintf_s(t->atc_id, "object%u", t->object_id);
+	time_t ltime;
+	struct tm today;
+	time(&ltime);
+	_localtime64_s(&today, &ltime);
+	char date[40], fn[1000];
+	strftime(date, sizeof(date), "%Y-%m-%d_%H%M", &today);
+	sprintf_s(fn, sizeof(fn), "%s%s_%s_%u.igc", igc_log_directory, t->atc_id, date, t->object_id);
+	if (fopen_s(&t->f, fn, "w") != 0) {
+		printf("\nError: couldn't open recorder file %s for writing.\n", fn);
+		t->f = NULL;
+	} else {
+		setvbuf(t->f, t->buffer, _IOFBF, RECORDER_BUFFER);
+		igc_write_header(t->f, &today, t->atc_id, t->atc_type);
+		if (debug) printf("\nRecording aircraft %u (%s) to %s", t->object_id, t->atc_id, fn);
+	}
+	recorder_track_count++;
+	for (int k=0; k<t->held_count; k++) {
+		if (t->f) recorder_write_fix(t, &t->held[k]);
+		else recorder_fix_count++;
+	}
+	t->held_count = 0;
+}
+
+void recorder_close(RecorderTrack *t) {
+	if (t->object_id==0) return;
+	if (!t->opened && t->held_count>0) recorder_open(t);
+	if (t->f) {
+		fprintf(t->f, "G123456789\n");
+		fclose(t->f);
+	}
+	t->object_id = 0;
+	t->f = NULL;
+}
+
+void recorder_take(const RecorderEntry *e) {
+	RecorderTrack *t = recorder_find(e->object_id, e->type!=RECORDER_CLOSE);
+	if (t==NULL) return; // all tracks in use, or closing a track that never opened
+	if (e->type==RECORDER_CLOSE) {
+		recorder_close(t);
+		return;
+	}
+	if (e->type==RECORDER_ID) {
+		strcpy_s(t->atc_id, e->atc_id);
+		strcpy_s(t->atc_type, e->atc_type);
+		t->identified = true;
+		return; // opened with the next fix
+	}
+	t->last_time = e->time;
+	if (e->fix.zulu_time==t->last_zulu) return; // one fix per second, as igc_log_point()
+	t->last_zulu = e->fix.zulu_time;
+	if (!t->opened && !t->identified && t->held_count<RECORDER_HOLD_FIXES) {
+		t->held[t->held_count++] = e->fix;
+		return;
+	}
+	if (!t->opened) recorder_open(t);
+	if (t->f) recorder_write_fix(t, &e->fix);
+	else recorder_fix_count++;
+}
+
+// recorder_drain() takes every queued entry, then flushes the files
+void recorder_drain() {
+	static DWORD flush_time = 0;
+	while (recorder_tail != recorder_head) {
+		MemoryBarrier(); // head before the entry contents
+		recorder_take(&recorder_ring[recorder_tail % RECORDER_RING]);
+		InterlockedIncrement(&recorder_tail);
+	}
+	DWORD now = tick_count();
+	if (now - flush_time < RECORDER_FLUSH_MS) return;
+	flush_time = now;
+	for (int k=0; k<RECORDER_MAX_TRACKS; k++) {
+		if (recorder_track[k].object_id!=0 && recorder_track[k].f) fflush(recorder_track[k].f);
+	}
+}
+
+DWORD WINAPI recorder_thread(LPVOID) {
+	trace_thread = 2;
+	while (!recorder_quit) {
+		WaitForSingleObject(recorder_event, 100);
+		recorder_drain();
+	}
+	recorder_drain();
+	for (int k=0; k<RECORDER_MAX_TRACKS; k++) recorder_close(&recorder_track[k]);
+	return 0;
+}
+
+void start_recorder_thread() {
+	if (!flight_recorder) return;
+	recorder_quit = false;
+	recorder_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+	recorder_thread_handle = CreateThread(NULL, 0, recorder_thread, NULL, 0, NULL);
+}
+
+// stop_recorder_thread() writes the queued fixes and closes every track
+void stop_recorder_thread() {
+	if (recorder_thread_handle==NULL) return;
+	recorder_quit = true;
+	SetEvent(recorder_event);
+	WaitForSingleObject(recorder_thread_handle, INFINITE);
+	CloseHandle(recorder_thread_handle);
+	CloseHandle(recorder_event);
+	recorder_thread_handle = NULL;
+	recorder_event = NULL;
+}
+
+void print_recorder_stats() {
+	printf("\nRecorder: %d fixes from %d aircraft, %d dropped (ring full)", recorder_fix_count, recorder_track_count, recorder_drop_count);
+}
+
+// END OF FLIGHT RECORDER
+//**********************************************************************************
 
 void remove_probes()
 {
-    if (debug_calls) printf("\n..entering remove_probes()..");
-    HRESULT hr;
+    trace(TRACE_ENTER, FN_REMOVE_PROBES, 0);
 	if (probe_created[1]) {
 		probe_created[1] = false;
-		hr = SimConnect_AIRemoveObject(hSimConnect, probe_id[1], REQUEST_PROBE_REMOVE1);
+		request_sent(REQUEST_PROBE_REMOVE1, 1);
+		SimConnect_AIRemoveObject(hSimConnect, probe_id[1], REQUEST_PROBE_REMOVE1);
 	}
 	if (probe_created[2]) {
 		probe_created[2] = false;
-		hr = SimConnect_AIRemoveObject(hSimConnect, probe_id[2], REQUEST_PROBE_REMOVE2);
+		request_sent(REQUEST_PROBE_REMOVE2, 2);
+		SimConnect_AIRemoveObject(hSimConnect, probe_id[2], REQUEST_PROBE_REMOVE2);
 	}
 	if (probe_created[3]) {
 		probe_created[3] = false;
-		hr = SimConnect_AIRemoveObject(hSimConnect, probe_id[3], REQUEST_PROBE_REMOVE3);
+		request_sent(REQUEST_PROBE_REMOVE3, 3);
+		SimConnect_AIRemoveObject(hSimConnect, probe_id[3], REQUEST_PROBE_REMOVE3);
 	}
 	if (probe_created[4]) {
 		probe_created[4] = false;
-		hr = SimConnect_AIRemoveObject(hSimConnect, probe_id[4], REQUEST_PROBE_REMOVE4);
+		request_sent(REQUEST_PROBE_REMOVE4, 4);
+		SimConnect_AIRemoveObject(hSimConnect, probe_id[4], REQUEST_PROBE_REMOVE4);
 	}
 //	if (probe_created[5]) {
 //		probe_created[5] = false;
 //		hr = SimConnect_AIRemoveObject(hSimConnect, probe_id[5], REQUEST_PROBE_REMOVE5);
 //	}
-    if (debug_calls) printf("\n..leaving remove_probes()..");
+    trace(TRACE_LEAVE, FN_REMOVE_PROBES, 0);
     
 }
 
 void create_probes()
 {
-    if (debug_calls) printf("\n..entering create_probes()..");
-    HRESULT hr;
+    trace(TRACE_ENTER, FN_CREATE_PROBES, 0);
 
     
     // Initialize probes at Seatac
@@ -549,26 +1676,37 @@ void create_probes()
 	// for (int i=1; i<PROFILE_COUNT; i++) probe_created[i] = false;
 
 	// now create probes
-    if (!probe_created[1]) hr = SimConnect_AICreateSimulatedObject(hSimConnect, probe_model, probe_position, REQUEST_PROBE_CREATE1);
-    if (!probe_created[2]) hr = SimConnect_AICreateSimulatedObject(hSimConnect, probe_model, probe_position, REQUEST_PROBE_CREATE2);
-    if (!probe_created[3]) hr = SimConnect_AICreateSimulatedObject(hSimConnect, probe_model, probe_position, REQUEST_PROBE_CREATE3);
-    if (!probe_created[4]) hr = SimConnect_AICreateSimulatedObject(hSimConnect, probe_model, probe_position, REQUEST_PROBE_CREATE4);
+    if (!probe_created[1]) {
+		request_sent(REQUEST_PROBE_CREATE1, 1);
+		SimConnect_AICreateSimulatedObject(hSimConnect, probe_model, probe_position, REQUEST_PROBE_CREATE1);
+	}
+    if (!probe_created[2]) {
+		request_sent(REQUEST_PROBE_CREATE2, 2);
+		SimConnect_AICreateSimulatedObject(hSimConnect, probe_model, probe_position, REQUEST_PROBE_CREATE2);
+	}
+    if (!probe_created[3]) {
+		request_sent(REQUEST_PROBE_CREATE3, 3);
+		SimConnect_AICreateSimulatedObject(hSimConnect, probe_model, probe_position, REQUEST_PROBE_CREATE3);
+	}
+    if (!probe_created[4]) {
+		request_sent(REQUEST_PROBE_CREATE4, 4);
+		SimConnect_AICreateSimulatedObject(hSimConnect, probe_model, probe_position, REQUEST_PROBE_CREATE4);
+	}
     //hr = SimConnect_AICreateSimulatedObject(hSimConnect, probe_model, probe_position, REQUEST_PROBE_CREATE5);
-    if (debug_calls) printf("\n..leaving create_probes()..");   
+    trace(TRACE_LEAVE, FN_CREATE_PROBES, 0);
 }
 
 //*****************************************************************************************
 // freeze_probe(i) transmits the event to 'freeze' the altitude & attitude of probe[i]
 void freeze_probe(int i) {
-	HRESULT hr;
 	//hr = SimConnect_AIReleaseControl(hSimConnect, probe_id[i], request_probe_release[i]);
-	hr = SimConnect_TransmitClientEvent(hSimConnect,
+	SimConnect_TransmitClientEvent(hSimConnect,
 										probe_id[i],
 										EVENT_FREEZE_ALTITUDE,
 										1, // set freeze value to 1
 										SIMCONNECT_GROUP_PRIORITY_HIGHEST,
 										SIMCONNECT_EVENT_FLAG_GROUPID_IS_PRIORITY);
-	hr = SimConnect_TransmitClientEvent(hSimConnect,
+	SimConnect_TransmitClientEvent(hSimConnect,
 										probe_id[i],
 										EVENT_FREEZE_ATTITUDE,
 										1, // set freeze value to 1
@@ -576,107 +1714,315 @@ void freeze_probe(int i) {
 										SIMCONNECT_EVENT_FLAG_GROUPID_IS_PRIORITY);
 }
 
-//*****************************************************************************************
-// calc_profile_latlongs() populates profile[i].lat/long for each element of profile
-void calc_profile_latlongs() {
-	double distance, bearing; // meters, degrees
-	//debug calc wind bearing here
-	// wind_bearing = wind_bearing + 10.0; // test rotation on each call
-    profile[0].latitude = user_pos.latitude;
-    profile[0].longitude = user_pos.longitude;
-    for (int i=1; i<PROFILE_COUNT; i++) {
-		distance = profile_distance[i];
-		bearing = wind_direction + profile_bearing[i];
-		MoveStruct p = distance_and_bearing(user_pos.latitude, user_pos.longitude, distance, bearing);
-		profile[i].latitude = p.latitude;
-		profile[i].longitude = p.longitude;
-	}
-}
-
-void get_user_pos()
+// subscribe_probe(i) subscribes to the ground elevation (and actual lat/long) of probe[i],
+// called once when the probe is created.  FSX then sends the changed fields whenever the
+// probe is moved, so no read request is needed per profile.
+void subscribe_probe(int i)
 {
-    HRESULT hr;
-    if (debug_calls) printf(" ..entering get_user_pos()..");
+	DATA_REQUEST_ID request_id = DATA_REQUEST_ID(REQUEST_PROBE_POS1+i-1);
+	probe_moved[i] = false;
+	request_sent(request_id, i);
+    SimConnect_RequestDataOnSimObject(hSimConnect,request_id,DEFINITION_PROBE_POS,probe_id[i],
+											SIMCONNECT_PERIOD_SIM_FRAME,
+											SIMCONNECT_DATA_REQUEST_FLAG_CHANGED | SIMCONNECT_DATA_REQUEST_FLAG_TAGGED);
+}
 
-    // set data request
-    hr = SimConnect_RequestDataOnSimObjectType(hSimConnect, 
-                                            REQUEST_USER_POS, 
-                                            DEFINITION_USER_POS, 
-                                            0,  // radius = 0 => user aircraft
-                                            SIMCONNECT_SIMOBJECT_TYPE_USER); 
-    if (debug_calls) printf(" ..leaving get_user_pos()..");
+// merge_probe_data(i,...) copies the tagged (datum id, value) pairs of a probe reply into
+// probe_state[i]
+void merge_probe_data(int i, SIMCONNECT_RECV_SIMOBJECT_DATA *pObjData) {
+	char *p = (char*)&pObjData->dwData;
+	for (DWORD k=0; k<pObjData->dwDefineCount; k++) {
+		DWORD datum_id = *(DWORD*)p;
+		double value;
+		memcpy(&value, p + sizeof(DWORD), sizeof(double));
+		p += sizeof(DWORD) + sizeof(double);
+		switch (datum_id) {
+			case PROBE_DATUM_ELEVATION: probe_state[i].ground_elevation = value; break;
+			case PROBE_DATUM_LATITUDE: probe_state[i].latitude = value; break;
+			case PROBE_DATUM_LONGITUDE: probe_state[i].longitude = value; break;
+			case PROBE_DATUM_ALTITUDE: probe_state[i].altitude = value; break;
+			case PROBE_DATUM_WIND_VELOCITY: probe_state[i].wind_velocity = value; break;
+			case PROBE_DATUM_WIND_DIRECTION: probe_state[i].wind_direction = value; break;
+		}
+	}
 }
 
-void get_probes_pos()
-{
-	HRESULT hr;
-	// request the probe data for all probes
-    hr = SimConnect_RequestDataOnSimObject(hSimConnect,REQUEST_PROBE_POS1,DEFINITION_PROBE_POS,probe_id[1],SIMCONNECT_PERIOD_ONCE); 
-    hr = SimConnect_RequestDataOnSimObject(hSimConnect,REQUEST_PROBE_POS2,DEFINITION_PROBE_POS,probe_id[2],SIMCONNECT_PERIOD_ONCE); 
-    hr = SimConnect_RequestDataOnSimObject(hSimConnect,REQUEST_PROBE_POS3,DEFINITION_PROBE_POS,probe_id[3],SIMCONNECT_PERIOD_ONCE); 
-    hr = SimConnect_RequestDataOnSimObject(hSimConnect,REQUEST_PROBE_POS4,DEFINITION_PROBE_POS,probe_id[4],SIMCONNECT_PERIOD_ONCE); 
-    //hr = SimConnect_RequestDataOnSimObject(hSimConnect,REQUEST_PROBE_POS5,DEFINITION_PROBE_POS,probe_id[5],SIMCONNECT_PERIOD_ONCE); 
+void run_sample_cycle(); // below, resumes the sampling cycle
+
+// probe_altitude() is the altitude for a probe sampling the wind (see WIND FIELD): the
+// aircraft's, but clear of the highest ground known around the target, or parked out of the
+// way if the ground there is unknown
+double probe_altitude(const UserStruct *pos, double latitude, double longitude) {
+	double ground, min_elevation, mean_elevation;
+	if (!elev_cache_get(latitude, longitude, &ground) &&
+		!elev_pyramid_get(latitude, longitude, 1, &min_elevation, &mean_elevation, &ground)) return PROBE_PARK_ALTITUDE;
+	return max(pos->altitude, ground + PROBE_WIND_CLEARANCE);
 }
 
 //*******************************************************************************************
 // HERE IS WHERE WE MOVE THE PROBES
-// get_profile() gets ground_elevation sample 0 (user aircraft) and triggers next sample
-void get_profile()
+// get_profile(a) gets ground_elevation sample 0 (aircraft[a]) and moves the probes to the
+// sample points, the elevations arrive via process_probe_reply()
+void get_profile(int a)
 {
-    if (debug_calls) printf("\n..entering get_profile()..");
-    HRESULT hr;
+    trace(TRACE_ENTER, FN_GET_PROFILE, a);
     MoveStruct move_pos;
+	const UserStruct *pos = &aircraft[a].pos;
+
+    calc_profile_latlongs(pos);
+    profile[0].ground_elevation = pos->ground_elevation;
+	elev_cache_put(pos->latitude, pos->longitude, pos->ground_elevation);
+	AlongWindHistory *history = &wind_history[a];
+	history_check(history, pos);
+	if (surface_fit) surface_fit_live = surface_fit_live % (PROFILE_COUNT-1) + 1;
+
+	// with a ridge index, a profile whose wind line crosses no ridge is taken as flat and the
+	// probes stay where they are
+	if (ridge_cell_count>0) {
+		bool near = ridge_near(pos->latitude, pos->longitude, pos->wind_direction);
+		if (a==0) ridge_user_near = near;
+		if (!near) {
+			for (int i=1; i<PROFILE_COUNT; i++) {
+				profile[i].ground_elevation = pos->ground_elevation;
+				profile_valid[i] = true;
+				profile_substituted[i] = false;
+				profile_reused[i] = true;
+			}
+			ridge_flat_count++;
+			trace(TRACE_LEAVE, FN_GET_PROFILE, a);
+			return;
+		}
+		ridge_probed_count++;
+	}
 
-    calc_profile_latlongs();
-    profile[0].ground_elevation = user_pos.ground_elevation;
-
-    // move the probes to the sample points
+    // move the probes to the sample points - the probe subscriptions then deliver the
+    // elevations from the new positions
 	for (int i=1; i<PROFILE_COUNT; i++) {
 		profile_valid[i] = false;
+		profile_substituted[i] = false;
+		profile_reused[i] = false;
 		// initialise move position to lat/long of user aircraft
-		move_pos.altitude = 10000;
+		move_pos.altitude = wind_field ? probe_altitude(pos, profile[i].latitude, profile[i].longitude) : PROBE_PARK_ALTITUDE;
 	    move_pos.latitude = profile[i].latitude;
 		move_pos.longitude = profile[i].longitude;
+		// no move needed if the probe was already moved there.  If its latest reply came from
+		// there no message will come from the subscription, so use that elevation; otherwise
+		// the reply from the move is still on its way and the subscription delivers it.
+		if (probe_moved[i] &&
+			approx_distance(probe_target[i].latitude, probe_target[i].longitude,
+							move_pos.latitude, move_pos.longitude) <= PROBE_POSITION_TOLERANCE) {
+			if (approx_distance(probe_state[i].latitude, probe_state[i].longitude,
+								probe_target[i].latitude, probe_target[i].longitude) <= PROBE_POSITION_TOLERANCE) {
+				profile[i].ground_elevation = probe_state[i].ground_elevation;
+				profile_valid[i] = true;
+			}
+			moves_skipped_count++;
+			continue;
+		}
+		// a point already covered by the along-wind history is interpolated from it
+		if (history_get(history, move_pos.latitude, move_pos.longitude, &profile[i].ground_elevation)) {
+			profile_valid[i] = true;
+			profile_reused[i] = true;
+			history_reuse_count++;
+			continue;
+		}
+		// a far probe is answered from the terrain pyramid (mean over its footprint) if the
+		// footprint cell has been sampled enough
+		int level = far_probe_level(profile_distance[i]);
+		double min_elevation, mean_elevation, max_elevation;
+		if (level>0 && elev_pyramid_get(move_pos.latitude, move_pos.longitude, level,
+										&min_elevation, &mean_elevation, &max_elevation)) {
+			profile[i].ground_elevation = mean_elevation;
+			profile_valid[i] = true;
+			profile_reused[i] = true;
+			probe_pyramid_count++;
+			continue;
+		}
+		// with 'surfacefit' a point in a well fitted tile is taken from the fit, apart from
+		// the live probe of this profile
+		if (surface_fit && i!=surface_fit_live &&
+			surface_fit_get(move_pos.latitude, move_pos.longitude, &profile[i].ground_elevation)) {
+			profile_valid[i] = true;
+			profile_reused[i] = true;
+			surface_fit_point_count++;
+			continue;
+		}
 		// now set data on probe[i]
-		hr = SimConnect_SetDataOnSimObject(hSimConnect, DEFINITION_MOVE, probe_id[i], 0, 0, sizeof(move_pos), &move_pos);
+		probe_target[i] = move_pos;
+		probe_moved[i] = true;
+		probe_asked = true;
+		move_sent(i);
+		SimConnect_SetDataOnSimObject(hSimConnect, DEFINITION_MOVE, probe_id[i], 0, 0, sizeof(move_pos), &move_pos);
+	}
+
+    trace(TRACE_LEAVE, FN_GET_PROFILE, a);
+}
+
+// get_aircraft_pos() requests the positions of all other aircraft within aircraft_radius,
+// one REQUEST_AIRCRAFT_POS reply arrives for each aircraft
+void get_aircraft_pos()
+{
+    request_sent(REQUEST_AIRCRAFT_POS, 0);
+    SimConnect_RequestDataOnSimObjectType(hSimConnect,
+                                       REQUEST_AIRCRAFT_POS,
+                                       DEFINITION_USER_POS,
+                                       DWORD(aircraft_radius),
+                                       SIMCONNECT_SIMOBJECT_TYPE_AIRCRAFT);
+}
+
+// update_aircraft() stores the position of another aircraft from a REQUEST_AIRCRAFT_POS reply
+void update_aircraft(DWORD object_id, const UserStruct *pos) {
+	if (object_id == aircraft[0].object_id) return; // by-type replies include the user aircraft
+	int a, free_slot = -1;
+	for (a=1; a<aircraft_count; a++) {
+		if (aircraft[a].active && aircraft[a].object_id == object_id) break;
+		if (!aircraft[a].active && free_slot<0) free_slot = a;
 	}
+	if (a == aircraft_count) {
+		// new aircraft - reuse an inactive slot or add one to the end of the table
+		if (free_slot>=0) a = free_slot;
+		else if (aircraft_count<MAX_AIRCRAFT) a = aircraft_count++;
+		else return; // table full
+		memset(&aircraft[a], 0, sizeof(aircraft[a]));
+		wind_history[a].count = 0;
+		aircraft[a].object_id = object_id;
+		aircraft[a].active = true;
+		if (debug) printf("\nTracking aircraft %d (object id %d)", a, object_id);
+	}
+	aircraft[a].pos = *pos;
+	aircraft[a].pos_time = tick_count();
+}
+
+//**********************************************************************************
+// aircraft_lift() returns the last lift published for object_id, 0 if it isn't being sampled
+double aircraft_lift(DWORD object_id) {
+	for (int a=0; a<aircraft_count; a++) {
+		if (aircraft[a].active && aircraft[a].object_id==object_id) return aircraft[a].lift;
+	}
+	return 0.0;
+}
+
+//**********************************************************************************
+// next_sample_aircraft() is the probe scheduler, sets *a to the aircraft to sample next or
+// returns false if none is due.  The probes sample one aircraft at a time: the user aircraft
+// whenever its position has arrived, otherwise the next other aircraft (round-robin) that
+// hasn't been sampled for AI_SAMPLE_INTERVAL_MS.
+bool next_sample_aircraft(int *a) {
+	if (user_sample_due) {
+		user_sample_due = false;
+		*a = 0;
+		return true;
+	}
+	DWORD now = tick_count();
+	for (int k=1; k<aircraft_count; k++) {
+		int n = next_ai;
+		next_ai = (next_ai < aircraft_count-1) ? next_ai+1 : 1;
+		if (!aircraft[n].active) continue;
+		if (now - aircraft[n].pos_time > AIRCRAFT_TIMEOUT_MS) {
+			aircraft[n].active = false;
+			if (debug) printf("\nAircraft %d (object id %d) no longer reported", n, aircraft[n].object_id);
+			continue;
+		}
+		if (aircraft[n].sample_count==0 || now - aircraft[n].sample_time >= AI_SAMPLE_INTERVAL_MS) {
+			*a = n;
+			return true;
+		}
+	}
+	return false;
+}
+
+// publish_multi_lift() writes the lift values of the other aircraft to the client data area
+void publish_multi_lift() {
+	int n = 0;
+	for (int a=1; a<aircraft_count; a++) {
+		if (!aircraft[a].active || aircraft[a].sample_count==0) continue;
+		sim_lift_multi.aircraft[n].object_id = aircraft[a].object_id;
+		sim_lift_multi.aircraft[n].lift = aircraft[a].lift;
+		n++;
+	}
+	sim_lift_multi.count = n;
+	msg_sent_count++;
+	record_call(CALL_CLIENT_DATA, 1, n);
+	SimConnect_SetClientData(hSimConnect,
+											SIMLIFT_MULTI_ID,
+											DEFINITION_SIMLIFT_MULTI,
+											SIMCONNECT_DATA_SET_FLAG_DEFAULT,
+											0, // reserved
+											sizeof(sim_lift_multi),
+											&sim_lift_multi);
+}
 
-	// calling get_user_pos() triggers the sequence that gets all the probe elevations
-	get_user_pos();
+// print_aircraft_stats() prints lift samples per aircraft (with the latency histograms)
+void print_aircraft_stats() {
+	double seconds = double(tick_count() - multi_start_time) / 1000.0;
+	if (seconds <= 0.0) return;
+	INT32 total = 0;
+	int active = 0;
+	printf("\nAircraft samples:");
+	for (int a=0; a<aircraft_count; a++) {
+		total += aircraft[a].sample_count;
+		if (!aircraft[a].active) continue;
+		active++;
+		printf("\n  aircraft %2d id %8d: %6d samples, %.2f per second, lift %+.2f",
+			   a, aircraft[a].object_id, aircraft[a].sample_count,
+			   aircraft[a].sample_count / seconds, aircraft[a].lift);
+	}
+	printf("\n%d aircraft active, %.1f profiles per second in total\n", active, total / seconds);
+}
 
-    if (debug_calls) printf(" ..leaving get_profile().. \n");
+
+// probes_ready() is true when all the probes have been created
+bool probes_ready() {
+	for (int i=1; i<PROFILE_COUNT; i++) {
+		if (!probe_created[i]) return false;
+	}
+	return true;
 }
 
+bool user_pos_subscribed = false; // REQUEST_USER_POS_AND_PROFILE subscription is running
 
 void get_user_pos_and_profile()
 {
-    if (debug_calls) printf("\n..entering get_user_pos_and_profile()..");
-    HRESULT hr;
+    trace(TRACE_ENTER, FN_GET_USER_POS_AND_PROFILE, 0);
+	user_pos_subscribed = true;
 
     // set data request
-    hr = SimConnect_RequestDataOnSimObject(hSimConnect, 
-                                            REQUEST_USER_POS_AND_PROFILE, 
-                                            DEFINITION_USER_POS, 
-                                            SIMCONNECT_OBJECT_ID_USER,
-                                            SIMCONNECT_PERIOD_SECOND); 
-    if (debug_calls) printf("\n..leaving get_user_pos_and_profile()..");
+    request_sent(REQUEST_USER_POS_AND_PROFILE, 0);
+    SimConnect_RequestDataOnSimObject(hSimConnect, 
+                                       REQUEST_USER_POS_AND_PROFILE, 
+                                       DEFINITION_USER_POS, 
+                                       SIMCONNECT_OBJECT_ID_USER,
+                                       SIMCONNECT_PERIOD_SECOND); 
+    trace(TRACE_LEAVE, FN_GET_USER_POS_AND_PROFILE, 0);
+}
+
+// ridge_fast_sample() asks once for the user position every RIDGE_FAST_INTERVAL_MS after each
+// subscription reply while the user aircraft is near a ridge (see RIDGE INDEX).  The requests
+// are timed from the subscription replies only, so they stay clear of the next one.
+void ridge_fast_sample() {
+	if (ridge_cell_count==0 || !ridge_user_near || !aircraft[0].active) return;
+	DWORD due = (ridge_fast_sent + 1) * RIDGE_FAST_INTERVAL_MS; // ms after the subscription reply, which is once a second
+	if (due >= 1000 || tick_count() - ridge_pos_time < due) return;
+	ridge_fast_sent++;
+	ridge_fast_count++;
+	request_sent(REQUEST_USER_POS_NEAR_RIDGE, 0);
+	SimConnect_RequestDataOnSimObject(hSimConnect,
+									  REQUEST_USER_POS_NEAR_RIDGE,
+									  DEFINITION_USER_POS,
+									  SIMCONNECT_OBJECT_ID_USER,
+									  SIMCONNECT_PERIOD_ONCE);
 }
 
 //**********************************************************************************
 // this routine is called each time a REQUEST_PROBE_CREATE message arrives
 // but only does anything if all probe_created[1..4] are true
 void process_probe_creates() {
-	bool ready = true;
-	for (int i=1; i<PROFILE_COUNT; i++) {
-		if (!probe_created[i]) {
-			ready = false;
-			break;
-		}
-	}
-	if (ready) {
-		// only continue with processing if all probes created
-		// Now request user pos at 1-second intervals
-		get_user_pos_and_profile();
+	if (probes_ready()) {
+		startup_mark(STARTUP_PROBES_READY);
+		// the user position subscription normally started with the probe creation
+		if (!user_pos_subscribed) get_user_pos_and_profile();
+		// sample straight away if a position is waiting
+		run_sample_cycle();
 	}
 }
 
@@ -705,46 +2051,232 @@ void process_probe_creates() {
 //**********************************************************************************
 //**********************************************************************************
 
-void process_profile() {
-	bool ready = true;
+// publish_snapshot() copies the completed profile of aircraft[a] to its ProfileSnapshot and
+// wakes the compute thread
+void publish_snapshot(int a, int substituted) {
+	ProfileSnapshot snap;
+	snap.pos = aircraft[a].pos;
+	for (int i=0; i<PROFILE_COUNT; i++) snap.ground_elevation[i] = profile[i].ground_elevation;
+	if (wind_field) {
+		snap.wind[0] = snap.pos.wind_velocity;
+		for (int i=1; i<PROFILE_COUNT; i++) snap.wind[i] = wind_along(&snap.pos, profile[i].latitude, profile[i].longitude);
+	}
+	snap.object_id = aircraft[a].object_id;
+	snap.substituted = substituted;
+	snap.warm = !probes_ready();
+	snap.dispatch_time = perf_now();
+	seqlock_write(&snapshot_seq[a], snapshot[a], sizeof(ProfileSnapshot), &snap);
+	trace(TRACE_SNAPSHOT, substituted, a);
+	if (compute_event) SetEvent(compute_event);
+}
+
+// profile_complete() is true once every probe elevation of the current profile is in
+bool profile_complete() {
+	for (int i=1; i<PROFILE_COUNT; i++) {
+		if (!profile_valid[i]) return false;
+	}
+	return true;
+}
+
+// process_profile(a) is called when the profile of aircraft[a] is complete
+void process_profile(int a) {
+	trace(TRACE_ENTER, FN_PROCESS_PROFILE, a);
+
+	// status is 'degraded' if any probe elevation was substituted after a missed deadline
+	int substituted = 0;
+	for (int i=1; i<PROFILE_COUNT; i++) {
+		if (profile_substituted[i]) substituted++;
+	}
+
+	// just in case we previously suppressed object id exceptions
+	// getting back to here confirms we're ok again, so reset
+	if (suppress_object_id_exceptions) {
+		if (debug) printf("\nResetting suppress_object_id_exceptions to false.\n");
+		suppress_object_id_exceptions = false;
+	}
+	// measured elevations go into the along-wind history for the next profiles
+	AlongWindHistory *history = &wind_history[a];
+	history_add(history, profile[0].latitude, profile[0].longitude, profile[0].ground_elevation);
 	for (int i=1; i<PROFILE_COUNT; i++) {
-		if (!profile_valid[i]) {
-			ready = false;
-			break;
+		if (profile_substituted[i] || profile_reused[i]) continue;
+		history_add(history, profile[i].latitude, profile[i].longitude, profile[i].ground_elevation);
+	}
+	// and into the surface fit
+	if (surface_fit) {
+		surface_fit_add(profile[0].latitude, profile[0].longitude, profile[0].ground_elevation);
+		for (int i=1; i<PROFILE_COUNT; i++) {
+			if (profile_substituted[i] || profile_reused[i]) continue;
+			surface_fit_add(profile[i].latitude, profile[i].longitude, profile[i].ground_elevation);
+		}
+	}
+
+	//*******************************************************************
+	// hand the profile to the compute thread, which calculates the lift
+	//*******************************************************************
+	AircraftState *ac = &aircraft[a];
+	publish_snapshot(a, substituted);
+	ac->sample_time = tick_count();
+	ac->sample_count++;
+	profile_count++;
+	if (substituted>0) profile_degraded_count++;
+	trace(TRACE_LEAVE, FN_PROCESS_PROFILE, a);
+}
+
+//**********************************************************************************
+//**********************************************************************************
+// COMPUTE THREAD - everything below runs on the compute thread, apart from
+// publish_results() (main loop) and igc_request() (dispatch thread)
+//**********************************************************************************
+//**********************************************************************************
+
+// compute_profile() calculates the lift from the snapshot of aircraft[a]
+void compute_profile(int a, const ProfileSnapshot *snap) {
+	trace(TRACE_ENTER, FN_COMPUTE_PROFILE, a);
+	//*******************************************************************
+	// calculate lift to be written to client data area to be read by CumulusX!
+	//*******************************************************************
+	LiftResult r;
+	trace(TRACE_ENTER, FN_RIDGE_LIFT, 0);
+	r.lift = lift_model(&snap->pos, snap->ground_elevation, wind_field ? snap->wind : NULL);
+	trace(TRACE_LEAVE, FN_RIDGE_LIFT, 0);
+	r.status = (snap->substituted>0) ? 2 : 0;
+	r.warm = snap->warm;
+	r.object_id = snap->object_id;
+	r.dispatch_time = snap->dispatch_time;
+	seqlock_write(&lift_result_seq[a], lift_result[a], sizeof(LiftResult), &r);
+	if (a != 0) {
+		// lift for another aircraft is published with the user lift, no console output
+		if (debug) printf("\nAircraft %d (object id %d) Lift = %+.2f", a, snap->object_id, r.lift);
+		trace(TRACE_LEAVE, FN_COMPUTE_PROFILE, a);
+		return;
+	}
+	// debug
+	if (debug_info) {
+		printf("\n%c Ridge Lift = %+.2f",cycle_char[cycle_count],r.lift);
+		if (snap->substituted>0) printf(" (degraded: %d probe(s) late)", snap->substituted);
+		cycle_count = (cycle_count+1) % strlen(cycle_char); // update counter for rotating symbol
+	}
+	if (debug) {
+		if (snap->pos.sim_on_ground) printf(",On Ground = True");
+		else printf(",On Ground = False");
+		printf(",[Lift = ,%.2f,]",r.lift);
+		printf(" (Wind: %.1f m/s @ %.0f) ",snap->pos.wind_velocity, snap->pos.wind_direction);
+		printf("Probes: ,%.0f",snap->ground_elevation[0]);
+		for (int i=1; i<PROFILE_COUNT; i++) {
+			printf(",%.0f",snap->ground_elevation[i]);
 		}
+		printf("\n");
+	}
+	// store position to igc log array every IGC_TICK_COUNT seconds, however often the user is
+	// sampled (zulu time goes back to 0 at midnight)
+	if (igc_record_count==0 || snap->pos.zulu_time - igc_pos[igc_record_count-1].zulu_time >= IGC_TICK_COUNT ||
+		snap->pos.zulu_time < igc_pos[igc_record_count-1].zulu_time) {
+		igc_log_point(snap, r.lift);
+	}
+	// process 'on ground' status and decide whether to write a log file
+	igc_ground_check(snap->pos.sim_on_ground, snap->pos.zulu_time);
+	if (flight_stats && flight_stats_add(&snap->pos, r.lift)) {
+		seqlock_write(&flight_stats_seq, flight_stats_slots, sizeof(SimLiftStats), &flight_stats_state.stats);
 	}
-	if (ready) {
-		if (debug_calls) printf("\n\n..in process_profile() (all profiles valid)..");
-		// only process ground elevations if we have them all
-		// i.e. profile_valid[i]=true for all
-		// otherwise do nothing
-
-		// We're ok, so reset the heartbeat
-		heartbeat = true;
-		// just in case we previously suppressed object id exceptions
-		// getting back to here confirms we're ok again, so reset
-		if (suppress_object_id_exceptions) {
-			if (debug) printf("\nResetting suppress_object_id_exceptions to false.\n");
-			suppress_object_id_exceptions = false;
+	trace(TRACE_LEAVE, FN_COMPUTE_PROFILE, a);
+}
+
+// compute_pending() carries out any IGC log commands and computes every new snapshot
+void compute_pending() {
+	static LONG computed_seq[MAX_AIRCRAFT] = {0};
+	static LONG startup_seq = 0;
+	// the startup data is read before the command flags: the dispatch thread asks for a write
+	// before it asks FSX for the next flight's startup data, so a file requested for the
+	// previous flight is still written under the previous flight's id
+	StartupStruct startup = igc_startup;
+	if ((igc_startup_seq & ~1) != startup_seq) {
+		startup_seq = seqlock_read(&igc_startup_seq, igc_startup_slots, sizeof(StartupStruct), &startup);
+	}
+	if (igc_write_requested) {
+		igc_write_requested = false;
+		bool restart = igc_restart_requested;
+		igc_restart_requested = false;
+		igc_write_file();
+		if (restart) igc_start_log();
+	}
+	igc_startup = startup;
+	for (int a=0; a<MAX_AIRCRAFT; a++) {
+		if ((snapshot_seq[a] & ~1) == computed_seq[a]) continue;
+		ProfileSnapshot snap;
+		computed_seq[a] = seqlock_read(&snapshot_seq[a], snapshot[a], sizeof(ProfileSnapshot), &snap);
+		compute_profile(a, &snap);
+	}
+}
+
+DWORD WINAPI compute_thread(LPVOID) {
+	trace_thread = 1;
+	while (!compute_quit) {
+		// the timeout is only a backstop, the event is set for every snapshot
+		WaitForSingleObject(compute_event, 100);
+		compute_pending();
+	}
+	return 0;
+}
+
+void start_compute_thread() {
+	compute_quit = false;
+	compute_event = CreateEvent(NULL, FALSE, FALSE, NULL);
+	compute_thread_handle = CreateThread(NULL, 0, compute_thread, NULL, 0, NULL);
+}
+
+// stop_compute_thread() waits for the compute thread to finish, after which the IGC log
+// belongs to the caller again
+void stop_compute_thread() {
+	if (compute_thread_handle==NULL) return;
+	compute_quit = true;
+	SetEvent(compute_event);
+	WaitForSingleObject(compute_thread_handle, INFINITE);
+	CloseHandle(compute_thread_handle);
+	CloseHandle(compute_event);
+	compute_thread_handle = NULL;
+	compute_event = NULL;
+}
+
+// igc_request() asks the compute thread to write the IGC file, and start a new log if restart
+void igc_request(bool restart) {
+	if (restart) igc_restart_requested = true;
+	igc_write_requested = true;
+	if (compute_event) SetEvent(compute_event);
+}
+
+// publish_results() is called from the main loop: sends new lift results to the client data
+// areas and records the dispatch-to-publish latency
+void publish_results() {
+	static LONG published_seq[MAX_AIRCRAFT] = {0};
+	bool user_published = false;
+	for (int a=0; a<aircraft_count; a++) {
+		if ((lift_result_seq[a] & ~1) == published_seq[a]) continue;
+		LiftResult r;
+		published_seq[a] = seqlock_read(&lift_result_seq[a], lift_result[a], sizeof(LiftResult), &r);
+		if (r.object_id != aircraft[a].object_id) continue; // aircraft[a] reused since
+		aircraft[a].lift = r.lift;
+		hist_add(&publish_latency, perf_us(perf_now() - r.dispatch_time));
+		trace(TRACE_LIFT, r.status, a);
+		if (a != 0) continue;
+		startup_mark(STARTUP_FIRST_LIFT);
+		if (r.warm) {
+			warm_lift_count++;
+		} else if (!startup_reached[STARTUP_PROBED_LIFT]) {
+			startup_mark(STARTUP_PROBED_LIFT);
+			if (debug_info || debug) print_startup_times();
 		}
-		//*******************************************************************
-		// calculate & write lift to client data area to be read by CumulusX!
-		//*******************************************************************
-		sim_lift.lift = ridge_lift();
-		sim_lift.status = 0;
+		sim_lift.lift = r.lift;
+		sim_lift.status = r.status;
 		sim_lift.version = version;
-		HRESULT hr = SimConnect_SetClientData(hSimConnect,
+		msg_sent_count++;
+		record_call(CALL_CLIENT_DATA, 0, INT32(floor(r.lift * 100.0 + 0.5)));
+		SimConnect_SetClientData(hSimConnect,
 												SIMLIFT_ID,
 												DEFINITION_SIMLIFT,
 												SIMCONNECT_DATA_SET_FLAG_DEFAULT,
 												0, // reserved
 												sizeof(sim_lift),
 												&sim_lift);
-		// debug
-		if (debug_info) {
-			printf("\n%c Ridge Lift = %+.2f",cycle_char[cycle_count],sim_lift.lift);
-			cycle_count = (cycle_count+1) % strlen(cycle_char); // update counter for rotating symbol
-		}
 		// if the user has selected 'show text' sub-menu, then lift values will be displayed on screen
 		if (menu_show_text) {
 			menu_tick_counter++;
@@ -752,37 +2284,210 @@ void process_profile() {
 				menu_tick_counter = 0;
 				char lift_text[20];
 				sprintf_s(lift_text, "Ridge Lift = %+.2f", sim_lift.lift);
-				menu_tick_counter = 0;
-				hr = SimConnect_Text(hSimConnect, SIMCONNECT_TEXT_TYPE_PRINT_RED, 5.0, EVENT_MENU_TEXT, sizeof(lift_text), lift_text);
+				SimConnect_Text(hSimConnect, SIMCONNECT_TEXT_TYPE_PRINT_RED, 5.0, EVENT_MENU_TEXT, sizeof(lift_text), lift_text);
 			}
 		}
-		if (debug) {
-			if (user_pos.sim_on_ground) printf(",On Ground = True");
-			else printf(",On Ground = False");
-			printf(",[Lift = ,%.2f,]",sim_lift.lift);
-			printf(" (Wind: %.1f m/s @ %.0f) ",wind_velocity, wind_direction);
-			printf("Probes: ,%.0f",user_pos.ground_elevation);
-			for (int i=1; i<PROFILE_COUNT; i++) {
-				printf(",%.0f",profile[i].ground_elevation);
-			}
-			printf("\n");
+		user_published = true;
+	}
+	if (user_published && multi_aircraft) publish_multi_lift();
+	static LONG published_stats_seq = 0;
+	if (flight_stats && (flight_stats_seq & ~1) != published_stats_seq) {
+		published_stats_seq = seqlock_read(&flight_stats_seq, flight_stats_slots, sizeof(SimLiftStats), &sim_lift_stats);
+		msg_sent_count++;
+		record_call(CALL_CLIENT_DATA, 2, sim_lift_stats.mode);
+		SimConnect_SetClientData(hSimConnect,
+								SIMLIFT_STATS_ID,
+								DEFINITION_SIMLIFT_STATS,
+								SIMCONNECT_DATA_SET_FLAG_DEFAULT,
+								0, // reserved
+								sizeof(sim_lift_stats),
+								&sim_lift_stats);
+	}
+}
+
+//**********************************************************************************
+// process_probe_reply(i) is called as each REQUEST_PROBE_POSn reply arrives.  A reply that
+// arrives after its deadline (i.e. the profile has already been sent with a substituted
+// value) is only used to update the elevation cache.
+void process_probe_reply(int i, const ProbeStruct *pS) {
+	// cache under the position the probe reports, not the commanded one, in case the reply is late
+	elev_cache_put(pS->latitude, pS->longitude, pS->ground_elevation);
+	if (wind_field) wind_cache_put(pS->latitude, pS->longitude, pS->altitude, pS->wind_velocity, pS->wind_direction);
+	if (sample_cycle.step!=CYCLE_PROBES || profile_valid[i]) return;
+	// check the probe is where we moved it, otherwise this is the elevation at its old position
+	double error = approx_distance(pS->latitude, pS->longitude, profile[i].latitude, profile[i].longitude);
+	if (error > PROBE_POSITION_TOLERANCE) {
+		probe_stale_count[i]++;
+		trace(TRACE_PROBE_STALE, REQUEST_PROBE_POS1+i-1, i);
+		if (debug) printf("\nProbe %d read stale (%.0fm from target)", i, error);
+		// the subscription will send the probe again when it moves, or the deadline will
+		// substitute a value
+		return;
+	}
+	move_done(i);
+	profile[i].ground_elevation = pS->ground_elevation;
+	profile_valid[i] = true;
+	profile_seen[i] = true;
+	// a probe replied from where it was moved, so we're ok
+	heartbeat = true;
+	run_sample_cycle();
+}
+
+//**********************************************************************************
+// substitute_late_probes(a) is called when the probe replies for the profile of aircraft[a]
+// are overdue: the missing elevations are taken from the elevation cache (or the previous
+// sample for that probe) so the lift is calculated anyway.
+void substitute_late_probes(int a) {
+	for (int i=1; i<PROFILE_COUNT; i++) {
+		if (profile_valid[i]) continue;
+		probe_miss_count[i]++;
+		trace(TRACE_PROBE_LATE, REQUEST_PROBE_POS1+i-1, i);
+		double elevation;
+		double min_elevation, max_elevation;
+		if (elev_cache_get(profile[i].latitude, profile[i].longitude, &elevation)) {
+			profile[i].ground_elevation = elevation;
+			probe_cache_count++;
+		} else if (elev_pyramid_get(profile[i].latitude, profile[i].longitude, 1,
+									&min_elevation, &elevation, &max_elevation)) {
+			// mean of the surrounding level 1 pyramid cell
+			profile[i].ground_elevation = elevation;
+			probe_pyramid_sub_count++;
+		} else {
+			// previous sample for this probe, or flat ground if the probe has never replied
+			if (!profile_seen[i]) profile[i].ground_elevation = aircraft[a].pos.ground_elevation;
+			probe_prev_count++;
+		}
+		profile_substituted[i] = true;
+		profile_valid[i] = true;
+		if (debug) printf("\nProbe %d missed its deadline, elevation substituted (%.0f)", i, profile[i].ground_elevation);
+	}
+}
+
+//**********************************************************************************
+// warm_profile() is the sampling cycle before the probes are ready: the user profile is
+// completed from the elevation cache, terrain pyramid and along-wind history (restored from
+// the previous session, see WARM START) if they cover every point.  Each position is tried
+// once, and stays due so the probes sample it as soon as they are ready.
+void warm_profile() {
+	static DWORD tried_pos_time = 0;
+	if (!user_sample_due || !aircraft[0].active || aircraft[0].pos_time==tried_pos_time) return;
+	tried_pos_time = aircraft[0].pos_time;
+	const UserStruct *pos = &aircraft[0].pos;
+	calc_profile_latlongs(pos);
+	profile[0].ground_elevation = pos->ground_elevation;
+	AlongWindHistory *history = &wind_history[0];
+	history_check(history, pos);
+	double elevation[PROFILE_COUNT];
+	for (int i=1; i<PROFILE_COUNT; i++) {
+		double min_elevation, max_elevation;
+		int level = max(1, far_probe_level(profile_distance[i]));
+		if (!history_get(history, profile[i].latitude, profile[i].longitude, &elevation[i]) &&
+			!elev_cache_get(profile[i].latitude, profile[i].longitude, &elevation[i]) &&
+			!elev_pyramid_get(profile[i].latitude, profile[i].longitude, level,
+							  &min_elevation, &elevation[i], &max_elevation)) return;
+	}
+	for (int i=1; i<PROFILE_COUNT; i++) {
+		profile[i].ground_elevation = elevation[i];
+		profile_valid[i] = true;
+		profile_substituted[i] = true;
+		profile_reused[i] = false;
+	}
+	process_profile(0);
+}
+
+//**********************************************************************************
+// run_sample_cycle() runs the sampling cycle as far as it can go and returns when it has to
+// wait.  It is called whenever something the cycle may be waiting for happens: a position
+// or probe reply arriving, or the message loop ticking (for the reply deadline).
+void run_sample_cycle() {
+	SampleCycle *c = &sample_cycle;
+	for (;;) {
+		switch (c->step) {
+			case CYCLE_IDLE:
+				// 0. until the probes are ready only a warm lift is possible
+				if (!probes_ready()) {
+					warm_profile();
+					return;
+				}
+				// 1. pick the next aircraft due a sample and move the probes to its profile
+				ridge_fast_sample();
+				if (!next_sample_aircraft(&c->aircraft)) return;
+				c->start_time = tick_count();
+				get_profile(c->aircraft);
+				c->step = CYCLE_PROBES;
+				// fall through - probes that didn't need moving have already reported
+
+			case CYCLE_PROBES:
+				// 2. wait for every probe to report from its new position, up to the deadline
+				if (!profile_complete()) {
+					if (tick_count() - c->start_time < PROBE_TIMEOUT_MS) return;
+					substitute_late_probes(c->aircraft);
+				}
+				// 3. hand over the profile, then round again as the probes are free
+				c->step = CYCLE_IDLE;
+				process_profile(c->aircraft);
+				break;
 		}
-		if (debug_calls) printf(" ..leaving process_profile()..\n");
 	}
 }
 
+// print_probe_stats() prints the probe deadline counters (on quit)
+void print_probe_stats() {
+	printf("\nLift values sent = %d, degraded = %d", profile_count, profile_degraded_count);
+	printf("\nProbe deadline misses:");
+	for (int i=1; i<PROFILE_COUNT; i++) printf(" probe[%d]=%d", i, probe_miss_count[i]);
+	printf("\nSubstituted from cache = %d, from terrain pyramid = %d, from previous sample = %d",
+		   probe_cache_count, probe_pyramid_sub_count, probe_prev_count);
+	printf("\nStale probe reads:");
+	for (int i=1; i<PROFILE_COUNT; i++) printf(" probe[%d]=%d", i, probe_stale_count[i]);
+	printf("\nProbe moves skipped (already at target) = %d", moves_skipped_count);
+	printf("\nFar probes answered from terrain pyramid = %d", probe_pyramid_count);
+	double minutes = double(tick_count() - multi_start_time) / 60000.0;
+	printf("\nProbe moves saved by the along-wind history = %d", history_reuse_count);
+	if (multi_start_time!=0 && minutes>0.0) printf(" (%.1f per minute)", history_reuse_count / minutes);
+	printf(", full refreshes = %d", history_reset_count);
+	if (wind_field) {
+		printf("\nWind samples = %d, profile points with a cached wind = %d, with the aircraft's = %d",
+			   wind_sample_count, wind_point_count, wind_fallback_count);
+	}
+	if (ridge_cell_count>0) {
+		printf("\nProfiles near a ridge = %d, taken as flat = %d, extra user positions near a ridge = %d",
+			   ridge_probed_count, ridge_flat_count, ridge_fast_count);
+	}
+	if (surface_fit) {
+		printf("\nProfile points answered from the surface fit = %d, fit samples = %d",
+			   surface_fit_point_count, surface_fit_sample_count);
+	}
+	if (profile_count>0) {
+		printf("\nMessages per lift sample: %.2f sent, %.2f received",
+			   double(msg_sent_count) / profile_count, double(msg_recv_count) / profile_count);
+	}
+	printf("\n");
+}
+
 //**********************************************************************************************
 // this is the routine that checks the 'heartbeat' boolean which is set to true each time
-// ridge lift is successfully calculated.  If the routine finds it false, it recreates the
-// probes to kick sim_probe back into life
+// a probe reply is accepted.  If the routine finds it false, it recreates the probes to kick
+// sim_probe back into life.  When no probe was moved since the last test (every profile flat
+// away from a ridge, or answered from the history, pyramid or surface fit) probe 1 is read
+// instead, and its reply is the heartbeat for the next test.
 void test_heartbeat() {
 	if (heartbeat) {
 		// sim_probe ok, so just reset heartbeat and return
 		heartbeat = false;
+		probe_asked = false;
+		return;
+	}
+	if (!probe_asked && probes_ready()) {
+		probe_asked = true;
+		request_sent(REQUEST_PROBE_ALIVE, 1);
+		SimConnect_RequestDataOnSimObject(hSimConnect, REQUEST_PROBE_ALIVE, DEFINITION_PROBE_POS, probe_id[1],
+										  SIMCONNECT_PERIOD_ONCE);
 		return;
 	}
 	// heartbeat is FALSE here, so we have a problem
 	if (debug_info || debug) printf("\nHeartbeat lost - recreating probes...\n");
+	trace(TRACE_HEARTBEAT_LOST, 0, 0);
 	suppress_object_id_exceptions = true;
 	remove_probes();
 	create_probes();
@@ -792,61 +2497,63 @@ void test_heartbeat() {
 //*********************************************************************************************
 //********** this is the main message handling loop of sim_probe, receiving messages from FS **
 //*********************************************************************************************
-void CALLBACK MyDispatchProcSO(SIMCONNECT_RECV* pData, DWORD cbData, void *pContext)
+void CALLBACK MyDispatchProcSO(SIMCONNECT_RECV* pData, DWORD cbData, void *)
 {   
-    HRESULT hr;
     //printf("\nIn dispatch proc");
+	msg_recv_count++;
 
     switch(pData->dwID)
     {
         case SIMCONNECT_RECV_ID_EVENT:
         {
             SIMCONNECT_RECV_EVENT *evt = (SIMCONNECT_RECV_EVENT*)pData;
+			trace(TRACE_EVENT, evt->uEventID, 0);
 
             switch(evt->uEventID)
             {
 				case EVENT_MENU_SHOW_TEXT:
-					if (debug_events) printf(" [EVENT_MENU_SHOW_TEXT] ");
 					menu_show_text = true;
                     break;
 					
 				case EVENT_MENU_HIDE_TEXT:
-					if (debug_events) printf(" [EVENT_MENU_HIDE_TEXT] ");
 					menu_show_text = false;
                     break;
 					
 				case EVENT_MENU_WRITE_LOG:
-					if (debug_events) printf(" [EVENT_MENU_WRITE_LOG] ");
-					igc_write_file();
+					igc_request(false);
                     break;
 					
                 case EVENT_SIM_START:
-					if (debug_events) printf(" [EVENT_SIM_START] ");
                     // Sim has started so turn the input events on
-                    hr = SimConnect_SetInputGroupState(hSimConnect, INPUT_ZX, SIMCONNECT_STATE_ON);
+                    SimConnect_SetInputGroupState(hSimConnect, INPUT_ZX, SIMCONNECT_STATE_ON);
 
+					startup_mark(STARTUP_SIM_START);
 					// get startup data e.g. "ATC ID"
 					get_startup_data();
 
-					// create probes
+					// create probes, and start the 1Hz user position meanwhile (until the
+					// probes are ready the lift can only come from the restored state)
 					create_probes();
+					get_user_pos_and_profile();
 
                     break;
 
                 case EVENT_4S_TIMER:
-					if (debug_events) printf(" [EVENT_4S_TIMER] ");
 					test_heartbeat();
+					if ((debug_info || debug) && ++latency_tick_counter==LATENCY_DUMP_TICKS) {
+						latency_tick_counter = 0;
+						print_latency();
+						if (multi_aircraft) print_aircraft_stats();
+						if (flight_stats) print_flight_stats();
+					}
                     break;
 
                 case EVENT_MISSIONCOMPLETED:
-					if (debug_events) printf(" [EVENT_MISSIONCOMPLETED] ");
 					// always write an IGC file on mission completion
-					igc_write_file();
-					igc_start_log();
+					igc_request(true);
                     break;
 
                 case EVENT_MENU_TEXT:
-					if (debug_events) printf(" [EVENT_MENU_TEXT] ");
                     break;
 
                 case EVENT_Z: // keystroke Z
@@ -865,7 +2572,7 @@ void CALLBACK MyDispatchProcSO(SIMCONNECT_RECV* pData, DWORD cbData, void *pCont
                     break;
                 
                 default:
-                    if (debug_events) printf("\nUnknown event: %d", evt->uEventID);
+                    if (debug_info) printf("\nUnknown event: %d", evt->uEventID);
                     break;
             }
             break;
@@ -874,50 +2581,51 @@ void CALLBACK MyDispatchProcSO(SIMCONNECT_RECV* pData, DWORD cbData, void *pCont
         case SIMCONNECT_RECV_ID_ASSIGNED_OBJECT_ID:
         {
             SIMCONNECT_RECV_ASSIGNED_OBJECT_ID *pObjData = (SIMCONNECT_RECV_ASSIGNED_OBJECT_ID*)pData;
+			request_done(pObjData->dwRequestID);
     
             switch( pObjData ->dwRequestID)
             {
             
 				case REQUEST_PROBE_CREATE1:
 					{
-						if (debug_events) printf(" [REQUEST_PROBE_CREATE1] ");
 						probe_id[1] = pObjData->dwObjectID;
 						if (debug_info || debug) printf("\nCreated probe 1, id = %d", probe_id[1]);
 						probe_created[1] = true;
 						freeze_probe(1);
+						subscribe_probe(1);
 						process_probe_creates();
 						break;
 					}
 	            
 				case REQUEST_PROBE_CREATE2:
 					{
-						if (debug_events) printf(" [REQUEST_PROBE_CREATE2] ");
 						probe_id[2] = pObjData->dwObjectID;
 						if (debug_info || debug) printf("\nCreated probe 2, id = %d", probe_id[2]);
 						probe_created[2] = true;
 						freeze_probe(2);
+						subscribe_probe(2);
 						process_probe_creates();
 						break;
 					}
 	            
 				case REQUEST_PROBE_CREATE3:
 					{
-						if (debug_events) printf(" [REQUEST_PROBE_CREATE3] ");
 						probe_id[3] = pObjData->dwObjectID;
 						if (debug_info || debug) printf("\nCreated probe 3, id = %d", probe_id[3]);
 						probe_created[3] = true;
 						freeze_probe(3);
+						subscribe_probe(3);
 						process_probe_creates();
 						break;
 					}
 	            
 				case REQUEST_PROBE_CREATE4:
 					{
-						if (debug_events) printf(" [REQUEST_PROBE_CREATE4] ");
 						probe_id[4] = pObjData->dwObjectID;
 						if (debug_info || debug) printf("\nCreated probe 4, id = %d", probe_id[4]);
 						probe_created[4] = true;
 						freeze_probe(4);
+						subscribe_probe(4);
 						process_probe_creates();
 						break;
 					}
@@ -933,7 +2641,7 @@ void CALLBACK MyDispatchProcSO(SIMCONNECT_RECV* pData, DWORD cbData, void *pCont
 	//				}
 	            
 				default:
-					if (debug_info || debug_events) printf("\nUnknown creation %d", pObjData->dwRequestID);
+					if (debug_info) printf("\nUnknown creation %d", pObjData->dwRequestID);
 					break;
 
             }
@@ -943,13 +2651,18 @@ void CALLBACK MyDispatchProcSO(SIMCONNECT_RECV* pData, DWORD cbData, void *pCont
         case SIMCONNECT_RECV_ID_SIMOBJECT_DATA:
         {
             SIMCONNECT_RECV_SIMOBJECT_DATA *pObjData = (SIMCONNECT_RECV_SIMOBJECT_DATA*) pData;
+			request_done(pObjData->dwRequestID);
 
             switch(pObjData->dwRequestID)
             {
                 case REQUEST_USER_POS_AND_PROFILE:
+                case REQUEST_USER_POS_NEAR_RIDGE:
                 {
-					if (debug_events) printf(" [REQUEST_USER_POS_AND_PROFILE] ");
                     DWORD ObjectID = pObjData->dwObjectID;
+					if (pObjData->dwRequestID==REQUEST_USER_POS_AND_PROFILE) {
+						ridge_pos_time = tick_count();
+						ridge_fast_sent = 0;
+					}
                     UserStruct *pU = (UserStruct*)&pObjData->dwData;
 					user_pos.altitude = pU->altitude;
 					user_pos.ground_elevation = pU->ground_elevation;
@@ -957,57 +2670,57 @@ void CALLBACK MyDispatchProcSO(SIMCONNECT_RECV* pData, DWORD cbData, void *pCont
 					user_pos.longitude = pU->longitude;
 					user_pos.sim_on_ground = pU->sim_on_ground;
 					user_pos.zulu_time = pU->zulu_time;
+					user_pos.wind_direction = pU->wind_direction;
+					user_pos.wind_velocity = pU->wind_velocity;
 					wind_direction = pU->wind_direction;
 					wind_velocity = pU->wind_velocity;
-					// store position to igc log array on every nth tick
-					if (++igc_tick_counter==IGC_TICK_COUNT) {
-						igc_log_point(user_pos);
-						igc_tick_counter = 0;
-					}
-					// process 'on ground' status and decide whether to write a log file
-					igc_ground_check(user_pos.sim_on_ground, user_pos.zulu_time);
+					aircraft[0].object_id = ObjectID;
+					aircraft[0].active = true;
+					aircraft[0].pos = user_pos;
+					aircraft[0].pos_time = tick_count();
+					startup_mark(STARTUP_POSITION);
+					if (wind_field) wind_cache_put(pU->latitude, pU->longitude, pU->altitude, pU->wind_velocity, pU->wind_direction);
 					// now initiate the sequence of requests that will get the probe readings
-                    get_profile(); // get_profile() will REQUEST_USER_POS
+					// - straight away if the probes are free
+					if (multi_start_time==0) multi_start_time = tick_count();
+					user_sample_due = true;
+					run_sample_cycle();
+					// and ask for the other aircraft positions for the samples in between, at 1Hz
+					if ((multi_aircraft || flight_recorder) && pObjData->dwRequestID==REQUEST_USER_POS_AND_PROFILE) {
+						get_aircraft_pos();
+					}
                     break;
                 }
 
+				case REQUEST_PROBE_ALIVE:
+					heartbeat = true;
+					break;
+
 				case REQUEST_PROBE_POS1:
                     {
-					if (debug_events) printf(" [REQUEST_PROBE_POS1] ");
-                    ProbeStruct *pS = (ProbeStruct*)&pObjData->dwData;
-                    profile[1].ground_elevation = pS->ground_elevation;
-					profile_valid[1] = true;
-					process_profile();
+					merge_probe_data(1, pObjData);
+					process_probe_reply(1, &probe_state[1]);
                     break;
                     }
 
                 case REQUEST_PROBE_POS2:
                     {
-					if (debug_events) printf(" [REQUEST_PROBE_POS2] ");
-                    ProbeStruct *pS = (ProbeStruct*)&pObjData->dwData;
-                    profile[2].ground_elevation = pS->ground_elevation;
-					profile_valid[2] = true;
-					process_profile();
+					merge_probe_data(2, pObjData);
+					process_probe_reply(2, &probe_state[2]);
                     break;
                     }
 
                 case REQUEST_PROBE_POS3:
                     {
-					if (debug_events) printf(" [REQUEST_PROBE_POS3] ");
-                    ProbeStruct *pS = (ProbeStruct*)&pObjData->dwData;
-                    profile[3].ground_elevation = pS->ground_elevation;
-					profile_valid[3] = true;
-					process_profile();
+					merge_probe_data(3, pObjData);
+					process_probe_reply(3, &probe_state[3]);
                     break;
                     }
 
                 case REQUEST_PROBE_POS4:
                     {
-					if (debug_events) printf(" [REQUEST_PROBE_POS4] ");
-                    ProbeStruct *pS = (ProbeStruct*)&pObjData->dwData;
-                    profile[4].ground_elevation = pS->ground_elevation;
-					profile_valid[4] = true;
-					process_profile();
+					merge_probe_data(4, pObjData);
+					process_probe_reply(4, &probe_state[4]);
                     break;
                     }
 
@@ -1022,19 +2735,18 @@ void CALLBACK MyDispatchProcSO(SIMCONNECT_RECV* pData, DWORD cbData, void *pCont
 
                 case REQUEST_STARTUP_DATA:
                     {
-					if (debug_events) printf(" [REQUEST_STARTUP_DATA] ");
-                    DWORD ObjectID = pObjData->dwObjectID;
                     StartupStruct *pU = (StartupStruct*)&pObjData->dwData;
 					strcpy_s(startup_data.atc_id,pU->atc_id);
 					strcpy_s(startup_data.atc_type,pU->atc_type);
 					startup_data.start_time = pU->start_time;
+					seqlock_write(&igc_startup_seq, igc_startup_slots, sizeof(StartupStruct), &startup_data);
 					if (debug) printf("\nStartup data: id=%s, type=%s\n",
 						              startup_data.atc_id, startup_data.atc_type);
                     break;
                     }
 
                 default:
-					if (debug_info || debug_events) printf("\nUnknown SIMCONNECT_RECV_ID_SIMOBJECT_DATA request %d", pObjData->dwRequestID);
+					if (debug_info) printf("\nUnknown SIMCONNECT_RECV_ID_SIMOBJECT_DATA request %d", pObjData->dwRequestID);
                     break;
 
             }
@@ -1044,22 +2756,28 @@ void CALLBACK MyDispatchProcSO(SIMCONNECT_RECV* pData, DWORD cbData, void *pCont
         case SIMCONNECT_RECV_ID_SIMOBJECT_DATA_BYTYPE:
         {
             SIMCONNECT_RECV_SIMOBJECT_DATA_BYTYPE *pObjData = (SIMCONNECT_RECV_SIMOBJECT_DATA_BYTYPE*)pData;
+			request_done(pObjData->dwRequestID);
             
             switch(pObjData->dwRequestID)
             {
 
-				// NOTE: REQUEST_USER_POS WILL THEN CALL get_probes_pos()
-                case REQUEST_USER_POS:
+                case REQUEST_AIRCRAFT_POS:
                 {
-					if (debug_events) printf(" [REQUEST_USER_POS] ");
-                    DWORD ObjectID = pObjData->dwObjectID;
                     UserStruct *pU = (UserStruct*)&pObjData->dwData;
-					get_probes_pos();
+					if (flight_recorder) recorder_fix(pObjData->dwObjectID, pU, aircraft_lift(pObjData->dwObjectID));
+					if (!multi_aircraft) break;
+					update_aircraft(pObjData->dwObjectID, pU);
+					// an aircraft may now be due a sample if the probes are idle
+					run_sample_cycle();
                     break;
                 }
 
+                case REQUEST_RECORDER_ID:
+					if (flight_recorder) recorder_id(pObjData->dwObjectID, (StartupStruct*)&pObjData->dwData);
+                    break;
+
                 default:
-					if (debug_info || debug_events) printf("\nUnknown SIMCONNECT_RECV_ID_SIMOBJECT_DATA_BYTYPE request %d", pObjData->dwRequestID);
+					if (debug_info) printf("\nUnknown SIMCONNECT_RECV_ID_SIMOBJECT_DATA_BYTYPE request %d", pObjData->dwRequestID);
 					break;
             }
             break;
@@ -1074,7 +2792,7 @@ void CALLBACK MyDispatchProcSO(SIMCONNECT_RECV* pData, DWORD cbData, void *pCont
                 case EVENT_OBJECT_REMOVED:
 					for (int i=1; i<PROFILE_COUNT; i++) {
 						if (evt->dwData == probe_id[i]) {
-							if (debug_events) printf("[EVENT_OBJECT_REMOVED probe[%d] ]\n", i);
+							trace(TRACE_OBJECT_REMOVED, evt->dwData, i);
 							probe_created[i] = false;
 							break;
 						}
@@ -1085,7 +2803,7 @@ void CALLBACK MyDispatchProcSO(SIMCONNECT_RECV* pData, DWORD cbData, void *pCont
                 //    printf("\nAI object removed: Type=%d, ObjectID=%d", evt->eObjType, evt->dwData);
                 //    break;
 				default:
-					if (debug_info || debug_events) printf("\n\n*Unrecognized SIMCONNECT_RECV_ID_EVENT_OBJECT_ADDREMOVE Type=%d, ObjectID=%d", evt->eObjType, evt->dwData);
+					if (debug_info) printf("\n\n*Unrecognized SIMCONNECT_RECV_ID_EVENT_OBJECT_ADDREMOVE Type=%d, ObjectID=%d", evt->eObjType, evt->dwData);
 					break;
 
             }
@@ -1096,6 +2814,7 @@ void CALLBACK MyDispatchProcSO(SIMCONNECT_RECV* pData, DWORD cbData, void *pCont
         case SIMCONNECT_RECV_ID_EXCEPTION:
         {
             SIMCONNECT_RECV_EXCEPTION *except = (SIMCONNECT_RECV_EXCEPTION*)pData;
+			trace(TRACE_EXCEPTION, except->dwException, 0);
 			switch(except->dwException)
 			{
 				case SIMCONNECT_EXCEPTION_UNRECOGNIZED_ID:
@@ -1118,7 +2837,7 @@ void CALLBACK MyDispatchProcSO(SIMCONNECT_RECV* pData, DWORD cbData, void *pCont
 					}
 
 				default:
-					if (debug_info || debug_events) printf("\n\n***** EXCEPTION=%d  SendID=%d  Index=%d  cbData=%d\n", except->dwException, except->dwSendID, except->dwIndex, cbData);
+					if (debug_info) printf("\n\n***** EXCEPTION=%d  SendID=%d  Index=%d  cbData=%d\n", except->dwException, except->dwSendID, except->dwIndex, cbData);
 					break;
 			}
             break;
@@ -1127,7 +2846,8 @@ void CALLBACK MyDispatchProcSO(SIMCONNECT_RECV* pData, DWORD cbData, void *pCont
         case SIMCONNECT_RECV_ID_OPEN:
         {
             SIMCONNECT_RECV_OPEN *open = (SIMCONNECT_RECV_OPEN*)pData;
-			if (debug_events) printf("\nConnected to FSX Version %d.%d", open->dwApplicationVersionMajor, open->dwApplicationVersionMinor);
+			if (debug_info) printf("\nConnected to FSX Version %d.%d", open->dwApplicationVersionMajor, open->dwApplicationVersionMinor);
+			startup_mark(STARTUP_CONNECT);
             break;
         }
 
@@ -1138,11 +2858,11 @@ void CALLBACK MyDispatchProcSO(SIMCONNECT_RECV* pData, DWORD cbData, void *pCont
             {
                 case EVENT_FLIGHTLOADED:
 
-					if (debug_events) printf("\n[ EVENT_FLIGHTLOADED ]: %s\n", evt->szFileName);
+					trace(TRACE_EVENT, EVENT_FLIGHTLOADED, 0);
+					if (debug) printf("\n[ EVENT_FLIGHTLOADED ]: %s\n", evt->szFileName);
 					// write previous file if there is one
-					igc_write_file();
-					// reset the IGC record count and start a new log
-					igc_start_log();
+					// and reset the IGC record count and start a new log
+					igc_request(true);
 					get_startup_data();
                     break;
 
@@ -1155,8 +2875,21 @@ void CALLBACK MyDispatchProcSO(SIMCONNECT_RECV* pData, DWORD cbData, void *pCont
 
         case SIMCONNECT_RECV_ID_QUIT:
         {
-			// write the IGC file if there is one
+			// write the IGC file if there is one (the IGC log is ours once the compute thread stops)
+			stop_compute_thread();
+			igc_startup = startup_data;
 			igc_write_file();
+			stop_recorder_thread();
+			if (state_file[0]!=0 && !replaying) state_save(state_file);
+			if (debug_info || debug) {
+				print_startup_times();
+				if (flight_stats) print_flight_stats();
+				if (flight_recorder) print_recorder_stats();
+				print_probe_stats();
+				print_latency();
+				if (multi_aircraft) print_aircraft_stats();
+			}
+			trace_dump();
 			// set flag to trigger a quit
             quit = 1;
             break;
@@ -1168,220 +2901,267 @@ void CALLBACK MyDispatchProcSO(SIMCONNECT_RECV* pData, DWORD cbData, void *pCont
     }
 }
 
+//*********************************************************************************************
+// REPLAY
+// capture_dispatch() sits in front of MyDispatchProcSO while recording.  replay_capture()
+// feeds a capture back to MyDispatchProcSO at the recorded pace, or as fast as possible with
+// 'fast' on the command line.  Between messages the replay clock advances in 1ms steps and
+// runs the message loop's work each step, as the loop in connectToSim() does, and the compute
+// thread's work is done inline so the replay is deterministic.  The exit code is the number
+// of outgoing calls that differ from the recording (0 => identical).
+//*********************************************************************************************
+
+// capture_dispatch() sits in front of MyDispatchProcSO while recording ('record=<file>'), see
+// REPLAY in sim_probe_replay.cpp for the other end of the capture
+void CALLBACK capture_dispatch(SIMCONNECT_RECV* pData, DWORD cbData, void *pContext)
+{
+	capture_write(CAPTURE_RECV, pData, cbData);
+	MyDispatchProcSO(pData, cbData, pContext);
+}
+
 void connectToSim()
 {
-    HRESULT hr;
 
     if (SUCCEEDED(SimConnect_Open(&hSimConnect, "sim_probe", NULL, 0, 0, 0)))
     {
         if (debug_info || debug) printf("\nsim_probe (Version %.2f) Connected to Flight Simulator!\n", version);   
           
         // Create some private events
-        hr = SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_Z);
-        hr = SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_X);
+        SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_Z);
+        SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_X);
         //hr = SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_C);
         //hr = SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_V);
 //        hr = SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_B);
 
 
         // Link the private events to keyboard keys, and ensure the input events are off
-        hr = SimConnect_MapInputEventToClientEvent(hSimConnect, INPUT_ZX, "Z", EVENT_Z);
-        hr = SimConnect_MapInputEventToClientEvent(hSimConnect, INPUT_ZX, "X", EVENT_X);
+        SimConnect_MapInputEventToClientEvent(hSimConnect, INPUT_ZX, "Z", EVENT_Z);
+        SimConnect_MapInputEventToClientEvent(hSimConnect, INPUT_ZX, "X", EVENT_X);
         //hr = SimConnect_MapInputEventToClientEvent(hSimConnect, INPUT_ZX, "C", EVENT_C);
         //hr = SimConnect_MapInputEventToClientEvent(hSimConnect, INPUT_ZX, "V", EVENT_V);
 //        hr = SimConnect_MapInputEventToClientEvent(hSimConnect, INPUT_ZX, "B", EVENT_B);
 
-        hr = SimConnect_SetInputGroupState(hSimConnect, INPUT_ZX, SIMCONNECT_STATE_OFF);
+        SimConnect_SetInputGroupState(hSimConnect, INPUT_ZX, SIMCONNECT_STATE_OFF);
 
         // Sign up for notifications
-        hr = SimConnect_AddClientEventToNotificationGroup(hSimConnect, GROUP_ZX, EVENT_Z);
-        hr = SimConnect_AddClientEventToNotificationGroup(hSimConnect, GROUP_ZX, EVENT_X);
+        SimConnect_AddClientEventToNotificationGroup(hSimConnect, GROUP_ZX, EVENT_Z);
+        SimConnect_AddClientEventToNotificationGroup(hSimConnect, GROUP_ZX, EVENT_X);
         //hr = SimConnect_AddClientEventToNotificationGroup(hSimConnect, GROUP_ZX, EVENT_C);
         //hr = SimConnect_AddClientEventToNotificationGroup(hSimConnect, GROUP_ZX, EVENT_V);
 //        hr = SimConnect_AddClientEventToNotificationGroup(hSimConnect, GROUP_ZX, EVENT_B);
 
 		//*** CREATE ADD-ON MENU
-		hr = SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_MENU);
-		hr = SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_MENU_SHOW_TEXT);
-		hr = SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_MENU_HIDE_TEXT);
-		hr = SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_MENU_WRITE_LOG);
+		SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_MENU);
+		SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_MENU_SHOW_TEXT);
+		SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_MENU_HIDE_TEXT);
+		SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_MENU_WRITE_LOG);
 		// Add sim_probe menu items
-		hr = SimConnect_MenuAddItem(hSimConnect, "sim_probe", EVENT_MENU, 0);
-		hr = SimConnect_MenuAddSubItem(hSimConnect, EVENT_MENU, "display status text", EVENT_MENU_SHOW_TEXT, 0);
-		hr = SimConnect_MenuAddSubItem(hSimConnect, EVENT_MENU, "hide status text", EVENT_MENU_HIDE_TEXT, 0);
-		hr = SimConnect_MenuAddSubItem(hSimConnect, EVENT_MENU, "write igc log file", EVENT_MENU_WRITE_LOG, 0);
+		SimConnect_MenuAddItem(hSimConnect, "sim_probe", EVENT_MENU, 0);
+		SimConnect_MenuAddSubItem(hSimConnect, EVENT_MENU, "display status text", EVENT_MENU_SHOW_TEXT, 0);
+		SimConnect_MenuAddSubItem(hSimConnect, EVENT_MENU, "hide status text", EVENT_MENU_HIDE_TEXT, 0);
+		SimConnect_MenuAddSubItem(hSimConnect, EVENT_MENU, "write igc log file", EVENT_MENU_WRITE_LOG, 0);
 		// Sign up for the notifications
-		hr = SimConnect_AddClientEventToNotificationGroup(hSimConnect, GROUP_MENU, EVENT_MENU);
-		hr = SimConnect_SetNotificationGroupPriority(hSimConnect, GROUP_MENU, SIMCONNECT_GROUP_PRIORITY_HIGHEST);
+		SimConnect_AddClientEventToNotificationGroup(hSimConnect, GROUP_MENU, EVENT_MENU);
+		SimConnect_SetNotificationGroupPriority(hSimConnect, GROUP_MENU, SIMCONNECT_GROUP_PRIORITY_HIGHEST);
 
         // DEFINITION_STARTUP for initial data
-        hr = SimConnect_AddToDataDefinition(hSimConnect, 
-                                            DEFINITION_STARTUP,
-                                            "ATC ID", 
-                                            NULL,
+        SimConnect_AddToDataDefinition(hSimConnect, 
+                                       DEFINITION_STARTUP,
+                                       "ATC ID", 
+                                       NULL,
 											SIMCONNECT_DATATYPE_STRING32);
 
-        hr = SimConnect_AddToDataDefinition(hSimConnect, 
-                                            DEFINITION_STARTUP,
-                                            "ATC TYPE", 
-                                            NULL,
+        SimConnect_AddToDataDefinition(hSimConnect, 
+                                       DEFINITION_STARTUP,
+                                       "ATC TYPE", 
+                                       NULL,
 											SIMCONNECT_DATATYPE_STRING32);
 
-        hr = SimConnect_AddToDataDefinition(hSimConnect, 
-                                            DEFINITION_STARTUP,
-                                            "ZULU TIME", 
-                                            "seconds",
+        SimConnect_AddToDataDefinition(hSimConnect, 
+                                       DEFINITION_STARTUP,
+                                       "ZULU TIME", 
+                                       "seconds",
 											SIMCONNECT_DATATYPE_INT32);
 
 
         // DEFINITION_PROBE_POS for probe position
-        hr = SimConnect_AddToDataDefinition(hSimConnect, 
-                                            DEFINITION_PROBE_POS,
-                                            "GROUND ALTITUDE", 
-                                            "meters");
-
-        hr = SimConnect_AddToDataDefinition(hSimConnect, 
-                                            DEFINITION_PROBE_POS,
-                                            "Plane Latitude", 
-                                            "degrees");
-
-        hr = SimConnect_AddToDataDefinition(hSimConnect, 
-                                            DEFINITION_PROBE_POS,
-                                            "Plane Longitude", 
-                                            "degrees");
+        // (with datum ids as the probe subscriptions use tagged data)
+        SimConnect_AddToDataDefinition(hSimConnect, 
+                                       DEFINITION_PROBE_POS,
+                                       "GROUND ALTITUDE", 
+                                       "meters",
+                                       SIMCONNECT_DATATYPE_FLOAT64, 0, PROBE_DATUM_ELEVATION);
+
+        SimConnect_AddToDataDefinition(hSimConnect, 
+                                       DEFINITION_PROBE_POS,
+                                       "Plane Latitude", 
+                                       "degrees",
+                                       SIMCONNECT_DATATYPE_FLOAT64, 0, PROBE_DATUM_LATITUDE);
+
+        SimConnect_AddToDataDefinition(hSimConnect, 
+                                       DEFINITION_PROBE_POS,
+                                       "Plane Longitude", 
+                                       "degrees",
+                                       SIMCONNECT_DATATYPE_FLOAT64, 0, PROBE_DATUM_LONGITUDE);
+
+		if (wind_field) {
+			// the probe's altitude and the wind there, in the same message
+			SimConnect_AddToDataDefinition(hSimConnect,
+												DEFINITION_PROBE_POS,
+												"Plane Altitude",
+												"meters",
+												SIMCONNECT_DATATYPE_FLOAT64, 0, PROBE_DATUM_ALTITUDE);
+
+			SimConnect_AddToDataDefinition(hSimConnect,
+												DEFINITION_PROBE_POS,
+												"AMBIENT WIND VELOCITY",
+												"m/s",
+												SIMCONNECT_DATATYPE_FLOAT64, 0, PROBE_DATUM_WIND_VELOCITY);
+
+			SimConnect_AddToDataDefinition(hSimConnect,
+												DEFINITION_PROBE_POS,
+												"AMBIENT WIND DIRECTION",
+												"degrees",
+												SIMCONNECT_DATATYPE_FLOAT64, 0, PROBE_DATUM_WIND_DIRECTION);
+		}
 
         // DEFINITION_MOVE - a lat/long pair to move the probe
-		hr = SimConnect_AddToDataDefinition(hSimConnect, 
-                                            DEFINITION_MOVE, 
-                                            "Plane Latitude", 
-                                            "degrees");
+		SimConnect_AddToDataDefinition(hSimConnect, 
+                                       DEFINITION_MOVE, 
+                                       "Plane Latitude", 
+                                       "degrees");
 
-        hr = SimConnect_AddToDataDefinition(hSimConnect, 
-                                            DEFINITION_MOVE, 
-                                            "Plane Longitude", 
-                                            "degrees");
+        SimConnect_AddToDataDefinition(hSimConnect, 
+                                       DEFINITION_MOVE, 
+                                       "Plane Longitude", 
+                                       "degrees");
 
-        hr = SimConnect_AddToDataDefinition(hSimConnect, 
-                                            DEFINITION_MOVE, 
-                                            "Plane Altitude", 
-                                            "meters");
+        SimConnect_AddToDataDefinition(hSimConnect, 
+                                       DEFINITION_MOVE, 
+                                       "Plane Altitude", 
+                                       "meters");
 
 		// DEFINITION_USER_POS - Lat/Long/Alt/Ground elev/wind
-        hr = SimConnect_AddToDataDefinition(hSimConnect, 
-                                            DEFINITION_USER_POS,
-                                            "Plane Latitude", 
-                                            "degrees");
-
-        hr = SimConnect_AddToDataDefinition(hSimConnect, 
-                                            DEFINITION_USER_POS,
-                                            "Plane Longitude", 
-                                            "degrees");
-
-        hr = SimConnect_AddToDataDefinition(hSimConnect, 
-                                            DEFINITION_USER_POS,
-                                            "PLANE ALTITUDE", 
-                                            "meters");
-
-        hr = SimConnect_AddToDataDefinition(hSimConnect, 
-                                            DEFINITION_USER_POS,
-                                            "GROUND ALTITUDE", 
-                                            "meters");
-
-        hr = SimConnect_AddToDataDefinition(hSimConnect, 
-                                            DEFINITION_USER_POS,
-                                            "AMBIENT WIND VELOCITY", 
-                                            "m/s");
-
-        hr = SimConnect_AddToDataDefinition(hSimConnect, 
-                                            DEFINITION_USER_POS,
-                                            "AMBIENT WIND DIRECTION", 
-                                            "degrees");
-
-        hr = SimConnect_AddToDataDefinition(hSimConnect, 
-                                            DEFINITION_USER_POS,
-                                            "SIM ON GROUND", 
-                                            "bool",
+        SimConnect_AddToDataDefinition(hSimConnect, 
+                                       DEFINITION_USER_POS,
+                                       "Plane Latitude", 
+                                       "degrees");
+
+        SimConnect_AddToDataDefinition(hSimConnect, 
+                                       DEFINITION_USER_POS,
+                                       "Plane Longitude", 
+                                       "degrees");
+
+        SimConnect_AddToDataDefinition(hSimConnect, 
+                                       DEFINITION_USER_POS,
+                                       "PLANE ALTITUDE", 
+                                       "meters");
+
+        SimConnect_AddToDataDefinition(hSimConnect, 
+                                       DEFINITION_USER_POS,
+                                       "GROUND ALTITUDE", 
+                                       "meters");
+
+        SimConnect_AddToDataDefinition(hSimConnect, 
+                                       DEFINITION_USER_POS,
+                                       "AMBIENT WIND VELOCITY", 
+                                       "m/s");
+
+        SimConnect_AddToDataDefinition(hSimConnect, 
+                                       DEFINITION_USER_POS,
+                                       "AMBIENT WIND DIRECTION", 
+                                       "degrees");
+
+        SimConnect_AddToDataDefinition(hSimConnect, 
+                                       DEFINITION_USER_POS,
+                                       "SIM ON GROUND", 
+                                       "bool",
 											SIMCONNECT_DATATYPE_INT32);
 
-        hr = SimConnect_AddToDataDefinition(hSimConnect, 
-                                            DEFINITION_USER_POS,
-                                            "ZULU TIME", 
-                                            "seconds",
+        SimConnect_AddToDataDefinition(hSimConnect, 
+                                       DEFINITION_USER_POS,
+                                       "ZULU TIME", 
+                                       "seconds",
 											SIMCONNECT_DATATYPE_INT32);
 
 
 		// SimLift client data definition
-		hr = SimConnect_AddToClientDataDefinition(hSimConnect,
+		SimConnect_AddToClientDataDefinition(hSimConnect,
 											DEFINITION_SIMLIFT,
 											SIMCONNECT_CLIENTDATAOFFSET_AUTO,
 											sizeof(sim_lift));
 												
 		// map the SimLift id
-		hr = SimConnect_MapClientDataNameToID(hSimConnect, SIMLIFT_NAME, SIMLIFT_ID);
+		SimConnect_MapClientDataNameToID(hSimConnect, SIMLIFT_NAME, SIMLIFT_ID);
 
 		// create reserved client data area
-		hr = SimConnect_CreateClientData(hSimConnect,
+		SimConnect_CreateClientData(hSimConnect,
 											SIMLIFT_ID,
 											sizeof(sim_lift),
 											SIMCONNECT_CREATE_CLIENT_DATA_FLAG_READ_ONLY);
 
+		if (multi_aircraft) {
+			// client data area for the lift values of the other aircraft
+			SimConnect_AddToClientDataDefinition(hSimConnect,
+												DEFINITION_SIMLIFT_MULTI,
+												SIMCONNECT_CLIENTDATAOFFSET_AUTO,
+												sizeof(sim_lift_multi));
+			SimConnect_MapClientDataNameToID(hSimConnect, SIMLIFT_MULTI_NAME, SIMLIFT_MULTI_ID);
+			SimConnect_CreateClientData(hSimConnect,
+												SIMLIFT_MULTI_ID,
+												sizeof(sim_lift_multi),
+												SIMCONNECT_CREATE_CLIENT_DATA_FLAG_READ_ONLY);
+		}
+
+		if (flight_stats) {
+			// client data area for the live flight statistics
+			SimConnect_AddToClientDataDefinition(hSimConnect,
+												DEFINITION_SIMLIFT_STATS,
+												SIMCONNECT_CLIENTDATAOFFSET_AUTO,
+												sizeof(sim_lift_stats));
+			SimConnect_MapClientDataNameToID(hSimConnect, SIMLIFT_STATS_NAME, SIMLIFT_STATS_ID);
+			SimConnect_CreateClientData(hSimConnect,
+												SIMLIFT_STATS_ID,
+												sizeof(sim_lift_stats),
+												SIMCONNECT_CREATE_CLIENT_DATA_FLAG_READ_ONLY);
+		}
+
         // Listen for a simulation start event
-        hr = SimConnect_SubscribeToSystemEvent(hSimConnect, EVENT_SIM_START, "SimStart");
+        SimConnect_SubscribeToSystemEvent(hSimConnect, EVENT_SIM_START, "SimStart");
 
         // Listen for an event saying an AI object has been removed
-        hr = SimConnect_SubscribeToSystemEvent(hSimConnect, EVENT_OBJECT_REMOVED, "ObjectRemoved");
+        SimConnect_SubscribeToSystemEvent(hSimConnect, EVENT_OBJECT_REMOVED, "ObjectRemoved");
 
         // Subscribe to the repeating 4-second timer event
-        hr = SimConnect_SubscribeToSystemEvent(hSimConnect, EVENT_4S_TIMER, "4sec");
+        SimConnect_SubscribeToSystemEvent(hSimConnect, EVENT_4S_TIMER, "4sec");
 
         // Subscribe to the FlightLoaded event to detect flight start and end
-        hr = SimConnect_SubscribeToSystemEvent(hSimConnect, EVENT_FLIGHTLOADED, "FlightLoaded");
+        SimConnect_SubscribeToSystemEvent(hSimConnect, EVENT_FLIGHTLOADED, "FlightLoaded");
 
         // Subscribe to the MissionCompleted event to detect flight end
-        hr = SimConnect_SubscribeToSystemEvent(hSimConnect, EVENT_MISSIONCOMPLETED, "MissionCompleted");
+        SimConnect_SubscribeToSystemEvent(hSimConnect, EVENT_MISSIONCOMPLETED, "MissionCompleted");
 
 		//  set the id for the freeze events so this client has full control of probe objects
-		hr = SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_FREEZE_ALTITUDE, "FREEZE_ALTITUDE_SET");
-		hr = SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_FREEZE_ATTITUDE, "FREEZE_ATTITUDE_SET");
+		SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_FREEZE_ALTITUDE, "FREEZE_ALTITUDE_SET");
+		SimConnect_MapClientEventToSimEvent(hSimConnect, EVENT_FREEZE_ATTITUDE, "FREEZE_ATTITUDE_SET");
+
+		// lift is calculated on the compute thread from the profile snapshots
+		start_compute_thread();
+		start_recorder_thread();
 
 		// Now loop checking for messages until quit
         while( 0 == quit )
         {
-            SimConnect_CallDispatch(hSimConnect, MyDispatchProcSO, NULL);
+            SimConnect_CallDispatch(hSimConnect, capture_file ? capture_dispatch : MyDispatchProcSO, NULL);
+			run_sample_cycle(); // for the probe reply deadline
+			publish_results();
             Sleep(1);
         } 
+        stop_compute_thread();
+        stop_recorder_thread();
 
-        hr = SimConnect_Close(hSimConnect);
+        SimConnect_Close(hSimConnect);
     }
 }
 
 
-//int __cdecl _tmain(int argc, _TCHAR* argv[])
-int main(int argc, char* argv[])
-{
-	// set up command line arguments (debug mode)
-	for (int i=1; i<argc; i++) {
-		if (strcmp(argv[i],"debug")==0) {
-			debug = true;
-			debug_info = false;
-		}
-		else if (strcmp(argv[i],"info")==0)      debug_info = true; // will open console window
-		else if (strcmp(argv[i],"calls")==0)     debug_calls = true;
-		else if (strcmp(argv[i],"events")==0)    debug_events = true;
-		else if (strncmp(argv[i],"model=",6)==0) probe_model = argv[i]+6;
-		else if (strncmp(argv[i],"log=",4)==0)   igc_log_directory = argv[i]+4;
-		if (debug) printf("Command line argument %d is %s\n",i,argv[i]);
-	}
-	if (!debug && !debug_info) FreeConsole(); // kill console unless requested
-
-	if (debug) {
-		printf("Starting sim_probe version %.2f in debug mode\n", version);
-		printf("IGC logs folder '%s'\n", igc_log_directory);
-	}
-	if (debug || ( debug_info && (strcmp(probe_model,"SimProbe")!=0))) {
-		printf("The probe AI Object model is %s\n",probe_model);
-	}
-
-    connectToSim();
-    return 0;
-}
\ No newline at end of file
@@ -0,0 +1,214 @@
+//------------------------------------------------------------------------------
+//
+//  sim_probe.h: the parts of the FSX add-on (sim_probe.cpp) used by sim_probe_main.cpp and by
+//  sim_probe_replay, which feeds a capture back through the add-on with no FSX connection
+//
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include "sim_probe_lib.h"
+#include "SimConnect.h"
+
+//*******************************************************************************
+// SimConnect request ids and client data
+
+enum DATA_REQUEST_ID {
+//    REQUEST_1,
+    REQUEST_PROBE_CREATE1,
+    REQUEST_PROBE_CREATE2,
+    REQUEST_PROBE_CREATE3,
+    REQUEST_PROBE_CREATE4,
+    //REQUEST_PROBE_CREATE5,
+    REQUEST_PROBE_REMOVE1,
+    REQUEST_PROBE_REMOVE2,
+    REQUEST_PROBE_REMOVE3,
+    REQUEST_PROBE_REMOVE4,
+    //REQUEST_PROBE_REMOVE5,
+    REQUEST_PROBE_RELEASE1,
+    REQUEST_PROBE_RELEASE2,
+    REQUEST_PROBE_RELEASE3,
+    REQUEST_PROBE_RELEASE4,
+    REQUEST_PROBE_POS1,
+    REQUEST_PROBE_POS2,
+    REQUEST_PROBE_POS3,
+    REQUEST_PROBE_POS4,
+    //REQUEST_PROBE_POS5,
+    REQUEST_USER_POS_AND_PROFILE,
+	REQUEST_STARTUP_DATA,
+	REQUEST_AIRCRAFT_POS, // by-type request for other aircraft within aircraft_radius
+	REQUEST_RECORDER_ID, // by-type request for the ATC id/type of the recorded aircraft
+	REQUEST_USER_POS_NEAR_RIDGE, // user position between the subscription replies (ridge index)
+	REQUEST_PROBE_ALIVE, // once-read of probe 1 by test_heartbeat() when no probe was moved
+	REQUEST_ID_COUNT // number of request ids (not a request)
+};
+
+// structure for lift value client data
+struct SimLift {
+	double lift;
+	int status; // 0 = ok, 1 = problem, 2 = degraded (probe value substituted), others = reserved
+	double version;
+};
+
+extern SimLift sim_lift; // the lift client data
+
+// fields of the tagged probe subscription, see subscribe_probe()
+enum PROBE_DATUM_ID {
+	PROBE_DATUM_ELEVATION,
+	PROBE_DATUM_LATITUDE,
+	PROBE_DATUM_LONGITUDE,
+	PROBE_DATUM_ALTITUDE,       // these three only with 'windfield'
+	PROBE_DATUM_WIND_VELOCITY,
+	PROBE_DATUM_WIND_DIRECTION
+};
+
+//*******************************************************************************
+// add-on state read by sim_probe_bench
+
+extern UserStruct user_pos;
+extern DWORD probe_id[PROFILE_COUNT]; // object id of probe[i]
+extern bool probe_created[PROFILE_COUNT];
+
+const double SURFACE_FIT_TILE = 0.004; // tile size in degrees (about 440m north-south)
+void surface_fit_add(double latitude, double longitude, double ground_elevation);
+bool surface_fit_get(double latitude, double longitude, double *ground_elevation);
+
+//*******************************************************************************
+// TRACE
+// the binary trace of the hot path, see TRACE in sim_probe.cpp
+
+struct TraceRecord {
+	LONGLONG time; // QueryPerformanceCounter ticks
+	WORD trace_id; // TRACE_ID
+	BYTE probe; // probe (or aircraft) index, 0 if none
+	BYTE thread; // 0 = main (dispatch) thread, 1 = compute thread
+	DWORD id; // request/event/function id, depending on trace_id
+};
+
+// header at the start of a trace dump file
+struct TraceHeader {
+	char magic[4]; // "SPTR"
+	DWORD version;
+	LONGLONG frequency; // QueryPerformanceFrequency ticks per second
+	DWORD count; // number of TraceRecords following
+	DWORD dropped; // records overwritten in the ring buffer before the dump
+};
+
+const DWORD TRACE_BUF_SIZE = 65536; // ring buffer records (must be a power of 2)
+
+const DWORD TRACE_VERSION = 2; // version 1 had no thread field (always 0 in the high probe byte)
+
+extern bool tracing; // set by 'trace=', 'calls' or 'events' on the command line
+extern bool trace_console; // print the decoded trace at quit ('calls' or 'events')
+extern const char *trace_file; // binary trace dump file written at quit ('trace=<file>')
+
+void trace_output(const TraceRecord *buf, DWORD start, DWORD count, DWORD mask, LONGLONG frequency,
+				  FILE *text, FILE *json);
+void trace_dump();
+
+// END OF TRACE
+//*******************************************************************************
+
+//*******************************************************************************
+// CAPTURE
+// the capture file written by 'record=<file>' and read by "sim_probe_replay replay=<file>", see
+// CAPTURE in sim_probe.cpp
+
+enum CAPTURE_TYPE {
+	CAPTURE_RECV, // data is the SIMCONNECT_RECV message as delivered
+	CAPTURE_CALL, // data is a CaptureCall
+	CAPTURE_STATE // data is the WarmState restored at startup (see WARM START)
+};
+
+enum CAPTURE_CALL_ID {
+	CALL_REQUEST,     // id = DATA_REQUEST_ID, arg = probe index
+	CALL_MOVE,        // id = probe index
+	CALL_CLIENT_DATA, // id = 0 user lift (arg = lift in cm/s), 1 other aircraft (arg = count),
+	                  // 2 flight stats (arg = mode)
+	CALL_ID_COUNT
+};
+
+extern const char *call_name[CALL_ID_COUNT];
+
+
+// header at the start of a capture file, with the options that change the message flow
+struct CaptureHeader {
+	char magic[4]; // "SPRC"
+	DWORD version;
+	DWORD multi_aircraft;
+	double aircraft_radius;
+	char stencil[16]; // lift model stencil name (version 2)
+	DWORD flight_stats; // (version 3)
+	DWORD flight_recorder; // (version 4)
+	DWORD wind_field; // (version 5)
+	DWORD surface_fit; // (version 6)
+	DWORD ridge_cells; // cells in the ridge index, 0 => none (version 7)
+};
+
+const DWORD CAPTURE_VERSION = 7;
+const size_t CAPTURE_HEADER_V2_SIZE = offsetof(CaptureHeader, flight_stats);
+const size_t CAPTURE_HEADER_V4_SIZE = offsetof(CaptureHeader, wind_field); // versions 3 and 4
+const size_t CAPTURE_HEADER_V5_SIZE = offsetof(CaptureHeader, surface_fit);
+const size_t CAPTURE_HEADER_V6_SIZE = offsetof(CaptureHeader, ridge_cells);
+
+// capture_header_size() is the size of the header written by a capture file version
+inline size_t capture_header_size(DWORD version) {
+	if (version<3) return CAPTURE_HEADER_V2_SIZE;
+	if (version<5) return CAPTURE_HEADER_V4_SIZE;
+	if (version<6) return CAPTURE_HEADER_V5_SIZE;
+	if (version<7) return CAPTURE_HEADER_V6_SIZE;
+	return sizeof(CaptureHeader);
+}
+
+struct CaptureRecord {
+	WORD type; // CAPTURE_TYPE
+	WORD reserved;
+	DWORD time; // GetTickCount() when the message was dispatched or the call made
+	DWORD size; // bytes of data following
+};
+
+struct CaptureCall {
+	DWORD call; // CAPTURE_CALL_ID
+	DWORD id;
+	INT32 arg;
+};
+
+extern FILE *capture_file; // open while recording ('record=<file>')
+
+extern bool replaying;
+extern DWORD replay_clock; // recorded time of the message being replayed
+
+extern CaptureCall *replay_calls[CALL_ID_COUNT];
+extern DWORD replay_call_count[CALL_ID_COUNT];
+extern DWORD replay_call_next[CALL_ID_COUNT];
+extern DWORD replay_mismatch_count;
+
+void capture_write(CAPTURE_TYPE type, const void *data, DWORD size);
+bool capture_open(const char *fn);
+
+// END OF CAPTURE
+//*******************************************************************************
+
+// command line options, set by main() or from the header of a capture being replayed
+extern const char *probe_model;
+extern const char *igc_log_directory;
+extern bool track_log;
+extern bool multi_aircraft;
+extern double aircraft_radius;
+extern bool flight_stats;
+extern bool flight_recorder;
+extern bool wind_field;
+extern bool surface_fit;
+extern const char *state_file;
+extern bool state_restored;
+
+extern int quit;
+
+bool state_restore(const WarmState *w);
+bool state_load(const char *fn);
+
+void CALLBACK MyDispatchProcSO(SIMCONNECT_RECV* pData, DWORD cbData, void *pContext);
+void run_sample_cycle();
+void compute_pending();
+void publish_results();
+void connectToSim();
@@ -0,0 +1,334 @@
+//------------------------------------------------------------------------------
+//
+//  sim_probe_bench: micro-benchmarks of the lift model and the add-on hot path, no FSX connection
+//
+//  Command line:
+//              bench [bench=<baseline file>]
+//
+//              Linux only, built with the stand-in headers and fake FSX (see standin/build.sh)
+//------------------------------------------------------------------------------
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_probe.h"
+
+//*********************************************************************************************
+// BENCHMARKS
+// "sim_probe_bench" times the lift and geodesy math, IGC 'B' record formatting and a full lift
+// sample through MyDispatchProcSO, the compute step and the publish step (fed with synthetic
+// replies, no FSX connection - the SimConnect calls made along the way go to the fake FSX of
+// the stand-in, so this measures sim_probe's own processing).  "bench=<file>" compares against
+// the baseline in <file>, or writes <file> as the new baseline if it doesn't exist yet.
+//
+// sim_probe_bench is only built with the stand-in (standin/build.sh).  Allocations are counted
+// by the operator new in standin/bench_alloc.cpp, linked into this program alone.
+//*********************************************************************************************
+
+const double BENCH_MIN_SECONDS = 0.25; // each benchmark is repeated until it runs this long
+const double BENCH_REGRESSION = 1.20; // flag results more than 20% slower than the baseline
+
+volatile double bench_sink; // results are accumulated here so the optimiser can't drop the work
+
+// in standin/bench_alloc.cpp
+extern volatile LONG bench_allocs; // count of operator new calls, reported as allocations per op
+extern bool bench_counting; // only set by run_benchmarks(), so the setup isn't counted
+
+void bench_distance_and_bearing(INT32 n) {
+	double sum = 0.0;
+	for (INT32 k=0; k<n; k++) {
+		MoveStruct p = distance_and_bearing(47.4, -122.3, 250.0 + (k & 1023), double(k % 360));
+		sum += p.latitude;
+	}
+	bench_sink = sum;
+}
+
+void bench_calc_profile_latlongs(INT32 n) {
+	for (INT32 k=0; k<n; k++) {
+		user_pos.wind_direction = double(k % 360);
+		calc_profile_latlongs(&user_pos);
+	}
+	bench_sink = profile[3].latitude;
+}
+
+void bench_adj_slope(INT32 n) {
+	double sum = 0.0;
+	for (INT32 k=0; k<n; k++) sum += adj_slope(double((k & 255) - 128) / 256.0);
+	bench_sink = sum;
+}
+
+void bench_agl_factor(INT32 n) {
+	double sum = 0.0;
+	for (INT32 k=0; k<n; k++) sum += agl_factor(300.0 + (k & 1023), 250.0);
+	bench_sink = sum;
+}
+
+void bench_ridge_lift(INT32 n) {
+	double sum = 0.0;
+	double elevation[PROFILE_COUNT] = { 250.0, 200.0, 180.0, 120.0, 260.0 };
+	for (INT32 k=0; k<n; k++) {
+		elevation[1] = 200.0 + (k & 63);
+		sum += ridge_lift(&user_pos, elevation);
+	}
+	bench_sink = sum;
+}
+
+// bench_lift_kernel<S>() is bench_ridge_lift() for the compile-time kernel of stencil S
+template <class S>
+void bench_lift_kernel(INT32 n) {
+	double sum = 0.0;
+	double elevation[PROFILE_COUNT] = { 250.0, 200.0, 180.0, 120.0, 260.0 };
+	for (INT32 k=0; k<n; k++) {
+		elevation[1] = 200.0 + (k & 63);
+		sum += ridge_lift_kernel<S>(&user_pos, elevation, NULL);
+	}
+	bench_sink = sum;
+}
+
+// one op = a sample added to the surface fit and the fit read at another point of the tile
+void bench_surface_fit(INT32 n) {
+	double sum = 0.0, elevation;
+	for (INT32 k=0; k<n; k++) {
+		double x = double(k & 15) / 16.0, y = double((k >> 4) & 15) / 16.0;
+		double latitude = 47.0 + (y + double((k >> 8) & 3)) * SURFACE_FIT_TILE;
+		double longitude = -122.0 + x * SURFACE_FIT_TILE;
+		surface_fit_add(latitude, longitude, 300.0 + 200.0 * x - 100.0 * x * x + 50.0 * y);
+		if (surface_fit_get(latitude, longitude + 0.5 * SURFACE_FIT_TILE * (0.5 - x), &elevation)) sum += elevation;
+	}
+	bench_sink = sum;
+}
+
+// one op = the ridge index checked along the wind line of a profile, a north-south ridge
+// 1km east of the aircraft
+void bench_ridge_near(INT32 n) {
+	static RidgeCell ridge[101];
+	for (int k=0; k<101; k++) {
+		RidgeCell c = { k - 50, 4, 0.2f, 100.0f, RIDGE_FACE };
+		ridge[k] = c;
+	}
+	RidgeCell *cells = ridge_cells;
+	DWORD count = ridge_cell_count;
+	ridge_cells = ridge;
+	ridge_cell_count = 101;
+	INT32 near = 0;
+	for (INT32 k=0; k<n; k++) {
+		if (ridge_near(user_pos.latitude, user_pos.longitude, double(k % 360))) near++;
+	}
+	ridge_cells = cells;
+	ridge_cell_count = count;
+	bench_sink = near;
+}
+
+void bench_igc_b_record(INT32 n) {
+	char buf[100];
+	igc_b p = { 43200, 47.4312, -122.3081, 1234.0, 0.0, 0.0, 0.0, 0.0, {0} };
+	INT32 len = 0;
+	for (INT32 k=0; k<n; k++) {
+		p.zulu_time = 43200 + (k & 4095);
+		len += igc_format_b_record(buf, sizeof(buf), &p);
+	}
+	bench_sink = len;
+}
+
+void bench_track_fix(INT32 n) {
+	BYTE buf[TRACK_MAX_FIX_BYTES];
+	igc_b p = { 43200, 47.4312, -122.3081, 1234.0, 850.0, 1.25, 0.0, 0.0, {0} };
+	TrackCoder c;
+	c.count = 0;
+	INT32 len = 0;
+	for (INT32 k=0; k<n; k++) {
+		if ((k & 255)==0) c.count = 0; // new block
+		p.zulu_time = 43200 + 4 * (k & 4095);
+		p.latitude += 0.0001;
+		len += track_encode_fix(&c, &p, buf);
+	}
+	bench_sink = len;
+}
+
+// bench_query_line() answers a lift query line from the elevation cache, as the query service
+void bench_query_line(INT32 n) {
+	QueryService q = { NULL, 0, 0 };
+	char reply[100];
+	// cache the elevations along the wind line of the query, 2.2km upwind to 200m downwind
+	for (double d=-200.0; d<=2200.0; d+=50.0) {
+		MoveStruct p = distance_and_bearing(47.4, -122.3, d, 270.0);
+		elev_cache_put(p.latitude, p.longitude, 300.0 + 0.1 * d);
+	}
+	INT32 len = 0;
+	for (INT32 k=0; k<n; k++) {
+		len += query_answer(&q, "L 47.4 -122.3 650 270 8", reply, sizeof(reply));
+	}
+	bench_sink = len;
+}
+
+// bench_msg builds a synthetic SIMCONNECT_RECV_SIMOBJECT_DATA reply with data copied to dwData
+struct BenchMsg {
+	SIMCONNECT_RECV_SIMOBJECT_DATA hdr;
+	double data[16]; // room for the payload that follows hdr.dwData
+};
+
+void bench_msg(BenchMsg *m, DWORD recv_id, DWORD request_id, DWORD object_id, const void *data, size_t size) {
+	memset(m, 0, sizeof(*m));
+	m->hdr.dwSize = sizeof(*m);
+	m->hdr.dwID = recv_id;
+	m->hdr.dwRequestID = request_id;
+	m->hdr.dwObjectID = object_id;
+	m->hdr.dwentrynumber = 1;
+	m->hdr.dwoutof = 1;
+	memcpy(&m->hdr.dwData, data, size);
+}
+
+// bench_sample_chain() feeds n lift samples through the dispatch, compute and publish steps,
+// with the probe replies carrying datums 0..datums-1 of PROBE_DATUM_ID
+void bench_sample_chain(INT32 n, int datums) {
+	BenchMsg user, probe[PROFILE_COUNT];
+	UserStruct u = { 47.4, -122.3, 600.0, 250.0, 10.0, 270.0, 0, 43200 };
+	for (int i=1; i<PROFILE_COUNT; i++) {
+		probe_created[i] = true;
+		probe_id[i] = 1000 + i;
+	}
+	for (INT32 k=0; k<n; k++) {
+		// aircraft moves 100m north each second so every probe has to move
+		u.zulu_time = 43200 + k;
+		u.latitude = 47.4 + 0.0009 * (k & 1023);
+		bench_msg(&user, SIMCONNECT_RECV_ID_SIMOBJECT_DATA, REQUEST_USER_POS_AND_PROFILE, 1, &u, sizeof(u));
+		MyDispatchProcSO(&user.hdr, sizeof(user), NULL);
+		for (int i=1; i<PROFILE_COUNT; i++) {
+			// tagged probe subscription data: (datum id, value) pairs
+			struct { DWORD id; double value; } tagged[6] = {
+				{ PROBE_DATUM_ELEVATION, 200.0 + 10.0 * i },
+				{ PROBE_DATUM_LATITUDE, profile[i].latitude },
+				{ PROBE_DATUM_LONGITUDE, profile[i].longitude },
+				{ PROBE_DATUM_ALTITUDE, 600.0 },
+				{ PROBE_DATUM_WIND_VELOCITY, 10.0 - i },
+				{ PROBE_DATUM_WIND_DIRECTION, 270.0 } };
+			char data[6 * (sizeof(DWORD) + sizeof(double))];
+			for (int t=0; t<datums; t++) {
+				memcpy(data + t * (sizeof(DWORD) + sizeof(double)), &tagged[t].id, sizeof(DWORD));
+				memcpy(data + t * (sizeof(DWORD) + sizeof(double)) + sizeof(DWORD), &tagged[t].value, sizeof(double));
+			}
+			bench_msg(&probe[i], SIMCONNECT_RECV_ID_SIMOBJECT_DATA, REQUEST_PROBE_POS1+i-1, probe_id[i], data, datums * (sizeof(DWORD) + sizeof(double)));
+			probe[i].hdr.dwDefineCount = datums;
+			MyDispatchProcSO(&probe[i].hdr, sizeof(probe[i]), NULL);
+		}
+		// no compute thread in bench mode, so run its work and the main loop's here
+		compute_pending();
+		publish_results();
+	}
+	bench_sink = sim_lift.lift;
+}
+
+// one op = the full chain of replies for one lift sample
+void bench_dispatch_cycle(INT32 n) {
+	bench_sample_chain(n, 3);
+}
+
+// bench_dispatch_cycle() with the wind at the probes ('windfield')
+void bench_dispatch_cycle_wind(INT32 n) {
+	wind_field = true;
+	bench_sample_chain(n, 6);
+	wind_field = false;
+}
+
+typedef void (*BenchFn)(INT32 n);
+
+struct Bench {
+	const char *name;
+	BenchFn fn;
+};
+
+Bench benches[] = {
+	{ "distance_and_bearing", bench_distance_and_bearing },
+	{ "calc_profile_latlongs", bench_calc_profile_latlongs },
+	{ "adj_slope", bench_adj_slope },
+	{ "agl_factor", bench_agl_factor },
+	{ "ridge_lift", bench_ridge_lift },
+	{ "lift_kernel_ridge", bench_lift_kernel<RidgeStencil> },
+	{ "lift_kernel_mountain", bench_lift_kernel<MountainStencil> },
+	{ "lift_kernel_dune", bench_lift_kernel<DuneStencil> },
+	{ "surface_fit", bench_surface_fit },
+	{ "ridge_near", bench_ridge_near },
+	{ "igc_b_record", bench_igc_b_record },
+	{ "track_fix", bench_track_fix },
+	{ "query_line", bench_query_line },
+	{ "dispatch_cycle", bench_dispatch_cycle },
+	{ "dispatch_cycle_wind", bench_dispatch_cycle_wind }
+};
+const int BENCH_COUNT = sizeof(benches) / sizeof(benches[0]);
+
+// bench_run() doubles the op count until the run takes BENCH_MIN_SECONDS, returns ns per op
+double bench_run(BenchFn fn, double *allocs_per_op) {
+	for (INT32 n=1; ; n*=2) {
+		LONG allocs = bench_allocs;
+		LONGLONG start = perf_now();
+		fn(n);
+		double seconds = double(perf_now() - start) / double(perf_frequency);
+		if (seconds >= BENCH_MIN_SECONDS || n >= (1<<30)) {
+			*allocs_per_op = double(bench_allocs - allocs) / n;
+			return seconds * 1.0e9 / n;
+		}
+	}
+}
+
+// run_benchmarks() returns the number of regressions against the baseline (0 if none)
+int run_benchmarks(const char *baseline_file) {
+	double baseline[BENCH_COUNT] = {0.0};
+	double result[BENCH_COUNT];
+	bool have_baseline = false;
+	FILE *f;
+	if (baseline_file[0]!=0 && fopen_s(&f, baseline_file, "r") == 0) {
+		char name[64];
+		double ns;
+		while (fscanf_s(f, "%63s %lf", name, (unsigned)sizeof(name), &ns) == 2) {
+			for (int b=0; b<BENCH_COUNT; b++) {
+				if (strcmp(name, benches[b].name)==0) baseline[b] = ns;
+			}
+		}
+		fclose(f);
+		have_baseline = true;
+	}
+	int regressions = 0;
+	bench_counting = true;
+	printf("%-24s %12s %10s %12s\n", "benchmark", "ns/op", "allocs/op", "vs baseline");
+	for (int b=0; b<BENCH_COUNT; b++) {
+		double allocs;
+		result[b] = bench_run(benches[b].fn, &allocs);
+		printf("%-24s %12.1f %10.2f", benches[b].name, result[b], allocs);
+		if (baseline[b] > 0.0) {
+			printf(" %+11.1f%%", (result[b] / baseline[b] - 1.0) * 100.0);
+			if (result[b] > baseline[b] * BENCH_REGRESSION) {
+				printf("  REGRESSION");
+				regressions++;
+			}
+		}
+		printf("\n");
+	}
+	bench_counting = false;
+	if (baseline_file[0]!=0 && !have_baseline) {
+		if (fopen_s(&f, baseline_file, "w") != 0) {
+			printf("Error: couldn't write baseline file %s\n", baseline_file);
+			return 0;
+		}
+		for (int b=0; b<BENCH_COUNT; b++) fprintf(f, "%s %.1f\n", benches[b].name, result[b]);
+		fclose(f);
+		printf("Baseline written to %s\n", baseline_file);
+	}
+	return regressions;
+}
+
+// END OF BENCHMARKS
+//*********************************************************************************************
+
+int main(int argc, char* argv[])
+{
+	const char *bench_file = "";
+	for (int i=1; i<argc; i++) {
+		if (strncmp(argv[i],"bench=",6)==0) bench_file = argv[i]+6;
+	}
+	perf_init();
+	igc_extension_init();
+
+	return run_benchmarks(bench_file);
+}
@@ -0,0 +1,496 @@
+//------------------------------------------------------------------------------
+//
+//  sim_probe_index: indexes a corpus of IGC files and queries the index, no FSX connection
+//
+//  Command line:
+//              index=<dir> [threads=<n>]
+//              query=<index> box=<lat1>,<long1>,<lat2>,<long2> [from=<yyyy-mm-dd>] [to=<yyyy-mm-dd>]
+//                    [wind=<from>,<to>]
+//------------------------------------------------------------------------------
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_probe_lib.h"
+
+//*********************************************************************************************
+// IGC INDEX
+// "sim_probe_index index=<dir>" parses every .igc file in dir (a prefix like log=, so end it with a
+// '\\') on 'threads=' worker threads and writes <dir>sim_probe.idx.  Each file is mapped into
+// memory and parsed in place.  The fixes are cut into segments of up to INDEX_SEGMENT_FIXES,
+// each with its time span, bounding box and, from the sim_probe extension columns, the mean
+// wind and the best lift.  The segments are bucketed on an INDEX_CELL degree lat/long grid.
+// "sim_probe_index query=<index> box=<lat1>,<long1>,<lat2>,<long2> [from=<yyyy-mm-dd>]
+// [to=<yyyy-mm-dd>] [wind=<from>,<to>]" lists the segments inside the box, time and wind
+// direction range (degrees, clockwise, e.g. wind=240,300 for westerlies).
+//*********************************************************************************************
+
+const int INDEX_VERSION = 1;
+const int INDEX_SEGMENT_FIXES = 32;
+const double INDEX_CELL = 0.1; // degrees
+const WORD INDEX_HAS_WIND = 1; // segment has WDI/WVE columns
+
+struct IndexHeader {
+	char magic[4]; // "SPIX"
+	DWORD version;
+	DWORD file_count;
+	DWORD segment_count;
+	DWORD cell_count;
+	DWORD posting_count;
+	DWORD names_size; // bytes of file names, each NUL terminated
+	float cell_size; // degrees
+};
+
+struct IndexSegment {
+	DWORD file; // into the file table
+	DWORD first_fix; // B record number of the first fix in the file
+	WORD fix_count;
+	WORD flags;
+	DWORD start_time; // seconds since 1970 UTC
+	DWORD end_time;
+	float min_latitude;
+	float min_longitude;
+	float max_latitude;
+	float max_longitude;
+	float wind_direction; // mean, degrees
+	float wind_velocity; // mean, m/s
+	float max_lift; // m/s
+};
+
+// the segments in a grid cell are postings[first..first+count-1]
+struct IndexCell {
+	INT32 lat_cell;
+	INT32 long_cell;
+	DWORD first;
+	DWORD count;
+};
+
+// one corpus file, parsed by a worker thread
+struct IndexFile {
+	char name[MAX_PATH];
+	IndexSegment *segments;
+	int segment_count;
+	int fix_count;
+};
+
+IndexFile *index_files = NULL;
+int index_file_count = 0;
+const char *index_directory = "";
+volatile LONG index_next = 0;
+
+// segment accumulator, the wind averaged as a vector so 350 and 10 degrees give 0
+struct IndexSegmentBuilder {
+	IndexSegment seg;
+	double wind_x;
+	double wind_y;
+	double wind_velocity;
+	int wind_count;
+};
+
+void index_segment_start(IndexSegmentBuilder *b, DWORD file, DWORD fix) {
+	memset(b, 0, sizeof(*b));
+	b->seg.file = file;
+	b->seg.first_fix = fix;
+	b->seg.max_lift = -100.0f;
+}
+
+void index_segment_add(IndexSegmentBuilder *b, const igc_b *p, DWORD time, bool has_wind) {
+	IndexSegment *s = &b->seg;
+	if (s->fix_count==0) {
+		s->start_time = time;
+		s->min_latitude = s->max_latitude = float(p->latitude);
+		s->min_longitude = s->max_longitude = float(p->longitude);
+	}
+	s->end_time = time;
+	s->fix_count++;
+	s->min_latitude = min(s->min_latitude, float(p->latitude));
+	s->max_latitude = max(s->max_latitude, float(p->latitude));
+	s->min_longitude = min(s->min_longitude, float(p->longitude));
+	s->max_longitude = max(s->max_longitude, float(p->longitude));
+	s->max_lift = max(s->max_lift, float(p->lift));
+	if (has_wind) {
+		b->wind_x += sin(deg2rad(p->wind_direction));
+		b->wind_y += cos(deg2rad(p->wind_direction));
+		b->wind_velocity += p->wind_velocity;
+		b->wind_count++;
+	}
+}
+
+void index_segment_end(IndexSegmentBuilder *b, IndexFile *f, int *capacity) {
+	if (b->seg.fix_count==0) return;
+	if (b->wind_count>0) {
+		b->seg.flags |= INDEX_HAS_WIND;
+		double direction = rad2deg(atan2(b->wind_x, b->wind_y));
+		b->seg.wind_direction = float(direction<0.0 ? direction + 360.0 : direction);
+		b->seg.wind_velocity = float(b->wind_velocity / b->wind_count);
+	}
+	if (f->segment_count==*capacity) {
+		*capacity = *capacity * 2 + 16;
+		IndexSegment *grown = new IndexSegment[*capacity];
+		if (f->segment_count>0) memcpy(grown, f->segments, f->segment_count * sizeof(IndexSegment));
+		delete[] f->segments;
+		f->segments = grown;
+	}
+	f->segments[f->segment_count++] = b->seg;
+}
+
+// index_parse_file() cuts the fixes of file k into segments, reading the file in place
+void index_parse_file(int k) {
+	IndexFile *f = &index_files[k];
+	f->segments = NULL;
+	f->segment_count = f->fix_count = 0;
+	char path[2 * MAX_PATH];
+	sprintf_s(path, sizeof(path), "%s%s", index_directory, f->name);
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file==INVALID_HANDLE_VALUE) return;
+	DWORD size = GetFileSize(file, NULL);
+	HANDLE mapping = (size>0) ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+	const char *data = mapping ? (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (data==NULL) {
+		if (mapping) CloseHandle(mapping);
+		CloseHandle(file);
+		return;
+	}
+	char i_record[200] = "I00";
+	bool has_wind = false;
+	struct tm date;
+	memset(&date, 0, sizeof(date));
+	date.tm_mday = 1;
+	date.tm_year = 70;
+	DWORD day_start = 0; // seconds since 1970 at 00:00 UTC on the flight date
+	INT32 prev_time = -1;
+	int capacity = 0;
+	IndexSegmentBuilder b;
+	index_segment_start(&b, k, 0);
+	for (const char *line=data, *end=data+size; line<end; ) {
+		const char *eol = (const char *)memchr(line, '\n', end - line);
+		size_t length = (eol ? eol : end) - line;
+		igc_b fix;
+		if (line[0]=='B' && igc_parse_b_record(line, length, &fix)) {
+			igc_parse_extensions(i_record, line, length, &fix);
+			if (prev_time>=0 && fix.zulu_time<prev_time) day_start += 86400; // past midnight UTC
+			prev_time = fix.zulu_time;
+			index_segment_add(&b, &fix, day_start + fix.zulu_time, has_wind);
+			f->fix_count++;
+			if (b.seg.fix_count==INDEX_SEGMENT_FIXES) {
+				index_segment_end(&b, f, &capacity);
+				index_segment_start(&b, k, f->fix_count);
+			}
+		} else if (line[0]=='I' && length<sizeof(i_record)) {
+			memcpy(i_record, line, length);
+			i_record[length] = 0;
+			has_wind = strstr(i_record, "WDI")!=NULL && strstr(i_record, "WVE")!=NULL;
+		} else if (length>=11 && strncmp(line, "HFDTE", 5)==0) {
+			int ddmmyy = igc_field(line+5, 6);
+			if (ddmmyy>=0) {
+				date.tm_mday = ddmmyy / 10000;
+				date.tm_mon = ddmmyy / 100 % 100 - 1;
+				date.tm_year = ddmmyy % 100 + (ddmmyy % 100 < 80 ? 100 : 0);
+				day_start = DWORD(_mkgmtime(&date));
+			}
+		}
+		line += length + 1;
+	}
+	index_segment_end(&b, f, &capacity);
+	UnmapViewOfFile(data);
+	CloseHandle(mapping);
+	CloseHandle(file);
+}
+
+DWORD WINAPI index_worker(LPVOID) {
+	for (;;) {
+		LONG k = InterlockedIncrement(&index_next) - 1;
+		if (k >= index_file_count) break;
+		index_parse_file(k);
+	}
+	return 0;
+}
+
+inline INT32 index_cell(double degrees) {
+	return INT32(floor(degrees / INDEX_CELL));
+}
+
+struct IndexPosting {
+	INT32 lat_cell;
+	INT32 long_cell;
+	DWORD segment;
+};
+
+int index_posting_compare(const void *a, const void *b) {
+	const IndexPosting *pa = (const IndexPosting *)a, *pb = (const IndexPosting *)b;
+	if (pa->lat_cell!=pb->lat_cell) return (pa->lat_cell < pb->lat_cell) ? -1 : 1;
+	if (pa->long_cell!=pb->long_cell) return (pa->long_cell < pb->long_cell) ? -1 : 1;
+	return (pa->segment < pb->segment) ? -1 : (pa->segment > pb->segment) ? 1 : 0;
+}
+
+int run_index(const char *directory, int threads) {
+	index_directory = directory;
+	char pattern[2 * MAX_PATH];
+	sprintf_s(pattern, sizeof(pattern), "%s*.igc", directory);
+	// list the corpus
+	int capacity = 0;
+	WIN32_FIND_DATAA found;
+	HANDLE find = FindFirstFileA(pattern, &found);
+	if (find!=INVALID_HANDLE_VALUE) {
+		do {
+			if (index_file_count==capacity) {
+				capacity = capacity * 2 + 64;
+				IndexFile *grown = new IndexFile[capacity];
+				if (index_file_count>0) memcpy(grown, index_files, index_file_count * sizeof(IndexFile));
+				delete[] index_files;
+				index_files = grown;
+			}
+			strcpy_s(index_files[index_file_count++].name, found.cFileName);
+		} while (FindNextFileA(find, &found));
+		FindClose(find);
+	}
+	if (index_file_count==0) {
+		printf("Error: no IGC files match %s\n", pattern);
+		return 1;
+	}
+	if (threads<=0) {
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		threads = si.dwNumberOfProcessors;
+	}
+
+	// parse
+	LONGLONG start = perf_now();
+	index_next = 0;
+	HANDLE *workers = new HANDLE[threads];
+	for (int k=0; k<threads; k++) workers[k] = CreateThread(NULL, 0, index_worker, NULL, 0, NULL);
+	for (int k=0; k<threads; k++) {
+		WaitForSingleObject(workers[k], INFINITE);
+		CloseHandle(workers[k]);
+	}
+	delete[] workers;
+	double parse_seconds = double(perf_now() - start) / double(perf_frequency);
+
+	// number the segments and bucket them by grid cell
+	int segment_count = 0, fix_count = 0;
+	DWORD names_size = 0;
+	for (int k=0; k<index_file_count; k++) {
+		segment_count += index_files[k].segment_count;
+		fix_count += index_files[k].fix_count;
+		names_size += DWORD(strlen(index_files[k].name) + 1);
+	}
+	IndexSegment *segments = new IndexSegment[max(segment_count, 1)];
+	int posting_count = 0, posting_capacity = segment_count * 2 + 16;
+	IndexPosting *postings = new IndexPosting[posting_capacity];
+	int n = 0;
+	for (int k=0; k<index_file_count; k++) {
+		for (int j=0; j<index_files[k].segment_count; j++, n++) {
+			const IndexSegment *s = &index_files[k].segments[j];
+			segments[n] = *s;
+			for (INT32 lat=index_cell(s->min_latitude); lat<=index_cell(s->max_latitude); lat++) {
+				for (INT32 lon=index_cell(s->min_longitude); lon<=index_cell(s->max_longitude); lon++) {
+					if (posting_count==posting_capacity) {
+						posting_capacity *= 2;
+						IndexPosting *grown = new IndexPosting[posting_capacity];
+						memcpy(grown, postings, posting_count * sizeof(IndexPosting));
+						delete[] postings;
+						postings = grown;
+					}
+					IndexPosting p = { lat, lon, DWORD(n) };
+					postings[posting_count++] = p;
+				}
+			}
+		}
+		delete[] index_files[k].segments;
+	}
+	qsort(postings, posting_count, sizeof(IndexPosting), index_posting_compare);
+	IndexCell *cells = new IndexCell[max(posting_count, 1)];
+	DWORD *segment_ids = new DWORD[max(posting_count, 1)];
+	int cell_count = 0;
+	for (int k=0; k<posting_count; k++) {
+		if (cell_count==0 || postings[k].lat_cell!=cells[cell_count-1].lat_cell || postings[k].long_cell!=cells[cell_count-1].long_cell) {
+			IndexCell c = { postings[k].lat_cell, postings[k].long_cell, DWORD(k), 0 };
+			cells[cell_count++] = c;
+		}
+		cells[cell_count-1].count++;
+		segment_ids[k] = postings[k].segment;
+	}
+	delete[] postings;
+
+	// write
+	char fn[2 * MAX_PATH];
+	sprintf_s(fn, sizeof(fn), "%ssim_probe.idx", directory);
+	FILE *f;
+	int result = 0;
+	if (fopen_s(&f, fn, "wb") != 0) {
+		printf("Error: couldn't write index file %s\n", fn);
+		result = 1;
+	} else {
+		IndexHeader h = { {'S','P','I','X'}, INDEX_VERSION, DWORD(index_file_count), DWORD(segment_count),
+						  DWORD(cell_count), DWORD(posting_count), names_size, float(INDEX_CELL) };
+		fwrite(&h, sizeof(h), 1, f);
+		for (int k=0; k<index_file_count; k++) fwrite(index_files[k].name, strlen(index_files[k].name) + 1, 1, f);
+		fwrite(segments, sizeof(IndexSegment), segment_count, f);
+		fwrite(cells, sizeof(IndexCell), cell_count, f);
+		fwrite(segment_ids, sizeof(DWORD), posting_count, f);
+		fclose(f);
+		printf("Indexed %d files, %d fixes, %d segments in %d cells: %.2f seconds on %d threads -> %s\n",
+			   index_file_count, fix_count, segment_count, cell_count, parse_seconds, threads, fn);
+	}
+	delete[] segment_ids;
+	delete[] cells;
+	delete[] segments;
+	delete[] index_files;
+	return result;
+}
+
+// index_in_wind() returns true if direction is in the clockwise range from..to (degrees)
+inline bool index_in_wind(double direction, double from, double to) {
+	if (from<=to) return direction>=from && direction<=to;
+	return direction>=from || direction<=to; // range through north
+}
+
+// query_date() returns the seconds since 1970 UTC at the start of yyyy-mm-dd
+DWORD query_date(const char *s) {
+	struct tm date;
+	memset(&date, 0, sizeof(date));
+	if (sscanf_s(s, "%d-%d-%d", &date.tm_year, &date.tm_mon, &date.tm_mday)!=3) return 0;
+	date.tm_year -= 1900;
+	date.tm_mon -= 1;
+	return DWORD(_mkgmtime(&date));
+}
+
+int run_query(const char *index_file, const char *box, const char *from, const char *to, const char *wind) {
+	double lat1 = -90.0, long1 = -180.0, lat2 = 90.0, long2 = 180.0;
+	if (box[0]!=0 && sscanf_s(box, "%lf,%lf,%lf,%lf", &lat1, &long1, &lat2, &long2)!=4) {
+		printf("Error: box=<lat1>,<long1>,<lat2>,<long2>\n");
+		return 1;
+	}
+	double wind_from = 0.0, wind_to = 360.0;
+	if (wind[0]!=0 && sscanf_s(wind, "%lf,%lf", &wind_from, &wind_to)!=2) {
+		printf("Error: wind=<from>,<to>\n");
+		return 1;
+	}
+	double min_lat = min(lat1, lat2), max_lat = max(lat1, lat2);
+	double min_long = min(long1, long2), max_long = max(long1, long2);
+	DWORD start_time = (from[0]!=0) ? query_date(from) : 0;
+	DWORD end_time = (to[0]!=0) ? query_date(to) + 86400 : 0xFFFFFFFF;
+
+	LONGLONG start = perf_now();
+	FILE *f;
+	if (fopen_s(&f, index_file, "rb") != 0) {
+		printf("Error: couldn't open index file %s\n", index_file);
+		return 1;
+	}
+	IndexHeader h;
+	if (fread(&h, sizeof(h), 1, f)!=1 || memcmp(h.magic, "SPIX", 4)!=0 || h.version!=INDEX_VERSION) {
+		printf("Error: %s is not a sim_probe index\n", index_file);
+		fclose(f);
+		return 1;
+	}
+	char *names = new char[h.names_size + 1];
+	const char **file_name = new const char *[h.file_count + 1];
+	IndexSegment *segments = new IndexSegment[h.segment_count + 1];
+	IndexCell *cells = new IndexCell[h.cell_count + 1];
+	DWORD *segment_ids = new DWORD[h.posting_count + 1];
+	bool ok = fread(names, 1, h.names_size, f)==h.names_size &&
+			  fread(segments, sizeof(IndexSegment), h.segment_count, f)==h.segment_count &&
+			  fread(cells, sizeof(IndexCell), h.cell_count, f)==h.cell_count &&
+			  fread(segment_ids, sizeof(DWORD), h.posting_count, f)==h.posting_count;
+	fclose(f);
+	// the query follows cells to postings to segments to file names without further checks
+	bool valid = ok;
+	for (DWORD k=0; valid && k<h.cell_count; k++) {
+		valid = cells[k].first<=h.posting_count && cells[k].count<=h.posting_count - cells[k].first;
+	}
+	for (DWORD k=0; valid && k<h.posting_count; k++) valid = segment_ids[k]<h.segment_count;
+	for (DWORD k=0; valid && k<h.segment_count; k++) valid = segments[k].file<h.file_count;
+	int matches = 0;
+	if (!ok) {
+		printf("Error: %s is truncated\n", index_file);
+	} else if (!valid) {
+		printf("Error: %s is corrupt\n", index_file);
+	} else {
+		names[h.names_size] = 0;
+		for (DWORD k=0, offset=0; k<h.file_count; k++) {
+			file_name[k] = names + offset;
+			if (offset<h.names_size) offset += DWORD(strlen(names + offset) + 1);
+		}
+		double load_ms = double(perf_now() - start) * 1000.0 / double(perf_frequency);
+		start = perf_now();
+		// cells overlapping the box, found by binary search on the sorted cell table
+		bool *seen = new bool[h.segment_count + 1];
+		memset(seen, 0, h.segment_count + 1);
+		DWORD *hits = new DWORD[h.segment_count + 1];
+		for (INT32 lat=index_cell(min_lat); lat<=index_cell(max_lat); lat++) {
+			int lo = 0, hi = int(h.cell_count);
+			while (lo<hi) {
+				int mid = (lo + hi) / 2;
+				if (cells[mid].lat_cell<lat || (cells[mid].lat_cell==lat && cells[mid].long_cell<index_cell(min_long))) lo = mid + 1;
+				else hi = mid;
+			}
+			for (int c=lo; c<int(h.cell_count) && cells[c].lat_cell==lat && cells[c].long_cell<=index_cell(max_long); c++) {
+				for (DWORD j=0; j<cells[c].count; j++) {
+					DWORD id = segment_ids[cells[c].first + j];
+					if (seen[id]) continue;
+					seen[id] = true;
+					const IndexSegment *s = &segments[id];
+					if (s->max_latitude<min_lat || s->min_latitude>max_lat ||
+						s->max_longitude<min_long || s->min_longitude>max_long) continue;
+					if (s->end_time<start_time || s->start_time>=end_time) continue;
+					if (wind[0]!=0 && (!(s->flags & INDEX_HAS_WIND) || !index_in_wind(s->wind_direction, wind_from, wind_to))) continue;
+					hits[matches++] = id;
+				}
+			}
+		}
+		double query_ms = double(perf_now() - start) * 1000.0 / double(perf_frequency);
+		for (int k=0; k<matches; k++) {
+			const IndexSegment *s = &segments[hits[k]];
+			char when[40];
+			time_t t = s->start_time;
+			struct tm utc;
+			_gmtime64_s(&utc, &t);
+			strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &utc);
+			printf("%s  %s  fixes %d-%d", file_name[s->file], when, s->first_fix, s->first_fix + s->fix_count - 1);
+			if (s->flags & INDEX_HAS_WIND) {
+				printf("  wind %3.0f/%.1f m/s  lift %+.2f m/s", s->wind_direction, s->wind_velocity, s->max_lift);
+			}
+			printf("\n");
+		}
+		printf("%d segments match (index load %.1f ms, query %.2f ms)\n", matches, load_ms, query_ms);
+		delete[] hits;
+		delete[] seen;
+	}
+	delete[] segment_ids;
+	delete[] cells;
+	delete[] segments;
+	delete[] file_name;
+	delete[] names;
+	return valid ? 0 : 1;
+}
+
+// END OF IGC INDEX
+//*********************************************************************************************
+
+int main(int argc, char* argv[])
+{
+	const char *index_dir = ""; // IGC corpus to index
+	int threads = 0; // worker threads, 0 => one per processor
+	const char *query_file = ""; // index to query
+	const char *box = "";
+	const char *from_date = "";
+	const char *to_date = "";
+	const char *wind_range = "";
+	for (int i=1; i<argc; i++) {
+		if (strncmp(argv[i],"index=",6)==0)      index_dir = argv[i]+6;
+		else if (strncmp(argv[i],"threads=",8)==0) threads = atoi(argv[i]+8);
+		else if (strncmp(argv[i],"query=",6)==0) query_file = argv[i]+6;
+		else if (strncmp(argv[i],"box=",4)==0)   box = argv[i]+4;
+		else if (strncmp(argv[i],"from=",5)==0)  from_date = argv[i]+5;
+		else if (strncmp(argv[i],"to=",3)==0)    to_date = argv[i]+3;
+		else if (strncmp(argv[i],"wind=",5)==0)  wind_range = argv[i]+5;
+	}
+	perf_init();
+
+	if (index_dir[0]!=0) return run_index(index_dir, threads);
+	if (query_file[0]!=0) return run_query(query_file, box, from_date, to_date, wind_range);
+	printf("usage: sim_probe_index index=<dir> [threads=<n>] | query=<index> box=<lat1>,<long1>,<lat2>,<long2>\n");
+	return 1;
+}
@@ -0,0 +1,941 @@
+//------------------------------------------------------------------------------
+//
+//  sim_probe_lib.cpp: the lift model, geodesy, terrain and IGC/track file code shared by
+//  sim_probe.exe and the offline tools, see sim_probe_lib.h
+//
+//------------------------------------------------------------------------------
+
+#include "sim_probe_lib.h"
+#include <string.h>
+#include <stdlib.h>
+
+// sim_probe version (sent in client data)
+double version = 3.00;
+
+// 'debug' parameters from command line that control various levels of diagnostic output
+bool debug_info = false; // default 'debug' level - prints out startup, lift, errors
+bool debug = false; // prints out lift factors as sim_probe runs
+
+LONGLONG perf_frequency = 1; // QueryPerformanceFrequency, set by perf_init()
+
+void perf_init() {
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	perf_frequency = frequency.QuadPart;
+}
+
+//*******************************************************************************
+// ELEVATION CACHE
+
+ElevCacheEntry elev_cache[ELEV_CACHE_SIZE];
+ElevPyramidEntry elev_pyramid[ELEV_PYRAMID_LEVELS+1][ELEV_PYRAMID_SIZE]; // [0] unused
+
+// elev_pyramid_add() adds a new cache cell to the cell containing it on each pyramid level,
+// unless that cell's footprint already has it
+void elev_pyramid_add(INT32 lat_cell, INT32 long_cell, double ground_elevation) {
+	for (int level=1; level<=ELEV_PYRAMID_LEVELS; level++) {
+		// floor division by 4 per level (arithmetic shift of the finer cell index)
+		INT32 plat = lat_cell >> (2*level);
+		INT32 plong = long_cell >> (2*level);
+		// the sub-cell of the footprint: the cache cell, or on level 3 the level 1 cell
+		int shift = max(0, 2*level - 4);
+		int bit = ((lat_cell - (plat << (2*level))) >> shift) * ELEV_PYRAMID_FOOTPRINT + ((long_cell - (plong << (2*level))) >> shift);
+		ElevPyramidEntry *p = &elev_pyramid[level][elev_cache_slot(plat, plong) & (ELEV_PYRAMID_SIZE-1)];
+		if (p->count==0 || p->lat_cell!=plat || p->long_cell!=plong) {
+			p->lat_cell = plat;
+			p->long_cell = plong;
+			p->min_elevation = p->max_elevation = p->sum_elevation = ground_elevation;
+			p->count = 1;
+			memset(p->footprint, 0, sizeof(p->footprint));
+			p->footprint[bit >> 5] |= 1u << (bit & 31);
+			continue;
+		}
+		if (p->footprint[bit >> 5] & (1u << (bit & 31))) continue; // already counted
+		p->footprint[bit >> 5] |= 1u << (bit & 31);
+		p->min_elevation = min(p->min_elevation, ground_elevation);
+		p->max_elevation = max(p->max_elevation, ground_elevation);
+		p->sum_elevation += ground_elevation;
+		p->count++;
+	}
+}
+
+// elev_pyramid_get() returns true and the min/mean/max of the pyramid cell at level
+// containing the point, if it has at least ELEV_PYRAMID_MIN_SAMPLES samples
+bool elev_pyramid_get(double latitude, double longitude, int level,
+					  double *min_elevation, double *mean_elevation, double *max_elevation) {
+	INT32 plat = INT32(floor(latitude / ELEV_CACHE_CELL)) >> (2*level);
+	INT32 plong = INT32(floor(longitude / ELEV_CACHE_CELL)) >> (2*level);
+	const ElevPyramidEntry *p = &elev_pyramid[level][elev_cache_slot(plat, plong) & (ELEV_PYRAMID_SIZE-1)];
+	if (p->count<ELEV_PYRAMID_MIN_SAMPLES || p->lat_cell!=plat || p->long_cell!=plong) return false;
+	*min_elevation = p->min_elevation;
+	*mean_elevation = p->sum_elevation / p->count;
+	*max_elevation = p->max_elevation;
+	return true;
+}
+
+// far_probe_level() is the pyramid level for a probe distance meters from the aircraft (the
+// coarsest with cells no bigger than a quarter of the distance), or 0 for a near probe
+int far_probe_level(double distance) {
+	if (fabs(distance) < FAR_PROBE_DISTANCE) return 0;
+	int level = 0;
+	double cell = ELEV_CACHE_CELL * 111000.0; // meters north-south
+	while (level<ELEV_PYRAMID_LEVELS && cell * 4.0 <= fabs(distance) / 4.0) {
+		cell *= 4.0;
+		level++;
+	}
+	return level;
+}
+
+void elev_cache_put(double latitude, double longitude, double ground_elevation) {
+	INT32 lat_cell = INT32(floor(latitude / ELEV_CACHE_CELL));
+	INT32 long_cell = INT32(floor(longitude / ELEV_CACHE_CELL));
+	ElevCacheEntry *e = &elev_cache[elev_cache_slot(lat_cell, long_cell)];
+	// a cache cell goes to the pyramid when it arrives (again, if it was evicted, when the
+	// pyramid footprint skips it)
+	if (!e->valid || e->lat_cell!=lat_cell || e->long_cell!=long_cell) {
+		elev_pyramid_add(lat_cell, long_cell, ground_elevation);
+	}
+	e->lat_cell = lat_cell;
+	e->long_cell = long_cell;
+	e->ground_elevation = ground_elevation;
+	e->valid = true;
+}
+
+// elev_cache_get() returns true and sets *ground_elevation if the cell is in the cache
+bool elev_cache_get(double latitude, double longitude, double *ground_elevation) {
+	INT32 lat_cell = INT32(floor(latitude / ELEV_CACHE_CELL));
+	INT32 long_cell = INT32(floor(longitude / ELEV_CACHE_CELL));
+	ElevCacheEntry *e = &elev_cache[elev_cache_slot(lat_cell, long_cell)];
+	if (!e->valid || e->lat_cell!=lat_cell || e->long_cell!=long_cell) return false;
+	*ground_elevation = e->ground_elevation;
+	return true;
+}
+
+// END OF ELEVATION CACHE
+//*******************************************************************************
+
+// distance_and_bearing(...) returns a new lat/long a distance and bearing from lat1,lon1.
+// lat, longs and bearings in degrees, distance in meters
+MoveStruct distance_and_bearing(double lat1, double long1, double distance, double bearing) {
+	double rlat1, rlong1, rbearing, rdistance, rlat2, rlong2;
+	MoveStruct r;
+	rlat1 = deg2rad(lat1);
+	rlong1 = deg2rad(long1);
+	rdistance = m2rad(distance);
+	rbearing = deg2rad(bearing);
+	rlat2 = asin(sin(rlat1)*cos(rdistance)+cos(rlat1)*sin(rdistance)*cos(rbearing));
+	if (cos(rlat2)==0) {
+        rlong2 = rlong1;      // endpoint a pole
+	}
+	else {
+		rlong2 = fmod((rlong1+asin(sin(rbearing)*sin(rdistance)/cos(rlat2))+M_PI),(2*M_PI))-M_PI;
+	}
+	r.latitude = rad2deg(rlat2);
+	r.longitude = rad2deg(rlong2);
+	return r;
+}
+
+//*******************************************************************************
+// ALONG-WIND HISTORY
+
+INT32 history_reset_count = 0; // full refreshes (history restarted)
+
+// wind_axis() sets *along and *cross, the position of a point in meters upwind along and to
+// the side of the history's wind line
+inline void wind_axis(const AlongWindHistory *h, double latitude, double longitude, double *along, double *cross) {
+	double x = rad2m(deg2rad(longitude - h->origin_longitude) * cos(deg2rad(h->origin_latitude)));
+	double y = rad2m(deg2rad(latitude - h->origin_latitude));
+	double b = deg2rad(h->wind_direction);
+	*along = x * sin(b) + y * cos(b);
+	*cross = x * cos(b) - y * sin(b);
+}
+
+// history_check() restarts the history of an aircraft if the wind has turned or the aircraft
+// is off the wind line, called at the start of each profile
+void history_check(AlongWindHistory *h, const UserStruct *pos) {
+	if (h->count>0) {
+		double turn = fabs(fmod(pos->wind_direction - h->wind_direction + 540.0, 360.0) - 180.0);
+		double along, cross;
+		wind_axis(h, pos->latitude, pos->longitude, &along, &cross);
+		if (turn <= ALONG_WIND_RESET_DEGREES && fabs(cross) <= ALONG_WIND_CROSS_TOLERANCE) return;
+		history_reset_count++;
+	}
+	h->origin_latitude = pos->latitude;
+	h->origin_longitude = pos->longitude;
+	h->wind_direction = pos->wind_direction;
+	h->count = 0;
+}
+
+// history_add() adds a measured elevation to the history if it is on the wind line
+void history_add(AlongWindHistory *h, double latitude, double longitude, double ground_elevation) {
+	double along, cross;
+	wind_axis(h, latitude, longitude, &along, &cross);
+	if (fabs(cross) > ALONG_WIND_CROSS_TOLERANCE) return;
+	// when full, drop the sample furthest downwind (i.e. behind the aircraft)
+	if (h->count==ALONG_WIND_SAMPLES) {
+		if (along <= h->sample[0].along) return;
+		memmove(&h->sample[0], &h->sample[1], (ALONG_WIND_SAMPLES-1) * sizeof(AlongWindSample));
+		h->count--;
+	}
+	int k = h->count;
+	while (k>0 && h->sample[k-1].along > along) {
+		h->sample[k] = h->sample[k-1];
+		k--;
+	}
+	h->sample[k].along = along;
+	h->sample[k].ground_elevation = ground_elevation;
+	h->count++;
+}
+
+// history_get() returns true and the interpolated elevation at a point covered by the history
+bool history_get(const AlongWindHistory *h, double latitude, double longitude, double *ground_elevation) {
+	if (h->count<2) return false;
+	double along, cross;
+	wind_axis(h, latitude, longitude, &along, &cross);
+	if (fabs(cross) > ALONG_WIND_CROSS_TOLERANCE) return false;
+	if (along < h->sample[0].along || along > h->sample[h->count-1].along) return false;
+	// binary search for the first sample at or beyond the point
+	int lo = 0, hi = h->count-1;
+	while (lo<hi) {
+		int mid = (lo + hi) / 2;
+		if (h->sample[mid].along < along) lo = mid+1;
+		else hi = mid;
+	}
+	const AlongWindSample *s1 = &h->sample[lo];
+	const AlongWindSample *s0 = (lo>0) ? &h->sample[lo-1] : s1;
+	double gap = s1->along - s0->along;
+	if (gap > ALONG_WIND_MAX_GAP) return false;
+	if (gap <= 0.0) {
+		*ground_elevation = s1->ground_elevation;
+		return true;
+	}
+	*ground_elevation = s0->ground_elevation + (s1->ground_elevation - s0->ground_elevation) * (along - s0->along) / gap;
+	return true;
+}
+
+// END OF ALONG-WIND HISTORY
+//*******************************************************************************
+
+//*******************************************************************************
+// TERRAIN SNAPSHOTS
+
+bool terrain_load(TerrainGrid *t, const char *filename) {
+	FILE *f;
+	if (fopen_s(&f, filename, "r") != 0) {
+		printf("Error: couldn't open terrain file %s\n", filename);
+		return false;
+	}
+	char key[32];
+	double value;
+	t->nodata = -9999.0;
+	t->ncols = t->nrows = 0;
+	// header lines are 'key value', until the first elevation
+	for (int k=0; k<6; k++) {
+		long pos = ftell(f);
+		if (fscanf_s(f, "%31s %lf", key, (unsigned)sizeof(key), &value) != 2) break;
+		if (_stricmp(key, "ncols")==0) t->ncols = int(value);
+		else if (_stricmp(key, "nrows")==0) t->nrows = int(value);
+		else if (_stricmp(key, "xllcorner")==0 || _stricmp(key, "xllcenter")==0) t->xll = value;
+		else if (_stricmp(key, "yllcorner")==0 || _stricmp(key, "yllcenter")==0) t->yll = value;
+		else if (_stricmp(key, "cellsize")==0) t->cellsize = value;
+		else if (_stricmp(key, "nodata_value")==0) t->nodata = value;
+		else {
+			fseek(f, pos, SEEK_SET);
+			break;
+		}
+	}
+	if (t->ncols<2 || t->nrows<2 || t->cellsize<=0.0) {
+		printf("Error: %s is not an ESRI ASCII grid\n", filename);
+		fclose(f);
+		return false;
+	}
+	t->z = new float[t->ncols * t->nrows];
+	for (int k=0; k<t->ncols * t->nrows; k++) {
+		if (fscanf_s(f, "%lf", &value) != 1) value = t->nodata;
+		t->z[k] = float(value);
+	}
+	fclose(f);
+	return true;
+}
+
+// terrain_elevation() returns true and the bilinear interpolated elevation at lat/long
+bool terrain_elevation(const TerrainGrid *t, double latitude, double longitude, double *elevation) {
+	double x = (longitude - t->xll) / t->cellsize;
+	double y = (t->yll + t->nrows * t->cellsize - latitude) / t->cellsize; // rows from the north
+	int col = int(floor(x));
+	int row = int(floor(y));
+	if (col<0 || row<0 || col>=t->ncols-1 || row>=t->nrows-1) return false;
+	double fx = x - col;
+	double fy = y - row;
+	const float *z = &t->z[row * t->ncols + col];
+	if (z[0]==t->nodata || z[1]==t->nodata || z[t->ncols]==t->nodata || z[t->ncols+1]==t->nodata) return false;
+	*elevation = (z[0] * (1-fx) + z[1] * fx) * (1-fy) + (z[t->ncols] * (1-fx) + z[t->ncols+1] * fx) * fy;
+	return true;
+}
+
+// terrain_synthetic() builds a 0.2 degree square with three north-south bands running east-west:
+// dunes in the south, ridges in the middle and a mountain range in the north
+void terrain_synthetic(TerrainGrid *t) {
+	t->ncols = t->nrows = 1000;
+	t->cellsize = 0.0002; // about 20m
+	t->xll = 0.0;
+	t->yll = 45.0;
+	t->nodata = -9999.0;
+	t->z = new float[t->ncols * t->nrows];
+	for (int row=0; row<t->nrows; row++) {
+		int band = 2 - row * 3 / t->nrows; // row 0 is the northern edge
+		for (int col=0; col<t->ncols; col++) {
+			double x = col * t->cellsize * 78700.0; // meters east at 45N
+			double z;
+			switch (band) {
+			case 0: // dunes 30m high, 800m apart
+				z = 30.0 * pow(sin(x * M_PI / 800.0), 2.0);
+				break;
+			case 1: // ridges 300m high, 4km apart
+				z = 300.0 * pow(sin(x * M_PI / 4000.0), 4.0);
+				break;
+			default: // a 1200m range centred 8km east
+				z = 1200.0 * exp(-pow((x - 8000.0) / 3000.0, 2.0));
+				break;
+			}
+			t->z[row * t->ncols + col] = float(100.0 + z);
+		}
+	}
+	printf("Synthetic terrain: dune, ridge and mountain bands\n");
+}
+
+// END OF TERRAIN SNAPSHOTS
+//*******************************************************************************
+
+//*******************************************************************************
+// RIDGE INDEX
+
+RidgeCell *ridge_cells = NULL;
+DWORD ridge_cell_count = 0; // 0 => no ridge index, every profile is probed
+
+int ridge_cell_compare(const void *a, const void *b) {
+	const RidgeCell *ca = (const RidgeCell *)a;
+	const RidgeCell *cb = (const RidgeCell *)b;
+	if (ca->lat_cell != cb->lat_cell) return (ca->lat_cell < cb->lat_cell) ? -1 : 1;
+	if (ca->long_cell != cb->long_cell) return (ca->long_cell < cb->long_cell) ? -1 : 1;
+	return 0;
+}
+
+// ridge_index_load() reads a ridge index written by 'ridges=', returns false if it can't
+bool ridge_index_load(const char *fn) {
+	FILE *f;
+	if (fopen_s(&f, fn, "rb") != 0) {
+		printf("Error: couldn't open ridge index %s\n", fn);
+		return false;
+	}
+	RidgeIndexHeader h;
+	if (fread(&h, sizeof(h), 1, f)!=1 || strncmp(h.magic, "SPRI", 4)!=0 || h.version!=RIDGE_INDEX_VERSION ||
+		h.cell_size!=float(RIDGE_INDEX_CELL)) {
+		printf("Error: %s is not a sim_probe ridge index\n", fn);
+		fclose(f);
+		return false;
+	}
+	ridge_cells = new RidgeCell[max(h.cell_count, 1)];
+	ridge_cell_count = DWORD(fread(ridge_cells, sizeof(RidgeCell), h.cell_count, f));
+	fclose(f);
+	if (debug_info || debug) printf("Ridge index %s: %d cells\n", fn, ridge_cell_count);
+	return ridge_cell_count==h.cell_count;
+}
+
+// ridge_find() returns the indexed cell, or NULL if the cell isn't in the index
+const RidgeCell *ridge_find(INT32 lat_cell, INT32 long_cell) {
+	RidgeCell key = { lat_cell, long_cell, 0.0f, 0.0f, 0 };
+	return (const RidgeCell *)bsearch(&key, ridge_cells, ridge_cell_count, sizeof(RidgeCell), ridge_cell_compare);
+}
+
+// ridge_near() is true if the wind line through a point, over the span of the probes,
+// crosses an indexed cell.  The points checked are interpolated between the ends of the line,
+// which is straight enough over a few km.
+bool ridge_near(double latitude, double longitude, double wind_direction) {
+	double nearest = 0.0, farthest = 0.0;
+	for (int i=1; i<PROFILE_COUNT; i++) {
+		nearest = min(nearest, profile_distance[i]);
+		farthest = max(farthest, profile_distance[i]);
+	}
+	MoveStruct p0 = distance_and_bearing(latitude, longitude, nearest, wind_direction);
+	MoveStruct p1 = distance_and_bearing(latitude, longitude, farthest, wind_direction);
+	int steps = int(ceil((farthest - nearest) / RIDGE_LINE_STEP));
+	for (int k=0; k<=steps; k++) {
+		double f = steps ? double(k) / steps : 0.0;
+		double lat = p0.latitude + (p1.latitude - p0.latitude) * f;
+		double lon = p0.longitude + (p1.longitude - p0.longitude) * f;
+		if (ridge_find(INT32(floor(lat / RIDGE_INDEX_CELL)), INT32(floor(lon / RIDGE_INDEX_CELL)))) return true;
+	}
+	return false;
+}
+
+// END OF RIDGE INDEX
+//*******************************************************************************
+
+//*******************************************************************************
+// WARM STATE FILE
+
+WarmState warm_state; // buffer for loading and saving
+
+// state_check() returns false if w is not a state file or is from an incompatible build
+bool state_check(const WarmState *w) {
+	return strncmp(w->magic, "SPST", 4)==0 && w->version==WARM_STATE_VERSION &&
+		w->elev_cache_size==ELEV_CACHE_SIZE && w->elev_pyramid_size==ELEV_PYRAMID_SIZE &&
+		w->elev_pyramid_levels==ELEV_PYRAMID_LEVELS && w->along_wind_samples==ALONG_WIND_SAMPLES;
+}
+
+// state_read() reads the state saved by a previous session into *w, returns false if there
+// is none or it doesn't pass state_check()
+bool state_read(const char *fn, WarmState *w) {
+	FILE *f;
+	if (fopen_s(&f, fn, "rb") != 0) {
+		if (debug_info || debug) printf("\nNo saved state in %s, cold start", fn);
+		return false;
+	}
+	bool ok = fread(w, sizeof(*w), 1, f)==1 && state_check(w);
+	fclose(f);
+	if (!ok) printf("\nError: %s is not a sim_probe state file for this version, cold start", fn);
+	else if (debug_info || debug) printf("\nRestored state from %s", fn);
+	return ok;
+}
+
+// state_restore_elevations() installs the elevation cache and terrain pyramid of a WarmState
+void state_restore_elevations(const WarmState *w) {
+	memcpy(elev_cache, w->elev_cache, sizeof(elev_cache));
+	memcpy(elev_pyramid, w->elev_pyramid, sizeof(elev_pyramid));
+}
+
+// END OF WARM STATE FILE
+//*******************************************************************************
+
+//**********************************************************************************
+//******* IGC FILE ROUTINES                                                 ********
+//**********************************************************************************
+
+INT32 igc_record_count = 0; // count of how many 'B' records we've recorded
+
+igc_b igc_pos[IGC_MAX_RECORDS];
+
+// igc_startup is the id and type written into IGC and track files (see sim_probe.cpp for how
+// the add-on publishes it)
+StartupStruct igc_startup;
+
+IgcExtension igc_extensions[IGC_EXTENSION_COUNT] = {
+	{ "FXA", 3 }, { "XLF", 5 }, { "XGE", 5 }, { "WDI", 3 }, { "WVE", 3 }
+	// XP1.. added by igc_extension_init()
+};
+
+char igc_i_record[200]; // "I" NN and SSFFCCC for each extension
+
+void igc_extension_init() {
+	static char probe_codes[PROFILE_COUNT-1][4];
+	for (int i=1; i<PROFILE_COUNT; i++) {
+		sprintf_s(probe_codes[i-1], 4, "XP%d", i);
+		igc_extensions[4+i].code = probe_codes[i-1];
+		igc_extensions[4+i].width = 5;
+	}
+	int column = 36; // first column after the fix
+	int n = sprintf_s(igc_i_record, sizeof(igc_i_record), "I%02d", IGC_EXTENSION_COUNT);
+	for (int k=0; k<IGC_EXTENSION_COUNT; k++) {
+		n += sprintf_s(igc_i_record+n, sizeof(igc_i_record)-n, "%02d%02d%s",
+					   column, column + igc_extensions[k].width - 1, igc_extensions[k].code);
+		column += igc_extensions[k].width;
+	}
+}
+
+// igc_format_b_record() writes the IGC 'B' (fix) record for p into buf, including the newline
+int igc_format_b_record(char *buf, size_t size, const igc_b *p) {
+	int hours = p->zulu_time / 3600;
+	int minutes = (p->zulu_time - hours * 3600 ) / 60;
+	int secs = p->zulu_time % 60;
+	char NS = (p->latitude>0.0) ? 'N' : 'S';
+	char EW = (p->longitude>0.0) ? 'E' : 'W';
+	// lat/long rounded to thousandths of a minute, so a parsed B record formats back unchanged
+	int abs_latitude = int(fabs(p->latitude) * 60000.0 + 0.5);
+	int abs_longitude = int(fabs(p->longitude) * 60000.0 + 0.5);
+	int lat_DD = abs_latitude / 60000;
+	int lat_MM = abs_latitude / 1000 % 60;
+	int lat_mmm = abs_latitude % 1000;
+	int long_DDD = abs_longitude / 60000;
+	int long_MM = abs_longitude / 1000 % 60;
+	int long_mmm = abs_longitude % 1000;
+	int altitude = int(floor(p->altitude + 0.5));
+
+//	return sprintf_s(buf, size, "B %02.2d %02.2d %02.2d %02.2d %02.2d %03.3d %c %03.3d %02.2d %03.3d %c A %05.5d %05.5d 000\n",
+	int n = sprintf_s(buf, size, "B%02.2d%02.2d%02.2d%02.2d%02.2d%03.3d%c%03.3d%02.2d%03.3d%cA%05.5d%05.5d000",
+				    hours, minutes, secs,
+					lat_DD, lat_MM, lat_mmm, NS,
+					long_DDD, long_MM, long_mmm, EW,
+					altitude, altitude);
+	n += sprintf_s(buf+n, size-n, "%+05d%05d%03d%03d",
+				   int(floor(p->lift * 100.0 + 0.5)), int(floor(p->ground_elevation + 0.5)),
+				   int(floor(p->wind_direction + 0.5)) % 360, int(floor(p->wind_velocity * 3.6 + 0.5)));
+	for (int i=0; i<PROFILE_COUNT-1; i++) n += sprintf_s(buf+n, size-n, "%05d", int(floor(p->probe_elevation[i] + 0.5)));
+	n += sprintf_s(buf+n, size-n, "\n");
+	return n;
+}
+
+// igc_field() returns the number in the n characters at s (a leading '-' allowed), or
+// -100000 if they aren't all digits
+int igc_field(const char *s, int n) {
+	int v = 0;
+	bool negative = (s[0]=='-');
+	for (int k = negative ? 1 : 0; k<n; k++) {
+		if (s[k]<'0' || s[k]>'9') return -100000;
+		v = v * 10 + (s[k] - '0');
+	}
+	return negative ? -v : v;
+}
+
+// igc_parse_b_record() reads an IGC 'B' (fix) record of length characters (line needn't be
+// terminated), returns false if line isn't one.
+// B HHMMSS DDMMmmm N DDDMMmmm E V PPPPP GGGGG (fixed columns, no spaces)
+bool igc_parse_b_record(const char *line, size_t length, igc_b *p) {
+	if (length<35 || line[0]!='B') return false;
+	memset(p, 0, sizeof(*p));
+	int hhmmss = igc_field(line+1, 6);
+	int lat_DD = igc_field(line+7, 2), lat_MMmmm = igc_field(line+9, 5);
+	int long_DDD = igc_field(line+15, 3), long_MMmmm = igc_field(line+18, 5);
+	int gps_alt = igc_field(line+30, 5);
+	if (hhmmss<0 || lat_DD<0 || lat_MMmmm<0 || long_DDD<0 || long_MMmmm<0 || gps_alt==-100000) return false;
+	p->zulu_time = (hhmmss / 10000) * 3600 + (hhmmss / 100 % 100) * 60 + hhmmss % 100;
+	p->latitude = lat_DD + lat_MMmmm / 60000.0;
+	if (line[14]=='S') p->latitude = -p->latitude;
+	p->longitude = long_DDD + long_MMmmm / 60000.0;
+	if (line[23]=='W') p->longitude = -p->longitude;
+	p->altitude = gps_alt;
+	return true;
+}
+
+// igc_parse_extensions() reads the XLF.. columns of B record line declared by I record
+// i_record (e.g. from a log written by sim_probe) into p.  Unknown codes are ignored.
+void igc_parse_extensions(const char *i_record, const char *line, size_t length, igc_b *p) {
+	int count = igc_field(i_record+1, 2);
+	for (int k=0; k<count && strlen(i_record)>=size_t(3+7*(k+1)); k++) {
+		const char *e = i_record + 3 + 7 * k;
+		int start = igc_field(e, 2), finish = igc_field(e+2, 2);
+		if (start<1 || finish<start || size_t(finish)>length) continue;
+		int v = igc_field(line+start-1, finish-start+1);
+		if (v==-100000 && line[start-1]=='+') v = igc_field(line+start, finish-start);
+		if (v==-100000) continue;
+		if (strncmp(e+4, "XLF", 3)==0) p->lift = v / 100.0;
+		else if (strncmp(e+4, "XGE", 3)==0) p->ground_elevation = v;
+		else if (strncmp(e+4, "WDI", 3)==0) p->wind_direction = v;
+		else if (strncmp(e+4, "WVE", 3)==0) p->wind_velocity = v / 3.6;
+		else if (strncmp(e+4, "XP", 2)==0 && e[6]>='1' && e[6]<'0'+PROFILE_COUNT) p->probe_elevation[e[6]-'1'] = v;
+	}
+}
+
+// igc_write_header() writes the IGC file header records for aircraft atc_id of type atc_type
+void igc_write_header(FILE *f, const struct tm *date, const char *atc_id, const char *atc_type) {
+	char buf[50];
+	fprintf(f,         "AXXXb21_sim_probe %.2f\n", version); // manufacturer
+	strftime( buf, 50, "HFDTE%d%m%y\n", date );              // date
+	fprintf(f,buf);
+	fprintf(f,         "HFFXA035\n");                        // gps accuracy
+	fprintf(f,         "HFPLTPILOTINCHARGE: not recorded\n");
+	fprintf(f,         "HFCM2CREW2: not recorded\n");
+	fprintf(f,         "HFGTYGLIDERTYPE:%s\n", atc_type);
+	fprintf(f,         "HFGIDGLIDERID:%s\n", atc_id);
+	fprintf(f,         "HFDTM100GPSDATUM: WGS-1984\n");
+	fprintf(f,         "HFRFWFIRMWAREVERSION: %.2f\n", version);
+	fprintf(f,         "HFRHWHARDWAREVERSION: 2008\n");
+	fprintf(f,         "HFFTYFRTYPE: sim_probe by Ian Forster-Lewis\n");
+	fprintf(f,         "HFGPSGPS:Microsoft Flight Simulator\n");
+	fprintf(f,         "HFPRSPRESSALTSENSOR: Microsoft Flight Simulator\n");
+	fprintf(f,         "HFCIDCOMPETITIONID:%s\n", atc_id);
+	fprintf(f,         "HFCCLCOMPETITIONCLASS:Microsoft Flight Simulator\n");
+	fprintf(f,         "%s\n", igc_i_record); // extension record for the columns at end of 'B' recs
+}
+
+// igc_write_igc() writes igc_pos[] as an IGC file fn dated date
+bool igc_write_igc(const char *fn, const struct tm *date) {
+	FILE *f;
+	const int MAXBUF = 1000;
+	char buf[MAXBUF];
+	errno_t err;
+
+	if( (err = fopen_s(&f, fn, "w")) != 0 ) {
+		printf( "\nError: couldn't open log file %s for writing.\n", fn);
+		return false;
+	} else {
+		// ok we've opened the log file - lets write all the data to it
+		igc_write_header(f, date, igc_startup.atc_id, igc_startup.atc_type);
+		// now do the 'B' location records
+		for (INT32 i=0; i<igc_record_count; i++) {
+			igc_format_b_record(buf, MAXBUF, &igc_pos[i]);
+			fputs(buf, f);
+		}
+		fprintf(f,         "G123456789\n");
+
+		fclose(f);
+	}
+	return true;
+}
+
+//**********************************************************************************
+// TRACK LOG
+
+inline INT32 track_round(double v) {
+	return INT32(floor(v + 0.5));
+}
+
+void track_fields(const igc_b *p, INT32 *v) {
+	v[TRACK_TIME] = p->zulu_time;
+	v[TRACK_LATITUDE] = track_round(p->latitude * TRACK_DEGREE);
+	v[TRACK_LONGITUDE] = track_round(p->longitude * TRACK_DEGREE);
+	v[TRACK_ALTITUDE] = track_round(p->altitude * TRACK_DECIMETER);
+	v[TRACK_GROUND] = track_round(p->ground_elevation * TRACK_DECIMETER);
+	v[TRACK_LIFT] = track_round(p->lift * TRACK_CM_PER_SEC);
+	v[TRACK_WIND_VELOCITY] = track_round(p->wind_velocity * TRACK_CM_PER_SEC);
+	v[TRACK_WIND_DIRECTION] = track_round(p->wind_direction * 10.0);
+	for (int i=0; i<PROFILE_COUNT-1; i++) v[TRACK_PROBE+i] = track_round(p->probe_elevation[i] * TRACK_DECIMETER);
+}
+
+inline int track_put_varint(BYTE *buf, UINT32 z) {
+	int n = 0;
+	while (z >= 0x80) {
+		buf[n++] = BYTE(z | 0x80);
+		z >>= 7;
+	}
+	buf[n++] = BYTE(z);
+	return n;
+}
+
+// track_get_varint() reads a varint from *p (advancing it), returns false if the data runs out
+inline bool track_get_varint(const BYTE **p, const BYTE *end, UINT32 *z) {
+	*z = 0;
+	for (int shift=0; ; shift+=7) {
+		if (*p>=end || shift>28) return false;
+		BYTE b = *(*p)++;
+		*z |= UINT32(b & 0x7F) << shift;
+		if ((b & 0x80)==0) return true;
+	}
+}
+
+inline INT32 track_predict(const TrackCoder *c, int k) {
+	if (c->count==0) return 0;
+	if (k<TRACK_LINEAR_FIELDS && c->count>=2) return 2 * c->prev[k] - c->prev2[k];
+	return c->prev[k];
+}
+
+void track_update(TrackCoder *c, const INT32 *v) {
+	for (int k=0; k<TRACK_FIELDS; k++) {
+		c->prev2[k] = c->prev[k];
+		c->prev[k] = v[k];
+	}
+	c->count++;
+}
+
+// track_encode_fix() appends fix p to buf and returns the number of bytes written
+int track_encode_fix(TrackCoder *c, const igc_b *p, BYTE *buf) {
+	INT32 v[TRACK_FIELDS];
+	track_fields(p, v);
+	UINT32 mask = 0;
+	BYTE data[TRACK_FIELDS * 5];
+	int size = 0;
+	for (int k=0; k<TRACK_FIELDS; k++) {
+		INT32 d = v[k] - track_predict(c, k);
+		if (d==0) continue;
+		mask |= 1 << k;
+		size += track_put_varint(data+size, (UINT32(d) << 1) ^ UINT32(d >> 31)); // zig-zag
+	}
+	int n = track_put_varint(buf, mask);
+	memcpy(buf+n, data, size);
+	track_update(c, v);
+	return n + size;
+}
+
+// track_decode_fix() reads a fix of 'fields' fields (TRACK_FIELDS_V1 in a version 1 file) from *p
+// (advancing it), returns false if the data runs out
+bool track_decode_fix(TrackCoder *c, const BYTE **p, const BYTE *end, int fields, igc_b *fix) {
+	UINT32 mask;
+	if (!track_get_varint(p, end, &mask)) return false; // version 1 wrote a mask byte < 0x80
+	INT32 v[TRACK_FIELDS];
+	for (int k=0; k<TRACK_FIELDS; k++) {
+		INT32 d = 0;
+		if (k<fields && (mask & (1 << k))) {
+			UINT32 z;
+			if (!track_get_varint(p, end, &z)) return false;
+			d = INT32(z >> 1) ^ -INT32(z & 1);
+		}
+		v[k] = (k<fields) ? track_predict(c, k) + d : 0;
+	}
+	track_update(c, v);
+	fix->zulu_time = v[TRACK_TIME];
+	fix->latitude = v[TRACK_LATITUDE] / TRACK_DEGREE;
+	fix->longitude = v[TRACK_LONGITUDE] / TRACK_DEGREE;
+	fix->altitude = v[TRACK_ALTITUDE] / TRACK_DECIMETER;
+	fix->ground_elevation = v[TRACK_GROUND] / TRACK_DECIMETER;
+	fix->lift = v[TRACK_LIFT] / TRACK_CM_PER_SEC;
+	fix->wind_velocity = v[TRACK_WIND_VELOCITY] / TRACK_CM_PER_SEC;
+	fix->wind_direction = v[TRACK_WIND_DIRECTION] / 10.0;
+	for (int i=0; i<PROFILE_COUNT-1; i++) fix->probe_elevation[i] = v[TRACK_PROBE+i] / TRACK_DECIMETER;
+	return true;
+}
+
+DWORD adler32(const BYTE *data, size_t size) {
+	DWORD a = 1, b = 0;
+	for (size_t k=0; k<size; k++) {
+		a = (a + data[k]) % 65521;
+		b = (b + a) % 65521;
+	}
+	return (b << 16) | a;
+}
+
+// track_write() writes igc_pos[] as a track file fn dated date
+bool track_write(const char *fn, const struct tm *date) {
+	FILE *f;
+	if (fopen_s(&f, fn, "wb") != 0) {
+		printf("\nError: couldn't open track file %s for writing.\n", fn);
+		return false;
+	}
+	TrackHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, "SPTK", 4);
+	h.version = TRACK_VERSION;
+	h.block_fixes = TRACK_BLOCK_FIXES;
+	h.sim_probe_version = version;
+	strcpy_s(h.atc_id, igc_startup.atc_id);
+	strcpy_s(h.atc_type, igc_startup.atc_type);
+	h.year = WORD(date->tm_year + 1900);
+	h.month = BYTE(date->tm_mon + 1);
+	h.day = BYTE(date->tm_mday);
+	fwrite(&h, sizeof(h), 1, f);
+
+	BYTE block[TRACK_BLOCK_FIXES * TRACK_MAX_FIX_BYTES];
+	for (INT32 first=0; first<igc_record_count; first+=TRACK_BLOCK_FIXES) {
+		TrackCoder c;
+		c.count = 0;
+		int fixes = min(TRACK_BLOCK_FIXES, igc_record_count - first);
+		int size = 0;
+		for (int k=0; k<fixes; k++) size += track_encode_fix(&c, &igc_pos[first+k], block+size);
+		TrackBlockHeader b;
+		memcpy(b.magic, "SPTB", 4);
+		b.fix_count = WORD(fixes);
+		b.size = WORD(size);
+		b.checksum = adler32(block, size);
+		fwrite(&b, sizeof(b), 1, f);
+		fwrite(block, size, 1, f);
+	}
+	fclose(f);
+	return true;
+}
+
+// track_read() loads track file fn into igc_pos[], the header into h; returns false if the file
+// can't be read.  Blocks with a bad checksum are skipped and counted in *bad_blocks.
+bool track_read(const char *fn, TrackHeader *h, int *bad_blocks) {
+	FILE *f;
+	if (fopen_s(&f, fn, "rb") != 0) {
+		printf("Error: couldn't open track file %s\n", fn);
+		return false;
+	}
+	if (fread(h, sizeof(*h), 1, f)!=1 || memcmp(h->magic, "SPTK", 4)!=0 || h->version>TRACK_VERSION) {
+		printf("Error: %s is not a sim_probe track file (or is a newer version)\n", fn);
+		fclose(f);
+		return false;
+	}
+	BYTE block[65536];
+	TrackBlockHeader b;
+	igc_record_count = 0;
+	*bad_blocks = 0;
+	while (fread(&b, sizeof(b), 1, f)==1) {
+		if (memcmp(b.magic, "SPTB", 4)!=0 || fread(block, 1, b.size, f)!=b.size) {
+			(*bad_blocks)++;
+			break; // lost the block boundaries, or a truncated file
+		}
+		if (adler32(block, b.size)!=b.checksum) {
+			(*bad_blocks)++;
+			continue;
+		}
+		TrackCoder c;
+		c.count = 0;
+		const BYTE *p = block;
+		for (int k=0; k<b.fix_count && igc_record_count<IGC_MAX_RECORDS; k++) {
+			int fields = (h->version==1) ? TRACK_FIELDS_V1 : TRACK_FIELDS;
+			if (!track_decode_fix(&c, &p, block+b.size, fields, &igc_pos[igc_record_count])) break;
+			igc_record_count++;
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+// END OF TRACK LOG
+//**********************************************************************************
+
+//**********************************************************************************
+//**********************************************************************************
+//******* NOW WE HAVE THE LIFT CALCULATION FORMULA
+
+double agl_factor(double user_alt, double ground_elevation) {
+	// agl_factor (0..1) is the multiple to apply to base lift to take into
+	// account the user altitude AGL, i.e. the lift drops off with height AGL
+	// agl_factor is linear from zero to BOUNDARY1 (40 meters)
+	// agl_factor is 1 from BOUNDARY1 to BOUNDARY2 (80 meters)
+	// agl_factor decays exponentially from BOUNDARY2 upwards
+	const double ZERO_FACTOR = 0.5; // agl_factor at zero meters AGL
+	const double BOUNDARY1 = 40.0; // agl altitude (meters) where agl_factor=1
+	const double BOUNDARY2 = 130.0; // agl altitude (meters) where agl_factor=1
+
+	return agl_factor_with(user_alt, ground_elevation, ZERO_FACTOR, BOUNDARY1, BOUNDARY2);
+}
+
+double adj_slope(double slope) {
+	double s = sin(atan(5.0 * pow(fabs(slope),1.7)));
+	if (slope<0) { s = -s;}
+	return s;
+}
+
+// ***************************************************************************************
+// HERE IS THE FORMULA THAT CALCULATES THE RIDGE LIFT GIVEN THE PROBE HEIGHTS & WIND ETC.
+// ***************************************************************************************
+// ridge_lift() is the generic version reading profile_distance[] and the weights at run time.
+// The lift actually sent comes from lift_model (see LIFT MODELS below), a copy of this formula
+// specialised at compile time for the selected stencil.
+double ridge_lift(const UserStruct *pos, const double *elevation) {
+	// we have the probe values in elevation[PROFILE_COUNT] (from a ProfileSnapshot);
+	// i.e. ground elevation at probe[i] is elevation[i], elevation[0] is under the aircraft
+	//
+	// probe[i] horizontal distance from user aircraft is profile_distance[i]
+	//
+	// horizontal wind speed is pos->wind_velocity
+	double slope[PROFILE_COUNT-1];
+	double factor[PROFILE_COUNT-1];
+	// after the factors for each slope are calculated, multiply each by a weighting:
+	double weight[PROFILE_COUNT-1] = {0.2, 0.2, 0.5, 0.2};
+	// first set slope[i] to real slope from probe[i] to probe[i+1]
+	// (+ve slope => +ve lift)
+	// the last probe will have slope calculated to user aircraft ground
+	slope[0]= (elevation[0] - elevation[1])/profile_distance[1];
+	slope[1]= (elevation[1] - elevation[2])/(profile_distance[2]-profile_distance[1]);
+	slope[2]= (elevation[2] - elevation[3])/(profile_distance[3]-profile_distance[2]);
+	// the last probe will have slope calculated to user aircraft ground
+	// and profile_distance will be negative
+	slope[3]= (elevation[4] - elevation[0])/(-profile_distance[4]);
+
+	// now update factors to normalise between -1 and 1
+	factor[0] = adj_slope(slope[0]) * weight[0];
+
+	factor[1] = adj_slope(slope[1]) * weight[1];
+
+	factor[2] = 0.0; // factor[2] (upwind distance) is always 0 or negative
+	if (slope[2]<0.0) factor[2] = adj_slope(slope[2]) * weight[2];
+
+	factor[3] = 0.0; // factor[3] (back slope) cannot reduce positive slope[0]
+	if (slope[3]>0.0 || slope[0]<0.0) factor[3] = adj_slope(slope[3]) * weight[3];
+
+	double aircraft_agl_factor = agl_factor(pos->altitude, pos->ground_elevation);
+
+	//debug
+	if (debug) {
+		printf("\n agl_factor = ,%.3f, Factors ,%.3f,%.3f,%.3f,%.3f,",aircraft_agl_factor,factor[0],factor[1],factor[2],factor[3]);
+	}
+	return pos->wind_velocity * (factor[0] + factor[1] + factor[2] + factor[3])  * aircraft_agl_factor;
+}
+
+// profile[] is the array of samples of ground elevation (in meters)
+ProbeStruct profile[PROFILE_COUNT];
+
+// profile_distance is the array of sample distances (in meters) upwind of the user aircraft
+double profile_distance[PROFILE_COUNT] = {0.0, 250.0, 750.0, 2000.0, -100.0 }; //, 5000.0};
+// profile_bearing is the degrees offset relative to wind to apply to the bearing of the probe
+double profile_bearing[PROFILE_COUNT] = {0.0, 0.0, 0.0, 0.0, 0.0}; //, 0.0};
+
+//*****************************************************************************************
+// calc_profile_latlongs() populates profile[i].lat/long for each element of profile
+// around the aircraft at pos
+void calc_profile_latlongs(const UserStruct *pos) {
+	double distance, bearing; // meters, degrees
+	//debug calc wind bearing here
+	// wind_bearing = wind_bearing + 10.0; // test rotation on each call
+    profile[0].latitude = pos->latitude;
+    profile[0].longitude = pos->longitude;
+    for (int i=1; i<PROFILE_COUNT; i++) {
+		distance = profile_distance[i];
+		bearing = pos->wind_direction + profile_bearing[i];
+		MoveStruct p = distance_and_bearing(pos->latitude, pos->longitude, distance, bearing);
+		profile[i].latitude = p.latitude;
+		profile[i].longitude = p.longitude;
+	}
+}
+
+//*********************************************************************************************
+// LIFT MODELS
+
+LiftModelFn lift_model = ridge_lift_kernel<RidgeStencil>; // set by select_stencil()
+const char *stencil_name = "ridge";
+
+// use_stencil<S>() makes S the probe layout and lift model
+template <class S>
+void use_stencil() {
+	for (int i=1; i<PROFILE_COUNT; i++) {
+		profile_distance[i] = S::distance(i);
+		profile_bearing[i] = S::bearing(i);
+	}
+	lift_model = ridge_lift_kernel<S>;
+}
+
+StencilChoice stencils[STENCIL_COUNT] = {
+	{ "ridge", use_stencil<RidgeStencil> },
+	{ "mountain", use_stencil<MountainStencil> },
+	{ "dune", use_stencil<DuneStencil> }
+};
+
+// select_stencil() is called at startup for 'stencil=<name>', returns false if name is unknown
+bool select_stencil(const char *name) {
+	for (int k=0; k<STENCIL_COUNT; k++) {
+		if (strcmp(name, stencils[k].name)==0) {
+			stencils[k].use();
+			stencil_name = stencils[k].name;
+			return true;
+		}
+	}
+	return false;
+}
+
+// END OF LIFT MODELS
+//*********************************************************************************************
+
+//*********************************************************************************************
+// LIFT QUERIES
+
+// query_elevation() looks up the ground elevation at a point, returns false if not covered
+bool query_elevation(const QueryService *q, double latitude, double longitude, double *elevation) {
+	double min_elevation, max_elevation;
+	if (q->terrain && terrain_elevation(q->terrain, latitude, longitude, elevation)) return true;
+	if (elev_cache_get(latitude, longitude, elevation)) return true;
+	return elev_pyramid_get(latitude, longitude, 1, &min_elevation, elevation, &max_elevation);
+}
+
+// query_answer() writes the reply to one query line to reply (QUERY_REPLY_MAX bytes), returns
+// its length
+int query_answer(QueryService *q, const char *line, char *reply, int size) {
+	double latitude, longitude, altitude, direction, velocity;
+	q->query_count++;
+	if (line[0]=='L' && sscanf_s(line+1, "%lf %lf %lf %lf %lf", &latitude, &longitude, &altitude, &direction, &velocity)==5) {
+		UserStruct pos = { latitude, longitude, altitude, 0.0, velocity, direction, 0, 0 };
+		double elevation[PROFILE_COUNT];
+		if (!query_elevation(q, latitude, longitude, &pos.ground_elevation)) return sprintf_s(reply, size, "-\n");
+		calc_profile_latlongs(&pos);
+		elevation[0] = pos.ground_elevation;
+		for (int i=1; i<PROFILE_COUNT; i++) {
+			if (!query_elevation(q, profile[i].latitude, profile[i].longitude, &elevation[i])) return sprintf_s(reply, size, "-\n");
+		}
+		return sprintf_s(reply, size, "%.3f %.1f\n", lift_model(&pos, elevation, NULL), pos.ground_elevation);
+	}
+	if (line[0]=='E' && sscanf_s(line+1, "%lf %lf", &latitude, &longitude)==2) {
+		double elevation;
+		if (!query_elevation(q, latitude, longitude, &elevation)) return sprintf_s(reply, size, "-\n");
+		return sprintf_s(reply, size, "%.1f\n", elevation);
+	}
+	if (line[0]=='S') {
+		double seconds = double(perf_now() - q->start) / double(perf_frequency);
+		return sprintf_s(reply, size, "%d %.3f %.0f\n", q->query_count, seconds, seconds>0.0 ? q->query_count / seconds : 0.0);
+	}
+	q->query_count--;
+	return sprintf_s(reply, size, "? %.40s\n", line);
+}
+
+// END OF LIFT QUERIES
+//*********************************************************************************************
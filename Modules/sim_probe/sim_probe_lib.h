@@ -0,0 +1,609 @@
+//------------------------------------------------------------------------------
+//
+//  sim_probe_lib.h: the lift model, geodesy, terrain and IGC/track file code shared by
+//  sim_probe.exe (the FSX add-on, sim_probe.cpp) and the offline tools:
+//
+//              sim_probe_sweep    parameter sweep, stencil evaluation, ridge extraction
+//              sim_probe_index    IGC corpus index and queries
+//              sim_probe_serve    lift and elevation query service
+//              sim_probe_track    track file export and packing
+//              sim_probe_replay   capture replay and trace decoding
+//
+//              None of this talks to FSX.  Built from sim_probe_lib.cpp.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+// sim_probe version (sent in client data)
+extern double version;
+
+// 'debug' parameters from command line that control various levels of diagnostic output
+extern bool debug_info; // default 'debug' level - prints out startup, lift, errors
+extern bool debug; // prints out lift factors as sim_probe runs
+
+// profile_count is the number of samples in the profile
+const int PROFILE_COUNT = 5;
+
+extern LONGLONG perf_frequency; // QueryPerformanceFrequency, set by perf_init()
+
+inline LONGLONG perf_now() {
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return now.QuadPart;
+}
+
+inline LONGLONG perf_us(LONGLONG ticks) {
+	return ticks * 1000000 / perf_frequency;
+}
+
+// perf_init() sets perf_frequency, called first thing in main()
+void perf_init();
+
+struct ProbeStruct {
+    double ground_elevation;
+    double latitude;
+    double longitude;
+    double altitude; // meters, with 'windfield'
+    double wind_velocity; // m/s, with 'windfield'
+    double wind_direction; // degrees, with 'windfield'
+};
+
+struct UserStruct {
+    double latitude;
+    double longitude;
+    double altitude; // meters
+    double ground_elevation;
+    double wind_velocity; // m/s
+    double wind_direction; // degrees
+	INT32  sim_on_ground;
+	INT32  zulu_time; // seconds
+};
+
+struct MoveStruct {
+    double latitude;
+    double longitude;
+	double altitude;
+};
+
+struct StartupStruct {
+	char atc_id[32];
+	char atc_type[32];
+	INT32 start_time;
+};
+
+//*******************************************************************************
+// ELEVATION CACHE
+// every ground elevation returned by a probe is stored in a direct-mapped cache keyed
+// on a lat/long grid cell, so a probe that misses its deadline can be answered from a
+// previous visit to the same spot.
+//
+// Above the cache is a terrain pyramid: ELEV_PYRAMID_LEVELS coarser grids, each cell 4x the
+// size of the level below, holding the min/mean/max of the distinct cache cells seen inside
+// it (on level 3, of the distinct level 1 cells).  A footprint bitmap in each pyramid cell
+// keeps a cache cell that was evicted and put again from being counted twice.  A far probe
+// (see far_probe_level()) only needs the general lie of the land, so once its footprint cell
+// at the matching level has enough samples it is answered from the pyramid instead of being
+// moved.
+
+const int ELEV_CACHE_SIZE = 4096; // number of cache slots (must be a power of 2)
+const double ELEV_CACHE_CELL = 0.001; // grid cell size in degrees (about 110m north-south)
+
+struct ElevCacheEntry {
+	INT32 lat_cell;
+	INT32 long_cell;
+	double ground_elevation;
+	bool valid;
+};
+
+extern ElevCacheEntry elev_cache[ELEV_CACHE_SIZE];
+
+const int ELEV_PYRAMID_LEVELS = 3; // levels 1..3: cells of 0.004, 0.016 and 0.064 degrees
+const int ELEV_PYRAMID_SIZE = 1024; // slots per level (must be a power of 2)
+const INT32 ELEV_PYRAMID_MIN_SAMPLES = 4; // distinct cache cells before a pyramid cell is used
+const int ELEV_PYRAMID_FOOTPRINT = 16; // footprint bitmap of 16x16 sub-cells per pyramid cell
+const double FAR_PROBE_DISTANCE = 1500.0; // meters, probes this far out may use the pyramid
+
+struct ElevPyramidEntry {
+	INT32 lat_cell;
+	INT32 long_cell;
+	double min_elevation;
+	double max_elevation;
+	double sum_elevation;
+	INT32 count; // distinct footprint sub-cells added, 0 => slot empty
+	UINT32 footprint[ELEV_PYRAMID_FOOTPRINT * ELEV_PYRAMID_FOOTPRINT / 32]; // sub-cells added
+};
+
+extern ElevPyramidEntry elev_pyramid[ELEV_PYRAMID_LEVELS+1][ELEV_PYRAMID_SIZE]; // [0] unused
+
+inline int elev_cache_slot(INT32 lat_cell, INT32 long_cell) {
+	return (int)((UINT32)(lat_cell * 73856093) ^ (UINT32)(long_cell * 19349663)) & (ELEV_CACHE_SIZE-1);
+}
+
+void elev_pyramid_add(INT32 lat_cell, INT32 long_cell, double ground_elevation);
+bool elev_pyramid_get(double latitude, double longitude, int level,
+					  double *min_elevation, double *mean_elevation, double *max_elevation);
+int far_probe_level(double distance);
+void elev_cache_put(double latitude, double longitude, double ground_elevation);
+bool elev_cache_get(double latitude, double longitude, double *ground_elevation);
+
+// END OF ELEVATION CACHE
+//*******************************************************************************
+
+const double M_PI = 4.0*atan(1.0); // pi
+const double EARTH_RAD = 6366710.0; // earth's radius in meters
+
+//**********************************************************************************
+// now we have a number of functions to do lat/long calculations to work
+// out the lat/long needed for each probe.
+
+// convert radians at the center of the earth to meters on the surface
+inline double rad2m(double rad)
+{
+    return EARTH_RAD * rad;
+}
+
+// convert metres on earths surface to radians subtended at the centre
+inline double m2rad(double distance)
+{
+    return distance / EARTH_RAD;
+}
+
+// convert degrees to radians
+inline double deg2rad(double deg)
+{
+    return deg * (M_PI / 180.0);
+}
+
+// convert radians to degrees
+
+inline double rad2deg(double rad)
+{
+    return rad * (180.0 / M_PI);
+}
+
+// approx_distance(...) returns the distance in meters between two nearby lat/longs (degrees),
+// using a flat-earth approximation which is fine over a few kilometers
+inline double approx_distance(double lat1, double long1, double lat2, double long2) {
+	double x = deg2rad(long2 - long1) * cos(deg2rad((lat1 + lat2) / 2.0));
+	double y = deg2rad(lat2 - lat1);
+	return rad2m(sqrt(x*x + y*y));
+}
+
+// distance_and_bearing(...) returns a new lat/long a distance and bearing from lat1,lon1.
+// lat, longs and bearings in degrees, distance in meters
+MoveStruct distance_and_bearing(double lat1, double long1, double distance, double bearing);
+
+//*******************************************************************************
+// ALONG-WIND HISTORY
+// flying into wind, the points probed a second ago are still on the upwind line, just closer.
+// Each aircraft keeps the elevations measured near its wind line, sorted by distance along
+// the line from an origin fixed when the history was started.  A profile point between two
+// history samples no more than ALONG_WIND_MAX_GAP apart is interpolated instead of probed, so
+// in steady flight only the leading edge (the far probe) has to move.  The history restarts
+// when the wind turns by more than ALONG_WIND_RESET_DEGREES or the aircraft drifts more than
+// ALONG_WIND_CROSS_TOLERANCE off the line.
+
+const int ALONG_WIND_SAMPLES = 128; // samples kept per aircraft
+const double ALONG_WIND_MAX_GAP = 60.0; // meters, max spacing of samples to interpolate between
+const double ALONG_WIND_CROSS_TOLERANCE = 40.0; // meters off the wind line
+const double ALONG_WIND_RESET_DEGREES = 10.0;
+
+struct AlongWindSample {
+	double along; // meters upwind of the origin
+	double ground_elevation;
+};
+
+struct AlongWindHistory {
+	double origin_latitude;
+	double origin_longitude;
+	double wind_direction; // degrees, the wind line runs upwind from the origin on this bearing
+	int count; // 0 => no history
+	AlongWindSample sample[ALONG_WIND_SAMPLES]; // sorted by along
+};
+
+extern INT32 history_reset_count; // full refreshes (history restarted)
+
+void history_check(AlongWindHistory *h, const UserStruct *pos);
+void history_add(AlongWindHistory *h, double latitude, double longitude, double ground_elevation);
+bool history_get(const AlongWindHistory *h, double latitude, double longitude, double *ground_elevation);
+
+// END OF ALONG-WIND HISTORY
+//*******************************************************************************
+
+//*******************************************************************************
+// TERRAIN SNAPSHOTS
+// the offline tools read the ground from a terrain snapshot instead of probes: an ESRI ASCII
+// grid in degrees (e.g. exported from SRTM) loaded by terrain_load(), or the synthetic dune,
+// ridge and mountain bands of terrain_synthetic().
+
+struct TerrainGrid {
+	int ncols;
+	int nrows;
+	double xll; // longitude of the lower left corner
+	double yll; // latitude of the lower left corner
+	double cellsize; // degrees
+	double nodata;
+	float *z; // nrows x ncols, row 0 is the northern edge
+};
+
+bool terrain_load(TerrainGrid *t, const char *filename);
+bool terrain_elevation(const TerrainGrid *t, double latitude, double longitude, double *elevation);
+void terrain_synthetic(TerrainGrid *t);
+
+// END OF TERRAIN SNAPSHOTS
+//*******************************************************************************
+
+//*******************************************************************************
+// RIDGE INDEX
+// most of the ground under a glider is too flat to give any ridge lift, so moving the probes
+// there only measures slopes of next to nothing.  "sim_probe_sweep ridges=<terrain.asc>" writes
+// the grid cells of a terrain snapshot holding a steep face or a ridgeline to a ridge index
+// file, a table of cells sorted on lat/long.  With 'ridgeindex=<file>' the wind line of each
+// profile, from the back probe to the far probe, is checked against the index: if it crosses
+// no indexed cell the probes stay where they are and the profile is taken as flat (so the lift
+// is zero), and while the user aircraft is near a ridge its position is asked for every
+// RIDGE_FAST_INTERVAL_MS between the once a second subscription replies.
+
+const DWORD RIDGE_INDEX_VERSION = 1;
+const double RIDGE_INDEX_CELL = 0.002; // grid cell size in degrees (about 220m north-south)
+const double RIDGE_LINE_STEP = 100.0; // meters between the points checked along the wind line
+const DWORD RIDGE_FAST_INTERVAL_MS = 500; // user sample interval near a ridge
+
+enum RIDGE_FLAG {
+	RIDGE_FACE = 1, // the cell has a slope of at least RIDGE_MIN_SLOPE
+	RIDGE_CREST = 2 // the cell's high point is above the cells either side of it
+};
+
+// header at the start of a ridge index file, followed by the cells
+struct RidgeIndexHeader {
+	char magic[4]; // "SPRI"
+	DWORD version;
+	DWORD cell_count;
+	float cell_size; // degrees
+	float min_slope; // extraction thresholds
+	float min_relief; // meters
+};
+
+struct RidgeCell {
+	INT32 lat_cell;
+	INT32 long_cell;
+	float slope; // steepest slope in the cell (rise over run)
+	float relief; // meters, highest minus lowest ground in the cell and its neighbours
+	DWORD flags; // RIDGE_FLAG bits
+};
+
+extern RidgeCell *ridge_cells;
+extern DWORD ridge_cell_count; // 0 => no ridge index, every profile is probed
+
+int ridge_cell_compare(const void *a, const void *b);
+bool ridge_index_load(const char *fn);
+const RidgeCell *ridge_find(INT32 lat_cell, INT32 long_cell);
+bool ridge_near(double latitude, double longitude, double wind_direction);
+
+// END OF RIDGE INDEX
+//*******************************************************************************
+
+//*******************************************************************************
+// WARM STATE FILE
+// 'state=<file>' (see WARM START in sim_probe.cpp) saves the elevation cache, terrain pyramid
+// and along-wind history of the user aircraft at quit, for the next session.  The query
+// service reads the elevations from the same file.
+
+const DWORD WARM_STATE_VERSION = 2;
+
+// the state file is this struct as it is in memory; the sizes in the header have to match
+struct WarmState {
+	char magic[4]; // "SPST"
+	DWORD version;
+	DWORD elev_cache_size;
+	DWORD elev_pyramid_size;
+	DWORD elev_pyramid_levels;
+	DWORD along_wind_samples;
+	double wind_direction; // last wind of the previous session
+	double wind_velocity;
+	ElevCacheEntry elev_cache[ELEV_CACHE_SIZE];
+	ElevPyramidEntry elev_pyramid[ELEV_PYRAMID_LEVELS+1][ELEV_PYRAMID_SIZE];
+	AlongWindHistory wind_history; // of the user aircraft
+};
+
+extern WarmState warm_state; // buffer for loading and saving
+
+bool state_check(const WarmState *w);
+bool state_read(const char *fn, WarmState *w);
+void state_restore_elevations(const WarmState *w);
+
+// END OF WARM STATE FILE
+//*******************************************************************************
+
+//*******************************************************************
+// igc file vars
+//*******************************************************************
+const int IGC_TICK_COUNT = 4; // log every 4 seconds (of zulu time)
+const INT32 IGC_MAX_RECORDS = 20000; // log a maximum of this many 'B' records.
+const INT32 IGC_MIN_RECORDS = 20; // don't record an IGC file if it is shorter than 20 B records long
+const INT32 IGC_MIN_FLIGHT_SECS_TO_LANDING = 80; // don't trigger a log save on landing unless
+                                                 // airborne for at least 80 seconds
+
+extern INT32 igc_record_count;
+
+struct igc_b {
+	INT32 zulu_time;
+	double latitude;
+	double longitude;
+	double altitude;
+	double ground_elevation; // meters
+	double lift; // m/s
+	double wind_velocity; // m/s
+	double wind_direction; // degrees
+	double probe_elevation[PROFILE_COUNT-1]; // ground elevation at probe[1..], meters
+};
+
+extern igc_b igc_pos[IGC_MAX_RECORDS];
+
+// igc_startup is the id and type written into IGC and track files, read by whoever owns the
+// IGC log
+extern StartupStruct igc_startup;
+
+// extension columns after the 35 byte fix, declared by the I record igc_write_igc() writes:
+// FXA gps accuracy, XLF ridge lift (cm/s), XGE ground elevation (m), WDI wind direction
+// (degrees), WVE wind velocity (km/h) and XP1.. ground elevation at each probe (m)
+const int IGC_EXTENSION_COUNT = 5 + PROFILE_COUNT - 1;
+
+struct IgcExtension {
+	const char *code;
+	int width;
+};
+
+extern IgcExtension igc_extensions[IGC_EXTENSION_COUNT];
+extern char igc_i_record[200]; // "I" NN and SSFFCCC for each extension
+
+void igc_extension_init();
+int igc_format_b_record(char *buf, size_t size, const igc_b *p);
+int igc_field(const char *s, int n);
+bool igc_parse_b_record(const char *line, size_t length, igc_b *p);
+void igc_parse_extensions(const char *i_record, const char *line, size_t length, igc_b *p);
+void igc_write_header(FILE *f, const struct tm *date, const char *atc_id, const char *atc_type);
+bool igc_write_igc(const char *fn, const struct tm *date);
+
+//**********************************************************************************
+// TRACK LOG
+// 'track' on the command line makes the logger write a binary track (.spt) instead of the IGC
+// file, a few bytes per fix instead of a 36 byte B record and no text formatting.  Each fix
+// holds the time, position, altitude, ground elevation and lift in fixed point.  The fixes are
+// packed in blocks of up to TRACK_BLOCK_FIXES with an Adler-32 checksum, so a damaged block
+// only loses its own fixes.  Within a block each field is stored as a zig-zag varint of its
+// difference from a prediction: extrapolated from the previous two fixes for time, position
+// and altitude, the previous fix for ground elevation and lift.  A mask byte per fix flags
+// the non-zero differences.
+// "sim_probe_track export=<file.spt>" converts a track to IGC, "pack=<file.igc>" the other way.
+//**********************************************************************************
+
+const WORD TRACK_VERSION = 2; // 2 adds the wind and probe elevations
+const int TRACK_BLOCK_FIXES = 256;
+const double TRACK_DEGREE = 600000.0; // position units per degree (0.0001 minute, about 0.2m)
+const double TRACK_DECIMETER = 10.0; // altitude and ground elevation units per meter
+const double TRACK_CM_PER_SEC = 100.0; // lift units per m/s
+
+struct TrackHeader {
+	char magic[4]; // "SPTK"
+	WORD version;
+	WORD block_fixes;
+	double sim_probe_version;
+	char atc_id[32];
+	char atc_type[32];
+	WORD year;
+	BYTE month; // 1..12
+	BYTE day;
+	DWORD reserved;
+};
+
+struct TrackBlockHeader {
+	char magic[4]; // "SPTB"
+	WORD fix_count;
+	WORD size; // bytes of fix data following the header
+	DWORD checksum; // Adler-32 of the fix data
+};
+
+enum TRACK_FIELD {
+	TRACK_TIME,
+	TRACK_LATITUDE,
+	TRACK_LONGITUDE,
+	TRACK_ALTITUDE, // fields above are extrapolated from the previous two fixes
+	TRACK_GROUND,
+	TRACK_LIFT,
+	TRACK_WIND_VELOCITY, // fields from here on are new in version 2
+	TRACK_WIND_DIRECTION,
+	TRACK_PROBE, // ground elevation at probe[1..]
+	TRACK_FIELDS = TRACK_PROBE + PROFILE_COUNT - 1
+};
+const int TRACK_FIELDS_V1 = TRACK_WIND_VELOCITY;
+const int TRACK_LINEAR_FIELDS = TRACK_GROUND;
+const int TRACK_MAX_FIX_BYTES = (TRACK_FIELDS + 1) * 5; // mask + a varint per field
+
+// prediction state, reset at the start of each block
+struct TrackCoder {
+	INT32 prev[TRACK_FIELDS];
+	INT32 prev2[TRACK_FIELDS];
+	int count;
+};
+
+int track_encode_fix(TrackCoder *c, const igc_b *p, BYTE *buf);
+bool track_decode_fix(TrackCoder *c, const BYTE **p, const BYTE *end, int fields, igc_b *fix);
+DWORD adler32(const BYTE *data, size_t size);
+bool track_write(const char *fn, const struct tm *date);
+bool track_read(const char *fn, TrackHeader *h, int *bad_blocks);
+
+// END OF TRACK LOG
+//**********************************************************************************
+
+//**********************************************************************************
+//**********************************************************************************
+//******* NOW WE HAVE THE LIFT CALCULATION FORMULA
+
+// agl_factor_with() is agl_factor() with the boundaries as parameters (for the parameter sweep)
+inline double agl_factor_with(double user_alt, double ground_elevation,
+							  double zero_factor, double boundary1, double boundary2) {
+	double agl_alt = max(user_alt - ground_elevation,0.0);
+
+	if (agl_alt<boundary1) { return zero_factor + (1-zero_factor)*agl_alt/boundary1; }
+	else if (agl_alt<boundary2) { return 1.0; }
+	return exp(-(2+2*ground_elevation/4000)*(agl_alt-boundary2)/max(ground_elevation, 200));
+}
+double agl_factor(double user_alt, double ground_elevation);
+double adj_slope(double slope);
+
+// ***************************************************************************************
+// HERE IS THE FORMULA THAT CALCULATES THE RIDGE LIFT GIVEN THE PROBE HEIGHTS & WIND ETC.
+// ***************************************************************************************
+// ridge_lift() is the generic version reading profile_distance[] and the weights at run time.
+// The lift actually sent comes from lift_model (see LIFT MODELS below), a copy of this formula
+// specialised at compile time for the selected stencil.
+double ridge_lift(const UserStruct *pos, const double *elevation);
+
+// profile[] is the array of samples of ground elevation (in meters), each set by move_probe(i)
+// in sim_probe.cpp, and the lat/longs by calc_profile_latlongs()
+extern ProbeStruct profile[PROFILE_COUNT];
+
+// profile_distance is the array of sample distances (in meters) upwind of the user aircraft
+extern double profile_distance[PROFILE_COUNT];
+// profile_bearing is the degrees offset relative to wind to apply to the bearing of the probe
+extern double profile_bearing[PROFILE_COUNT];
+
+void calc_profile_latlongs(const UserStruct *pos);
+
+//*********************************************************************************************
+// LIFT MODELS
+// a stencil is the probe layout (distance upwind and bearing offset from the wind of each
+// probe), the weight of each slope and the clamp rules for the upwind and back slopes.  The
+// lift formula is a template on the stencil, so each stencil gets its own kernel with the
+// distances, reciprocals and weights folded to constants and the clamp rules resolved at
+// compile time.  The stencil is chosen at startup with 'stencil=' on the command line.
+
+// ridge: the original sim_probe layout, for ridges of a few hundred meters
+struct RidgeStencil {
+	static double distance(int i) {
+		switch (i) { case 1: return 250.0; case 2: return 750.0; case 3: return 2000.0; case 4: return -100.0; }
+		return 0.0;
+	}
+	static double bearing(int) { return 0.0; }
+	static double weight(int k) {
+		switch (k) { case 0: return 0.2; case 1: return 0.2; case 2: return 0.5; }
+		return 0.2;
+	}
+	enum {
+		UPWIND_SINK_ONLY = 1, // slope 2 (far upwind) can only reduce the lift
+		BACK_SLOPE_CLAMP = 1  // slope 3 (behind) can't reduce the lift of a positive slope 0
+	};
+};
+
+// mountain: probes further out with more weight on the main slope, for large massifs
+struct MountainStencil {
+	static double distance(int i) {
+		switch (i) { case 1: return 400.0; case 2: return 1500.0; case 3: return 4000.0; case 4: return -200.0; }
+		return 0.0;
+	}
+	static double bearing(int) { return 0.0; }
+	static double weight(int k) {
+		switch (k) { case 0: return 0.15; case 1: return 0.3; case 2: return 0.4; }
+		return 0.2;
+	}
+	enum { UPWIND_SINK_ONLY = 1, BACK_SLOPE_CLAMP = 1 };
+};
+
+// dune: short stencil for coastal dunes and low escarpments, the face slope dominates
+struct DuneStencil {
+	static double distance(int i) {
+		switch (i) { case 1: return 60.0; case 2: return 150.0; case 3: return 400.0; case 4: return -30.0; }
+		return 0.0;
+	}
+	static double bearing(int) { return 0.0; }
+	static double weight(int k) {
+		switch (k) { case 0: return 0.4; case 1: return 0.25; case 2: return 0.25; }
+		return 0.1;
+	}
+	enum { UPWIND_SINK_ONLY = 1, BACK_SLOPE_CLAMP = 0 };
+};
+
+// elevation[i] is the ground elevation at profile point i, and wind[i] (if not NULL, see WIND
+// FIELD in sim_probe.cpp) the wind component along the profile line there; each slope uses the
+// mean wind of its two ends, otherwise they all use the aircraft's wind
+template <class S>
+double ridge_lift_kernel(const UserStruct *pos, const double *elevation, const double *wind) {
+	// reciprocals of the slope baselines, constants once S is known
+	const double r0 = 1.0 / S::distance(1);
+	const double r1 = 1.0 / (S::distance(2) - S::distance(1));
+	const double r2 = 1.0 / (S::distance(3) - S::distance(2));
+	const double r3 = 1.0 / (-S::distance(4));
+
+	double slope0 = (elevation[0] - elevation[1]) * r0;
+	double slope1 = (elevation[1] - elevation[2]) * r1;
+	double slope2 = (elevation[2] - elevation[3]) * r2;
+	double slope3 = (elevation[4] - elevation[0]) * r3;
+
+	double factor0 = adj_slope(slope0) * S::weight(0);
+	double factor1 = adj_slope(slope1) * S::weight(1);
+	double factor2 = 0.0;
+	if (!S::UPWIND_SINK_ONLY || slope2<0.0) factor2 = adj_slope(slope2) * S::weight(2);
+	double factor3 = 0.0;
+	if (!S::BACK_SLOPE_CLAMP || slope3>0.0 || slope0<0.0) factor3 = adj_slope(slope3) * S::weight(3);
+
+	double wind0 = pos->wind_velocity, wind1 = wind0, wind2 = wind0, wind3 = wind0;
+	if (wind) {
+		wind0 = 0.5 * (wind[0] + wind[1]);
+		wind1 = 0.5 * (wind[1] + wind[2]);
+		wind2 = 0.5 * (wind[2] + wind[3]);
+		wind3 = 0.5 * (wind[4] + wind[0]);
+	}
+
+	double aircraft_agl_factor = agl_factor(pos->altitude, pos->ground_elevation);
+
+	//debug
+	if (debug) {
+		printf("\n agl_factor = ,%.3f, Factors ,%.3f,%.3f,%.3f,%.3f,",aircraft_agl_factor,factor0,factor1,factor2,factor3);
+	}
+	return (wind0 * factor0 + wind1 * factor1 + wind2 * factor2 + wind3 * factor3) * aircraft_agl_factor;
+}
+
+typedef double (*LiftModelFn)(const UserStruct *pos, const double *elevation, const double *wind);
+
+extern LiftModelFn lift_model; // set by select_stencil()
+extern const char *stencil_name;
+
+struct StencilChoice {
+	const char *name;
+	void (*use)();
+};
+
+const int STENCIL_COUNT = 3;
+extern StencilChoice stencils[STENCIL_COUNT];
+
+bool select_stencil(const char *name);
+
+// END OF LIFT MODELS
+//*********************************************************************************************
+
+//*********************************************************************************************
+// LIFT QUERIES
+// query_answer() answers one line of the query service protocol (see sim_probe_serve.cpp):
+// elevations come from the terrain snapshot, then from the elevation cache and terrain pyramid,
+// and the lift from calc_profile_latlongs() + lift_model(), i.e. what sim_probe would send at
+// that point with the stencil chosen by stencil=.
+
+const int QUERY_REPLY_MAX = 1024; // longest reply to one line (two %.3f doubles fit)
+
+struct QueryService {
+	const TerrainGrid *terrain; // NULL => elevation cache only
+	INT32 query_count; // all clients
+	LONGLONG start;
+};
+
+bool query_elevation(const QueryService *q, double latitude, double longitude, double *elevation);
+int query_answer(QueryService *q, const char *line, char *reply, int size);
+
+// END OF LIFT QUERIES
+//*********************************************************************************************
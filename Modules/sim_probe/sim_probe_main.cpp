@@ -0,0 +1,84 @@
+//------------------------------------------------------------------------------
+//
+//  sim_probe_main.cpp: main() of sim_probe.exe, the FSX add-on (see sim_probe.cpp)
+//
+//  Command line:
+//              debug, info, calls, events, trace=<file>   diagnostic output
+//              record=<file>   capture the SimConnect messages and calls (see CAPTURE)
+//              model=<title> stencil=<name> log=<dir> track multi stats recorder windfield
+//              surfacefit state=<file> ridgeindex=<file> radius=<meters>
+//
+//              The offline modes are separate programs built from sim_probe_lib.cpp:
+//              sim_probe_sweep, sim_probe_index, sim_probe_serve, sim_probe_track and
+//              sim_probe_replay.
+//------------------------------------------------------------------------------
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_probe.h"
+
+//int __cdecl _tmain(int argc, _TCHAR* argv[])
+int main(int argc, char* argv[])
+{
+	const char *record_file = ""; // capture the SimConnect messages and calls to this file
+	const char *ridge_index_file = "";
+	// set up command line arguments (debug mode)
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i],"debug")==0) {
+			debug = true;
+			debug_info = false;
+		}
+		else if (strcmp(argv[i],"info")==0)      debug_info = true; // will open console window
+		else if (strcmp(argv[i],"calls")==0 || strcmp(argv[i],"events")==0) {
+			tracing = true;
+			trace_console = true;
+		}
+		else if (strncmp(argv[i],"trace=",6)==0) {
+			tracing = true;
+			trace_file = argv[i]+6;
+		}
+		else if (strncmp(argv[i],"record=",7)==0) record_file = argv[i]+7;
+		else if (strncmp(argv[i],"model=",6)==0) probe_model = argv[i]+6;
+		else if (strncmp(argv[i],"stencil=",8)==0) {
+			if (!select_stencil(argv[i]+8)) printf("Unknown stencil %s, using ridge\n", argv[i]+8);
+		}
+		else if (strncmp(argv[i],"log=",4)==0)   igc_log_directory = argv[i]+4;
+		else if (strcmp(argv[i],"track")==0)     track_log = true;
+		else if (strcmp(argv[i],"multi")==0)     multi_aircraft = true;
+		else if (strcmp(argv[i],"stats")==0)     flight_stats = true;
+		else if (strcmp(argv[i],"recorder")==0)  flight_recorder = true;
+		else if (strcmp(argv[i],"windfield")==0) wind_field = true;
+		else if (strcmp(argv[i],"surfacefit")==0) surface_fit = true;
+		else if (strncmp(argv[i],"state=",6)==0) state_file = argv[i]+6;
+		else if (strncmp(argv[i],"ridgeindex=",11)==0) ridge_index_file = argv[i]+11;
+		else if (strncmp(argv[i],"radius=",7)==0) aircraft_radius = atof(argv[i]+7);
+		if (debug) printf("Command line argument %d is %s\n",i,argv[i]);
+	}
+	perf_init();
+	igc_extension_init();
+
+	if (ridge_index_file[0]!=0 && !ridge_index_load(ridge_index_file)) return 1;
+	if (!debug && !debug_info && !trace_console) FreeConsole(); // kill console unless requested
+
+	if (debug) {
+		printf("Starting sim_probe version %.2f in debug mode\n", version);
+		printf("IGC logs folder '%s'\n", igc_log_directory);
+	}
+	if (debug || ( debug_info && (strcmp(probe_model,"SimProbe")!=0))) {
+		printf("The probe AI Object model is %s\n",probe_model);
+	}
+
+	if (record_file[0]!=0) capture_open(record_file);
+
+	// the restored state goes into the capture too, so the replay starts from it
+	if (state_file[0]!=0 && state_load(state_file) && capture_file) {
+		capture_write(CAPTURE_STATE, &warm_state, sizeof(warm_state));
+	}
+
+    connectToSim();
+	if (capture_file) fclose(capture_file);
+    return 0;
+}
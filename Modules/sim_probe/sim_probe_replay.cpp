@@ -0,0 +1,214 @@
+//------------------------------------------------------------------------------
+//
+//  sim_probe_replay: feeds a capture written by "sim_probe record=<file>" back through the
+//  add-on (sim_probe.cpp) with no FSX connection, and decodes trace dump files
+//
+//  Command line:
+//              replay=<file> [fast] [ridgeindex=<file>]   replay a capture
+//              decode=<file> [json=<file>]                 decode a trace dump
+//              debug, info, calls, events, trace=<file>    as for sim_probe
+//------------------------------------------------------------------------------
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_probe.h"
+
+// trace_decode() is the offline decoder for a trace dump file ('decode=<file>')
+int trace_decode(const char *filename, const char *json_filename) {
+	FILE *f;
+	TraceHeader h;
+	if (fopen_s(&f, filename, "rb") != 0) {
+		printf("Error: couldn't open trace file %s\n", filename);
+		return 1;
+	}
+	if (fread(&h, sizeof(h), 1, f)!=1 || strncmp(h.magic, "SPTR", 4)!=0
+		|| h.version<1 || h.version>TRACE_VERSION) {
+		printf("Error: %s is not a sim_probe trace file\n", filename);
+		fclose(f);
+		return 1;
+	}
+	// trace_dump() never writes more than the ring holds, so a larger count is a corrupt header
+	if (h.count > TRACE_BUF_SIZE) h.count = TRACE_BUF_SIZE;
+	TraceRecord *records = new TraceRecord[h.count];
+	DWORD count = (DWORD)fread(records, sizeof(TraceRecord), h.count, f);
+	fclose(f);
+	printf("%s: %d records (%d dropped)\n", filename, count, h.dropped);
+	FILE *json = NULL;
+	if (json_filename[0]!=0 && fopen_s(&json, json_filename, "w") != 0) {
+		printf("Error: couldn't open %s for writing\n", json_filename);
+		json = NULL;
+	}
+	trace_output(records, 0, count, 0xFFFFFFFF, h.frequency, json ? NULL : stdout, json);
+	if (json) fclose(json);
+	delete[] records;
+	return 0;
+}
+
+//*********************************************************************************************
+// REPLAY
+// replay_capture() feeds a capture written through capture_dispatch() (see sim_probe.cpp) back
+// to MyDispatchProcSO at the recorded pace, or as fast as possible with 'fast' on the command
+// line.  Between messages the replay clock advances in 1ms steps and runs the message loop's
+// work each step, as the loop in connectToSim() does, and the compute thread's work is done
+// inline so the replay is deterministic.  The exit code is the number of outgoing calls that
+// differ from the recording (0 => identical).
+//*********************************************************************************************
+
+// replay_tick() is one pass of the message loop at the current replay_clock
+void replay_tick() {
+	run_sample_cycle();
+	compute_pending();
+	publish_results();
+}
+
+int replay_capture(const char *filename, bool fast) {
+	FILE *f;
+	CaptureHeader h;
+	if (fopen_s(&f, filename, "rb") != 0) {
+		printf("Error: couldn't open capture file %s\n", filename);
+		return 1;
+	}
+	memset(&h, 0, sizeof(h));
+	if (fread(&h, CAPTURE_HEADER_V2_SIZE, 1, f)!=1 || strncmp(h.magic, "SPRC", 4)!=0 || h.version<2 || h.version>CAPTURE_VERSION
+		|| (h.version>=3 && fread((char*)&h + CAPTURE_HEADER_V2_SIZE, capture_header_size(h.version) - CAPTURE_HEADER_V2_SIZE, 1, f)!=1)) {
+		printf("Error: %s is not a sim_probe capture file\n", filename);
+		fclose(f);
+		return 1;
+	}
+	size_t header_size = capture_header_size(h.version);
+	if (h.version<4) h.flight_recorder = 0; // structure padding in version 3
+	multi_aircraft = h.multi_aircraft!=0;
+	flight_stats = h.flight_stats!=0;
+	flight_recorder = h.flight_recorder!=0;
+	wind_field = h.wind_field!=0;
+	surface_fit = h.surface_fit!=0;
+	if (h.ridge_cells!=ridge_cell_count) {
+		printf("Warning: the capture was recorded with a ridge index of %d cells, replaying with %d (ridgeindex=)\n",
+			   h.ridge_cells, ridge_cell_count);
+	}
+	aircraft_radius = h.aircraft_radius;
+	h.stencil[sizeof(h.stencil)-1] = 0;
+	select_stencil(h.stencil);
+	// read the whole capture, then index the messages and the recorded calls
+	_fseeki64(f, 0, SEEK_END);
+	long long bytes = _ftelli64(f) - header_size;
+	_fseeki64(f, header_size, SEEK_SET);
+	char *data = new char[size_t(bytes)];
+	bytes = (long long)fread(data, 1, size_t(bytes), f);
+	fclose(f);
+	DWORD message_count = 0;
+	for (int pass=0; pass<2; pass++) {
+		for (int c=0; c<CALL_ID_COUNT; c++) replay_call_count[c] = 0;
+		for (long long k=0; k + (long long)sizeof(CaptureRecord) <= bytes; ) {
+			const CaptureRecord *r = (const CaptureRecord *)(data + k);
+			if (k + (long long)sizeof(CaptureRecord) + r->size > bytes) {
+				// a capture cut short by a crash: replay it up to the last whole record
+				printf("%s: truncated capture, the record at byte %lld is incomplete\n", filename, k + (long long)header_size);
+				bytes = k;
+				break;
+			}
+			if (r->type==CAPTURE_RECV && pass==0) message_count++;
+			if (r->type==CAPTURE_CALL && r->size>=sizeof(CaptureCall)) {
+				const CaptureCall *c = (const CaptureCall *)(r + 1);
+				if (c->call<CALL_ID_COUNT) {
+					if (pass==1) replay_calls[c->call][replay_call_count[c->call]] = *c;
+					replay_call_count[c->call]++;
+				}
+			}
+			k += sizeof(CaptureRecord) + r->size;
+		}
+		if (pass==0) {
+			for (int c=0; c<CALL_ID_COUNT; c++) replay_calls[c] = new CaptureCall[replay_call_count[c] + 1];
+		}
+	}
+	printf("%s: %d messages\n", filename, message_count);
+
+	replaying = true;
+	bool started = false;
+	DWORD first_time = 0;
+	LONGLONG start = perf_now();
+	for (long long k=0; k + (long long)sizeof(CaptureRecord) <= bytes && quit==0; ) {
+		CaptureRecord *r = (CaptureRecord *)(data + k);
+		k += sizeof(CaptureRecord) + r->size;
+		if (r->type==CAPTURE_STATE && r->size==sizeof(WarmState)) {
+			memcpy(&warm_state, r + 1, sizeof(WarmState));
+			if (!state_restore(&warm_state)) printf("Error: the capture's saved state is for another version\n");
+			continue;
+		}
+		if (r->type!=CAPTURE_RECV) continue;
+		if (!started) {
+			replay_clock = first_time = r->time;
+			started = true;
+		}
+		// the message loop runs every millisecond until the message is due
+		while (int(r->time - replay_clock) > 0) {
+			replay_clock++;
+			replay_tick();
+		}
+		if (!fast) {
+			// wait until the message is due at the recorded pace
+			LONGLONG due = start + LONGLONG(r->time - first_time) * perf_frequency / 1000;
+			LONGLONG wait = due - perf_now();
+			if (wait > 0) Sleep(DWORD(perf_us(wait) / 1000));
+		}
+		MyDispatchProcSO((SIMCONNECT_RECV *)(r + 1), r->size, NULL);
+		replay_tick();
+	}
+	double seconds = double(perf_now() - start) / double(perf_frequency);
+	replaying = false;
+
+	printf("\nReplayed %d messages in %.2f seconds (%.0f messages per second)\n",
+		   message_count, seconds, seconds > 0.0 ? message_count / seconds : 0.0);
+	for (int c=0; c<CALL_ID_COUNT; c++) {
+		printf("%-20s recorded %6d, replayed %6d\n", call_name[c], replay_call_count[c], replay_call_next[c]);
+		if (replay_call_next[c] < replay_call_count[c]) replay_mismatch_count += replay_call_count[c] - replay_call_next[c];
+	}
+	printf("%d call(s) differ from the recording\n", replay_mismatch_count);
+	for (int c=0; c<CALL_ID_COUNT; c++) delete[] replay_calls[c];
+	delete[] data;
+	return int(replay_mismatch_count);
+}
+
+// END OF REPLAY
+//*********************************************************************************************
+
+int main(int argc, char* argv[])
+{
+	const char *decode_file = ""; // trace dump file to decode
+	const char *json_file = "";
+	const char *replay_file = ""; // capture to replay
+	bool fast = false; // replay as fast as possible
+	const char *ridge_index_file = "";
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i],"debug")==0) {
+			debug = true;
+			debug_info = false;
+		}
+		else if (strcmp(argv[i],"info")==0)      debug_info = true;
+		else if (strcmp(argv[i],"calls")==0 || strcmp(argv[i],"events")==0) {
+			tracing = true;
+			trace_console = true;
+		}
+		else if (strncmp(argv[i],"trace=",6)==0) {
+			tracing = true;
+			trace_file = argv[i]+6;
+		}
+		else if (strncmp(argv[i],"decode=",7)==0) decode_file = argv[i]+7;
+		else if (strncmp(argv[i],"json=",5)==0)   json_file = argv[i]+5;
+		else if (strncmp(argv[i],"replay=",7)==0) replay_file = argv[i]+7;
+		else if (strcmp(argv[i],"fast")==0)      fast = true;
+		else if (strncmp(argv[i],"ridgeindex=",11)==0) ridge_index_file = argv[i]+11;
+		if (debug) printf("Command line argument %d is %s\n",i,argv[i]);
+	}
+	perf_init();
+	igc_extension_init();
+
+	if (decode_file[0]!=0) return trace_decode(decode_file, json_file);
+	if (ridge_index_file[0]!=0 && !ridge_index_load(ridge_index_file)) return 1;
+	if (replay_file[0]!=0) return replay_capture(replay_file, fast);
+	printf("usage: sim_probe_replay replay=<capture file> [fast] | decode=<trace file> [json=<file>]\n");
+	return 1;
+}
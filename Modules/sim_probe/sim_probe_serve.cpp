@@ -0,0 +1,210 @@
+//------------------------------------------------------------------------------
+//
+//  sim_probe_serve: answers lift and elevation queries on a TCP port, no FSX connection
+//
+//  Command line:
+//              serve=<port> [terrain=<asc>|terrain=synthetic] [state=<file>] [stencil=<name>]
+//------------------------------------------------------------------------------
+
+#include <winsock2.h>
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_probe_lib.h"
+
+#ifdef _MSC_VER
+#pragma comment(lib, "ws2_32.lib")
+#endif
+
+//*********************************************************************************************
+// QUERY SERVICE
+// "sim_probe_serve serve=<port> [terrain=<asc>|terrain=synthetic] [state=<file>]" answers lift and
+// elevation queries from other programs (e.g. a task planner) on a TCP port on the loopback
+// interface, without an FSX connection.  Elevations come from the terrain snapshot, then from
+// the elevation cache and terrain pyramid saved by a flying session (state=), and the lift from
+// calc_profile_latlongs() + lift_model(), i.e. what sim_probe would send at that point with the
+// stencil chosen by stencil=.
+//
+// The protocol is one query per line, one reply line per query in the same order, so a client
+// can pipeline any number of queries without waiting; every complete line received is answered
+// and the replies go back in one send.
+//   L <lat> <long> <altitude m> <wind from deg> <wind m/s>  => <lift m/s> <ground elevation m>
+//   E <lat> <long>                                         => <ground elevation m>
+//   S                                                      => <queries> <seconds> <queries/s>
+// A point not covered by the terrain or the cache is answered with '-'.  Each client's query
+// rate is printed when it disconnects.
+//*********************************************************************************************
+
+const int QUERY_MAX_CLIENTS = 16;
+const int QUERY_BUFFER = 65536; // bytes of input, and of replies, per client
+
+struct QueryClient {
+	SOCKET socket; // INVALID_SOCKET => slot free
+	char in[QUERY_BUFFER];
+	int in_length;
+	char out[QUERY_BUFFER];
+	int out_length;
+	INT32 query_count;
+	LONGLONG start; // perf_now() at connection
+};
+
+// query_flush() sends the client's pending replies, returns false if the client has gone
+bool query_flush(QueryClient *c) {
+	int sent = 0;
+	while (sent < c->out_length) {
+		int n = send(c->socket, c->out + sent, c->out_length - sent, 0);
+		if (n==SOCKET_ERROR || n==0) return false;
+		sent += n;
+	}
+	c->out_length = 0;
+	return true;
+}
+
+// query_read() reads what the client has sent and answers every complete line, returns false
+// when the client disconnects
+bool query_read(QueryService *q, QueryClient *c) {
+	int n = recv(c->socket, c->in + c->in_length, QUERY_BUFFER - 1 - c->in_length, 0);
+	if (n==SOCKET_ERROR || n==0) return false;
+	c->in_length += n;
+	c->in[c->in_length] = 0;
+	char *line = c->in;
+	char *end;
+	while ((end = strchr(line, '\n')) != NULL) {
+		*end = 0;
+		if (end>line && end[-1]=='\r') end[-1] = 0;
+		if (line[0]!=0) {
+			char reply[QUERY_REPLY_MAX];
+			int length = query_answer(q, line, reply, sizeof(reply));
+			// send what we have first if the reply doesn't fit
+			if (c->out_length + length > QUERY_BUFFER && !query_flush(c)) return false;
+			memcpy(c->out + c->out_length, reply, length);
+			c->out_length += length;
+			c->query_count++;
+		}
+		line = end + 1;
+	}
+	// keep the partial last line; a line longer than the buffer is dropped
+	c->in_length -= int(line - c->in);
+	memmove(c->in, line, c->in_length);
+	if (c->in_length == QUERY_BUFFER - 1) c->in_length = 0;
+	return query_flush(c);
+}
+
+void query_close(QueryClient *c, int k) {
+	double seconds = double(perf_now() - c->start) / double(perf_frequency);
+	printf("Client %d: %d queries in %.3f seconds (%.0f queries per second)\n",
+		   k, c->query_count, seconds, seconds>0.0 ? c->query_count / seconds : 0.0);
+	fflush(stdout);
+	closesocket(c->socket);
+	c->socket = INVALID_SOCKET;
+}
+
+int run_query_service(int port, const char *terrain_file, const char *state_file) {
+	QueryService q;
+	TerrainGrid terrain;
+	q.terrain = NULL;
+	q.query_count = 0;
+	if (terrain_file[0]!=0) {
+		if (strcmp(terrain_file, "synthetic")==0) terrain_synthetic(&terrain);
+		else if (!terrain_load(&terrain, terrain_file)) return 1;
+		q.terrain = &terrain;
+	}
+	bool restored = state_file[0]!=0 && state_read(state_file, &warm_state);
+	if (restored) state_restore_elevations(&warm_state);
+	if (q.terrain==NULL && !restored) {
+		printf("Error: serve= needs terrain= or a state= file to answer from\n");
+		return 1;
+	}
+
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2,2), &wsa) != 0) {
+		printf("Error: couldn't start Winsock\n");
+		return 1;
+	}
+	SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons((unsigned short)port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // local programs only
+	if (listener==INVALID_SOCKET || bind(listener, (sockaddr *)&address, sizeof(address))==SOCKET_ERROR ||
+		listen(listener, 4)==SOCKET_ERROR) {
+		printf("Error: couldn't listen on 127.0.0.1:%d\n", port);
+		if (listener!=INVALID_SOCKET) closesocket(listener);
+		WSACleanup();
+		return 1;
+	}
+	printf("Answering lift queries on 127.0.0.1:%d (stencil %s)\n", port, stencil_name);
+	fflush(stdout);
+
+	QueryClient *clients = new QueryClient[QUERY_MAX_CLIENTS];
+	for (int k=0; k<QUERY_MAX_CLIENTS; k++) clients[k].socket = INVALID_SOCKET;
+	q.start = perf_now();
+	for (;;) {
+		fd_set readable;
+		FD_ZERO(&readable);
+		FD_SET(listener, &readable);
+		for (int k=0; k<QUERY_MAX_CLIENTS; k++) {
+			if (clients[k].socket!=INVALID_SOCKET) FD_SET(clients[k].socket, &readable);
+		}
+		if (select(0, &readable, NULL, NULL, NULL)==SOCKET_ERROR) break;
+		if (FD_ISSET(listener, &readable)) {
+			SOCKET s = accept(listener, NULL, NULL);
+			int k = 0;
+			while (k<QUERY_MAX_CLIENTS && clients[k].socket!=INVALID_SOCKET) k++;
+			if (s==INVALID_SOCKET) {
+				// accept failed, nothing to do
+			} else if (k==QUERY_MAX_CLIENTS) {
+				closesocket(s);
+			} else {
+				int nodelay = 1; // replies go out as soon as a batch is answered
+				setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char *)&nodelay, sizeof(nodelay));
+				QueryClient *c = &clients[k];
+				c->socket = s;
+				c->in_length = c->out_length = 0;
+				c->query_count = 0;
+				c->start = perf_now();
+			}
+		}
+		for (int k=0; k<QUERY_MAX_CLIENTS; k++) {
+			QueryClient *c = &clients[k];
+			if (c->socket==INVALID_SOCKET || !FD_ISSET(c->socket, &readable)) continue;
+			if (!query_read(&q, c)) query_close(c, k);
+		}
+	}
+	for (int k=0; k<QUERY_MAX_CLIENTS; k++) {
+		if (clients[k].socket!=INVALID_SOCKET) query_close(&clients[k], k);
+	}
+	delete[] clients;
+	closesocket(listener);
+	WSACleanup();
+	if (q.terrain) delete[] terrain.z;
+	return 0;
+}
+
+// END OF QUERY SERVICE
+//*********************************************************************************************
+
+int main(int argc, char* argv[])
+{
+	int serve_port = 0; // answer lift queries on this port
+	const char *terrain_file = "";
+	const char *state_file = ""; // elevations saved by a flying session
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i],"debug")==0)          debug = true;
+		else if (strcmp(argv[i],"info")==0)      debug_info = true;
+		else if (strncmp(argv[i],"serve=",6)==0) serve_port = atoi(argv[i]+6);
+		else if (strncmp(argv[i],"terrain=",8)==0) terrain_file = argv[i]+8;
+		else if (strncmp(argv[i],"state=",6)==0) state_file = argv[i]+6;
+		else if (strncmp(argv[i],"stencil=",8)==0) {
+			if (!select_stencil(argv[i]+8)) printf("Unknown stencil %s, using ridge\n", argv[i]+8);
+		}
+	}
+	perf_init();
+
+	if (serve_port>0) return run_query_service(serve_port, terrain_file, state_file);
+	printf("usage: sim_probe_serve serve=<port> [terrain=<asc>|terrain=synthetic] [state=<file>]\n");
+	return 1;
+}
@@ -0,0 +1,695 @@
+//------------------------------------------------------------------------------
+//
+//  sim_probe_sweep: offline tuning of the lift model against a terrain snapshot, no FSX connection
+//
+//  Command line:
+//              sweep=<terrain.asc> igc=<file> [igc=<file> ...] [threads=<n>] [report=<file>]
+//              evaluate=<terrain.asc>|synthetic [igc=<file> ...] [budget=<m/s>]
+//              ridges=<terrain.asc>|synthetic [ridgeindex=<file>] [igc=<file> ...]
+//------------------------------------------------------------------------------
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_probe_lib.h"
+
+//*********************************************************************************************
+// PARAMETER SWEEP
+// "sim_probe_sweep sweep=<terrain.asc> igc=<file> [igc=<file> ...]" scores every parameter set in
+// the grid below (probe distances, slope weights and agl_factor() boundaries) against a
+// reference lift, over the fixes of the IGC files with the wind from SWEEP_WIND_DIRECTIONS
+// directions, and prints the best sets.  The terrain snapshot is an ESRI ASCII grid in degrees
+// (e.g. exported from SRTM).  The sets are shared out between 'threads=<n>' worker threads,
+// default one per processor, and 'report=<file>' writes the full ranking.
+//
+// The reference is the same slope response evaluated densely: every SWEEP_STEP segment of the
+// wind line from 100m downwind to 2000m upwind, weighted by exp(-distance/500m) and scaled to
+// the total weight of the ridge stencil.
+//*********************************************************************************************
+
+const int SWEEP_WIND_DIRECTIONS = 8;
+const double SWEEP_WIND_VELOCITY = 10.0; // m/s
+const double SWEEP_STEP = 25.0; // meters between terrain samples along the wind line
+const double SWEEP_NEAR = -300.0; // wind line from 300m downwind ...
+const double SWEEP_FAR = 4000.0; // ... to 4000m upwind
+const int SWEEP_SAMPLES = int((SWEEP_FAR - SWEEP_NEAR) / SWEEP_STEP) + 1;
+const int SWEEP_MAX_POINTS = 4000; // evaluation points (fix x wind direction)
+const double SWEEP_FIX_SPACING = 200.0; // meters, closer IGC fixes are skipped
+const int SWEEP_REPORT_COUNT = 20; // best parameter sets printed
+
+// one evaluation point: an aircraft position with the wind from one direction
+struct SweepPoint {
+	double latitude;
+	double longitude;
+	double wind_direction; // degrees
+	double altitude;
+	float line[SWEEP_SAMPLES]; // terrain along the wind line, line[k] at SWEEP_NEAR + k * SWEEP_STEP
+	double reference; // reference lift
+};
+
+struct SweepParams {
+	double distance[PROFILE_COUNT];
+	double weight[PROFILE_COUNT-1];
+	double zero_factor;
+	double boundary1;
+	double boundary2;
+};
+
+struct SweepResult {
+	double rms; // rms error against the reference lift, m/s
+	double bias; // mean error, m/s
+};
+
+// the parameter grid, set k is the mixed radix number with a digit per parameter
+const double sweep_d1[] = { 150.0, 250.0, 400.0 };
+const double sweep_d2[] = { 500.0, 750.0, 1000.0 };
+const double sweep_d3[] = { 1500.0, 2000.0, 3000.0 };
+const double sweep_d4[] = { -50.0, -100.0, -200.0 };
+const double sweep_w0[] = { 0.1, 0.2, 0.3 };
+const double sweep_w1[] = { 0.1, 0.2, 0.3 };
+const double sweep_w2[] = { 0.3, 0.5, 0.7 };
+const double sweep_w3[] = { 0.1, 0.2 };
+const double sweep_zero[] = { 0.3, 0.5, 0.7 };
+const double sweep_b1[] = { 30.0, 40.0, 60.0 };
+const double sweep_b2[] = { 100.0, 130.0, 180.0 };
+
+struct SweepAxis {
+	const char *name;
+	const double *values;
+	int count;
+};
+
+#define SWEEP_AXIS(name, a) { name, a, sizeof(a) / sizeof(a[0]) }
+SweepAxis sweep_axes[] = {
+	SWEEP_AXIS("d1", sweep_d1), SWEEP_AXIS("d2", sweep_d2), SWEEP_AXIS("d3", sweep_d3), SWEEP_AXIS("d4", sweep_d4),
+	SWEEP_AXIS("w0", sweep_w0), SWEEP_AXIS("w1", sweep_w1), SWEEP_AXIS("w2", sweep_w2), SWEEP_AXIS("w3", sweep_w3),
+	SWEEP_AXIS("zero", sweep_zero), SWEEP_AXIS("b1", sweep_b1), SWEEP_AXIS("b2", sweep_b2)
+};
+const int SWEEP_AXIS_COUNT = sizeof(sweep_axes) / sizeof(sweep_axes[0]);
+
+// sweep_params() sets p to parameter set k of the grid
+void sweep_params(int k, SweepParams *p) {
+	double v[SWEEP_AXIS_COUNT];
+	for (int a=0; a<SWEEP_AXIS_COUNT; a++) {
+		v[a] = sweep_axes[a].values[k % sweep_axes[a].count];
+		k /= sweep_axes[a].count;
+	}
+	p->distance[0] = 0.0;
+	for (int i=1; i<PROFILE_COUNT; i++) p->distance[i] = v[i-1];
+	for (int i=0; i<PROFILE_COUNT-1; i++) p->weight[i] = v[PROFILE_COUNT-1+i];
+	p->zero_factor = v[8];
+	p->boundary1 = v[9];
+	p->boundary2 = v[10];
+}
+
+// sweep_line() returns the terrain elevation distance meters upwind along the point's wind line
+inline double sweep_line(const SweepPoint *pt, double distance) {
+	double x = (distance - SWEEP_NEAR) / SWEEP_STEP;
+	int k = int(x);
+	if (k<0) return pt->line[0];
+	if (k>=SWEEP_SAMPLES-1) return pt->line[SWEEP_SAMPLES-1];
+	return pt->line[k] + (pt->line[k+1] - pt->line[k]) * (x - k);
+}
+
+// sweep_lift() is ridge_lift() with the distances, weights and agl boundaries from p
+double sweep_lift(const SweepParams *p, const SweepPoint *pt) {
+	double e[PROFILE_COUNT];
+	for (int i=0; i<PROFILE_COUNT; i++) e[i] = sweep_line(pt, p->distance[i]);
+	double slope0 = (e[0] - e[1]) / p->distance[1];
+	double slope1 = (e[1] - e[2]) / (p->distance[2] - p->distance[1]);
+	double slope2 = (e[2] - e[3]) / (p->distance[3] - p->distance[2]);
+	double slope3 = (e[4] - e[0]) / (-p->distance[4]);
+	double factor = adj_slope(slope0) * p->weight[0] + adj_slope(slope1) * p->weight[1];
+	if (slope2<0.0) factor += adj_slope(slope2) * p->weight[2];
+	if (slope3>0.0 || slope0<0.0) factor += adj_slope(slope3) * p->weight[3];
+	return SWEEP_WIND_VELOCITY * factor * agl_factor_with(pt->altitude, e[0], p->zero_factor, p->boundary1, p->boundary2);
+}
+
+double sweep_reference_lift(const SweepPoint *pt) {
+	const double total_weight = 1.1; // sum of the ridge stencil weights
+	double sum = 0.0, weights = 0.0;
+	for (double d=-100.0; d<2000.0; d+=SWEEP_STEP) {
+		double slope = (sweep_line(pt, d) - sweep_line(pt, d + SWEEP_STEP)) / SWEEP_STEP;
+		double w = exp(-fabs(d + SWEEP_STEP / 2.0) / 500.0);
+		sum += adj_slope(slope) * w;
+		weights += w;
+	}
+	return SWEEP_WIND_VELOCITY * total_weight * sum / weights * agl_factor(pt->altitude, sweep_line(pt, 0.0));
+}
+
+SweepPoint *sweep_points = NULL;
+int sweep_point_count = 0;
+SweepResult *sweep_results = NULL;
+int sweep_set_count = 0;
+volatile LONG sweep_next = 0; // next parameter set for a worker to take
+
+void sweep_score(const SweepParams *p, SweepResult *r) {
+	double sum = 0.0, sum2 = 0.0;
+	for (int k=0; k<sweep_point_count; k++) {
+		double error = sweep_lift(p, &sweep_points[k]) - sweep_points[k].reference;
+		sum += error;
+		sum2 += error * error;
+	}
+	r->rms = sqrt(sum2 / sweep_point_count);
+	r->bias = sum / sweep_point_count;
+}
+
+DWORD WINAPI sweep_worker(LPVOID) {
+	for (;;) {
+		LONG k = InterlockedIncrement(&sweep_next) - 1;
+		if (k >= sweep_set_count) break;
+		SweepParams p;
+		sweep_params(k, &p);
+		sweep_score(&p, &sweep_results[k]);
+	}
+	return 0;
+}
+
+// sweep_add_position() adds an evaluation point per wind direction at lat/long, altitude no
+// lower than agl meters above the ground, and returns the number added
+int sweep_add_position(const TerrainGrid *t, double latitude, double longitude, double altitude, double agl) {
+	int added = 0;
+	for (int w=0; w<SWEEP_WIND_DIRECTIONS && sweep_point_count<SWEEP_MAX_POINTS; w++) {
+		SweepPoint *pt = &sweep_points[sweep_point_count];
+		double wind_direction = 360.0 * w / SWEEP_WIND_DIRECTIONS;
+		bool ok = true;
+		for (int k=0; k<SWEEP_SAMPLES && ok; k++) {
+			MoveStruct m = distance_and_bearing(latitude, longitude, SWEEP_NEAR + k * SWEEP_STEP, wind_direction);
+			double elevation;
+			ok = terrain_elevation(t, m.latitude, m.longitude, &elevation);
+			pt->line[k] = float(elevation);
+		}
+		if (!ok) continue; // wind line runs off the terrain snapshot
+		pt->latitude = latitude;
+		pt->longitude = longitude;
+		pt->wind_direction = wind_direction;
+		pt->altitude = max(altitude, pt->line[int(-SWEEP_NEAR / SWEEP_STEP)] + agl);
+		pt->reference = sweep_reference_lift(pt);
+		sweep_point_count++;
+		added++;
+	}
+	return added;
+}
+
+// sweep_add_igc() adds evaluation points from the fixes of an IGC file
+void sweep_add_igc(const TerrainGrid *t, const char *filename) {
+	FILE *f;
+	if (fopen_s(&f, filename, "r") != 0) {
+		printf("Error: couldn't open IGC file %s\n", filename);
+		return;
+	}
+	char line[200];
+	igc_b fix, last = { 0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, {0} };
+	bool have_last = false;
+	int fixes = 0, used = 0;
+	while (fgets(line, sizeof(line), f) && sweep_point_count + SWEEP_WIND_DIRECTIONS <= SWEEP_MAX_POINTS) {
+		if (!igc_parse_b_record(line, strlen(line), &fix)) continue;
+		fixes++;
+		if (have_last && approx_distance(last.latitude, last.longitude, fix.latitude, fix.longitude) < SWEEP_FIX_SPACING) continue;
+		last = fix;
+		have_last = true;
+		used += sweep_add_position(t, fix.latitude, fix.longitude, fix.altitude, 0.0);
+	}
+	fclose(f);
+	printf("%s: %d fixes, %d evaluation points\n", filename, fixes, used);
+}
+
+int sweep_compare(const void *a, const void *b) {
+	double ra = sweep_results[*(const int *)a].rms;
+	double rb = sweep_results[*(const int *)b].rms;
+	return (ra < rb) ? -1 : (ra > rb) ? 1 : 0;
+}
+
+void sweep_print(FILE *f, int rank, const SweepParams *p, const SweepResult *r) {
+	fprintf(f, "%6d  rms %6.3f  bias %+6.3f  d %4.0f %4.0f %4.0f %4.0f  w %.2f %.2f %.2f %.2f  agl %.2f %3.0f %3.0f\n",
+			rank, r->rms, r->bias, p->distance[1], p->distance[2], p->distance[3], p->distance[4],
+			p->weight[0], p->weight[1], p->weight[2], p->weight[3], p->zero_factor, p->boundary1, p->boundary2);
+}
+
+int run_sweep(const char *terrain_file, char **igc_files, int igc_count, int threads, const char *report_file) {
+	TerrainGrid terrain;
+	if (!terrain_load(&terrain, terrain_file)) return 1;
+	sweep_points = new SweepPoint[SWEEP_MAX_POINTS];
+	for (int k=0; k<igc_count; k++) sweep_add_igc(&terrain, igc_files[k]);
+	delete[] terrain.z;
+	if (sweep_point_count==0) {
+		printf("Error: no evaluation points (no IGC fixes inside the terrain snapshot)\n");
+		delete[] sweep_points;
+		return 1;
+	}
+	sweep_set_count = 1;
+	for (int a=0; a<SWEEP_AXIS_COUNT; a++) sweep_set_count *= sweep_axes[a].count;
+	sweep_results = new SweepResult[sweep_set_count];
+	if (threads<=0) {
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		threads = si.dwNumberOfProcessors;
+	}
+	printf("Scoring %d parameter sets over %d points on %d threads\n", sweep_set_count, sweep_point_count, threads);
+
+	LONGLONG start = perf_now();
+	sweep_next = 0;
+	HANDLE *workers = new HANDLE[threads];
+	for (int k=0; k<threads; k++) workers[k] = CreateThread(NULL, 0, sweep_worker, NULL, 0, NULL);
+	for (int k=0; k<threads; k++) {
+		WaitForSingleObject(workers[k], INFINITE);
+		CloseHandle(workers[k]);
+	}
+	delete[] workers;
+	double seconds = double(perf_now() - start) / double(perf_frequency);
+	printf("%.1f seconds (%.0f parameter sets per second)\n", seconds, sweep_set_count / seconds);
+
+	int *order = new int[sweep_set_count];
+	for (int k=0; k<sweep_set_count; k++) order[k] = k;
+	qsort(order, sweep_set_count, sizeof(int), sweep_compare);
+
+	// the ridge stencil and agl_factor() as shipped, for comparison
+	SweepParams current = { {0.0, 250.0, 750.0, 2000.0, -100.0}, {0.2, 0.2, 0.5, 0.2}, 0.5, 40.0, 130.0 };
+	SweepResult current_result;
+	sweep_score(&current, &current_result);
+	int current_rank = 1;
+	while (current_rank<=sweep_set_count && sweep_results[order[current_rank-1]].rms < current_result.rms) current_rank++;
+
+	SweepParams p;
+	printf("\nBest parameter sets:\n");
+	for (int k=0; k<SWEEP_REPORT_COUNT && k<sweep_set_count; k++) {
+		sweep_params(order[k], &p);
+		sweep_print(stdout, k+1, &p, &sweep_results[order[k]]);
+	}
+	printf("\nCurrent parameters:\n");
+	sweep_print(stdout, current_rank, &current, &current_result);
+	FILE *f;
+	if (report_file[0]!=0) {
+		if (fopen_s(&f, report_file, "w") != 0) {
+			printf("Error: couldn't write report file %s\n", report_file);
+		} else {
+			for (int k=0; k<sweep_set_count; k++) {
+				sweep_params(order[k], &p);
+				sweep_print(f, k+1, &p, &sweep_results[order[k]]);
+			}
+			fclose(f);
+		}
+	}
+	delete[] order;
+	delete[] sweep_results;
+	delete[] sweep_points;
+	return 0;
+}
+
+// END OF PARAMETER SWEEP
+//*********************************************************************************************
+
+//*********************************************************************************************
+// STENCIL EVALUATION
+// "sim_probe_sweep evaluate=<terrain.asc> [igc=<file> ...]" compares the production lift path,
+// calc_profile_latlongs() + lift_model() with elevations looked up in the terrain snapshot,
+// against the dense reference lift of the parameter sweep, for every stencil and for 2 to
+// PROFILE_COUNT probes.  With fewer probes the missing ones read the elevation of the previous
+// probe (the back probe reads the aircraft's), i.e. their slopes are flat.  "evaluate=synthetic"
+// builds dune, ridge and mountain bands instead of loading a DEM.  The points are the IGC fixes,
+// or without igc= a lattice over the terrain.  'budget=<m/s>' picks the cheapest configuration
+// with a 90th percentile error within the budget.
+//*********************************************************************************************
+
+const double EVAL_LATTICE_SPACING = 1000.0; // meters between lattice positions
+const double eval_lattice_agl[] = { 50.0, 150.0, 400.0 }; // lattice altitudes, cycled
+
+// sweep_add_lattice() adds evaluation points on a lattice over the terrain snapshot
+void sweep_add_lattice(const TerrainGrid *t) {
+	double lat_step = EVAL_LATTICE_SPACING / 111120.0;
+	int added = 0, k = 0;
+	for (double latitude=t->yll + lat_step; latitude<t->yll + t->nrows * t->cellsize; latitude+=lat_step) {
+		double long_step = lat_step / cos(latitude * M_PI / 180.0);
+		for (double longitude=t->xll + long_step; longitude<t->xll + t->ncols * t->cellsize; longitude+=long_step) {
+			double agl = eval_lattice_agl[k++ % (sizeof(eval_lattice_agl) / sizeof(eval_lattice_agl[0]))];
+			added += sweep_add_position(t, latitude, longitude, 0.0, agl);
+		}
+	}
+	printf("Lattice: %d evaluation points\n", added);
+}
+
+struct EvalResult {
+	const char *stencil;
+	int probes;
+	double messages; // SimConnect messages per sample, a move and a reply per probe
+	double rms;
+	double bias;
+	double p50; // percentiles of the absolute error
+	double p90;
+	double max;
+};
+
+int double_compare(const void *a, const void *b) {
+	double da = *(const double *)a;
+	double db = *(const double *)b;
+	return (da < db) ? -1 : (da > db) ? 1 : 0;
+}
+
+// evaluate_stencil() scores the current stencil with the first 'probes' probes
+void evaluate_stencil(const TerrainGrid *t, int probes, double *errors, EvalResult *r) {
+	int n = 0;
+	double sum = 0.0, sum2 = 0.0;
+	for (int k=0; k<sweep_point_count; k++) {
+		const SweepPoint *pt = &sweep_points[k];
+		UserStruct pos = { pt->latitude, pt->longitude, pt->altitude, pt->line[int(-SWEEP_NEAR / SWEEP_STEP)],
+						   SWEEP_WIND_VELOCITY, pt->wind_direction, 0, 0 };
+		calc_profile_latlongs(&pos);
+		double elevation[PROFILE_COUNT];
+		elevation[0] = pos.ground_elevation;
+		bool ok = true;
+		for (int i=1; i<PROFILE_COUNT && ok; i++) {
+			if (i<probes) ok = terrain_elevation(t, profile[i].latitude, profile[i].longitude, &elevation[i]);
+			else elevation[i] = (i==PROFILE_COUNT-1) ? elevation[0] : elevation[i-1];
+		}
+		if (!ok) continue; // stencil reaches off the terrain snapshot
+		double error = lift_model(&pos, elevation, NULL) - pt->reference;
+		sum += error;
+		sum2 += error * error;
+		errors[n++] = fabs(error);
+	}
+	r->probes = probes;
+	r->messages = 2.0 * (probes - 1);
+	if (n==0) {
+		r->rms = r->bias = r->p50 = r->p90 = r->max = 0.0;
+		return;
+	}
+	qsort(errors, n, sizeof(double), double_compare);
+	r->rms = sqrt(sum2 / n);
+	r->bias = sum / n;
+	r->p50 = errors[n / 2];
+	r->p90 = errors[n * 9 / 10];
+	r->max = errors[n - 1];
+}
+
+int run_evaluation(const char *terrain_file, char **igc_files, int igc_count, double budget) {
+	TerrainGrid terrain;
+	if (strcmp(terrain_file, "synthetic")==0) terrain_synthetic(&terrain);
+	else if (!terrain_load(&terrain, terrain_file)) return 1;
+	sweep_points = new SweepPoint[SWEEP_MAX_POINTS];
+	for (int k=0; k<igc_count; k++) sweep_add_igc(&terrain, igc_files[k]);
+	if (igc_count==0) sweep_add_lattice(&terrain);
+	if (sweep_point_count==0) {
+		printf("Error: no evaluation points\n");
+		delete[] sweep_points;
+		delete[] terrain.z;
+		return 1;
+	}
+
+	const int probe_counts = PROFILE_COUNT - 1; // 2..PROFILE_COUNT probes
+	EvalResult *results = new EvalResult[STENCIL_COUNT * probe_counts];
+	double *errors = new double[sweep_point_count];
+	int result_count = 0;
+	for (int s=0; s<STENCIL_COUNT; s++) {
+		stencils[s].use();
+		for (int probes=2; probes<=PROFILE_COUNT; probes++) {
+			EvalResult *r = &results[result_count++];
+			r->stencil = stencils[s].name;
+			evaluate_stencil(&terrain, probes, errors, r);
+		}
+	}
+	select_stencil(stencil_name);
+
+	printf("\n%d evaluation points, wind %.0f m/s from %d directions, errors in m/s\n",
+		   sweep_point_count, SWEEP_WIND_VELOCITY, SWEEP_WIND_DIRECTIONS);
+	printf("stencil   probes msgs/sample    rms    bias  |err| p50    p90    max\n");
+	int best = -1;
+	for (int k=0; k<result_count; k++) {
+		const EvalResult *r = &results[k];
+		printf("%-9s %6d %11.0f %6.3f %+7.3f %10.3f %6.3f %6.3f\n",
+			   r->stencil, r->probes, r->messages, r->rms, r->bias, r->p50, r->p90, r->max);
+		if (budget>0.0 && r->p90<=budget &&
+			(best<0 || r->messages<results[best].messages || (r->messages==results[best].messages && r->rms<results[best].rms))) {
+			best = k;
+		}
+	}
+	if (budget>0.0) {
+		if (best<0) printf("\nNo configuration has a 90th percentile error within %.2f m/s\n", budget);
+		else printf("\nCheapest within %.2f m/s: stencil=%s with %d probes (%.0f messages per sample)\n",
+					budget, results[best].stencil, results[best].probes, results[best].messages);
+	}
+	delete[] errors;
+	delete[] results;
+	delete[] sweep_points;
+	delete[] terrain.z;
+	return 0;
+}
+
+// END OF STENCIL EVALUATION
+//*********************************************************************************************
+
+//*********************************************************************************************
+// RIDGE EXTRACTION
+// "sim_probe_sweep ridges=<terrain.asc> [ridgeindex=<file>] [igc=<file> ...]" writes the ridge index
+// of a terrain snapshot (ESRI ASCII grid, or 'ridges=synthetic' for the terrain of the stencil
+// evaluation) to <file>, default sim_probe.rdg.  A RIDGE_INDEX_CELL cell is indexed if the
+// ground in it and its neighbours rises at least RIDGE_MIN_RELIEF and it has a face of at least
+// RIDGE_MIN_SLOPE or a crest.  The index is then flown over the IGC fixes, with their own wind
+// if they have sim_probe's wind columns or else from SWEEP_WIND_DIRECTIONS directions, or
+// without igc= over a lattice, to report the share of profiles (and so of probe moves) the
+// runtime would skip and the lift the flat profiles miss, from the terrain.
+//*********************************************************************************************
+
+const double RIDGE_MIN_SLOPE = 0.08; // rise over run
+const double RIDGE_MIN_RELIEF = 20.0; // meters
+const double RIDGE_LATTICE_SPACING = 250.0; // meters between lattice positions
+const double RIDGE_LATTICE_AGL = 100.0; // meters
+const double RIDGE_MISSED_LIFT = 0.5; // m/s, flat profiles missing more are counted
+
+// cell statistics while extracting
+struct RidgeStats {
+	float min_elevation;
+	float max_elevation;
+	float slope;
+	bool valid;
+};
+
+// ridge_extract() sets *cells to the indexed cells of the terrain snapshot, sorted, and
+// returns the number
+int ridge_extract(const TerrainGrid *t, RidgeCell **cells) {
+	double top = t->yll + t->nrows * t->cellsize;
+	INT32 lat0 = INT32(floor(t->yll / RIDGE_INDEX_CELL)), long0 = INT32(floor(t->xll / RIDGE_INDEX_CELL));
+	int rows = INT32(floor(top / RIDGE_INDEX_CELL)) - lat0 + 1;
+	int cols = INT32(floor((t->xll + t->ncols * t->cellsize) / RIDGE_INDEX_CELL)) - long0 + 1;
+	RidgeStats *s = new RidgeStats[rows * cols];
+	memset(s, 0, rows * cols * sizeof(RidgeStats));
+	double dy = rad2m(deg2rad(t->cellsize));
+	for (int row=1; row<t->nrows-1; row++) {
+		double latitude = top - (row + 0.5) * t->cellsize;
+		double dx = dy * cos(deg2rad(latitude));
+		for (int col=1; col<t->ncols-1; col++) {
+			const float *z = &t->z[row * t->ncols + col];
+			if (z[0]==t->nodata || z[-1]==t->nodata || z[1]==t->nodata || z[-t->ncols]==t->nodata || z[t->ncols]==t->nodata) continue;
+			double gx = (z[1] - z[-1]) / (2.0 * dx);
+			double gy = (z[-t->ncols] - z[t->ncols]) / (2.0 * dy);
+			double longitude = t->xll + (col + 0.5) * t->cellsize;
+			RidgeStats *c = &s[(INT32(floor(latitude / RIDGE_INDEX_CELL)) - lat0) * cols + INT32(floor(longitude / RIDGE_INDEX_CELL)) - long0];
+			if (!c->valid) {
+				c->min_elevation = c->max_elevation = z[0];
+				c->valid = true;
+			}
+			c->min_elevation = min(c->min_elevation, z[0]);
+			c->max_elevation = max(c->max_elevation, z[0]);
+			c->slope = max(c->slope, float(sqrt(gx * gx + gy * gy)));
+		}
+	}
+	int count = 0, capacity = 1024;
+	*cells = new RidgeCell[capacity];
+	for (int r=0; r<rows; r++) {
+		for (int c=0; c<cols; c++) {
+			const RidgeStats *cell = &s[r * cols + c];
+			if (!cell->valid) continue;
+			// relief over the cell and its neighbours, and whether its high point is a crest
+			// along a row or a column of cells
+			float low = cell->min_elevation, high = cell->max_elevation;
+			bool crest_ns = r>0 && r<rows-1, crest_ew = c>0 && c<cols-1;
+			for (int k=0; k<9; k++) {
+				int nr = r + k / 3 - 1, nc = c + k % 3 - 1;
+				if (nr<0 || nc<0 || nr>=rows || nc>=cols || !s[nr * cols + nc].valid) continue;
+				const RidgeStats *n = &s[nr * cols + nc];
+				low = min(low, n->min_elevation);
+				high = max(high, n->max_elevation);
+				if (k==1 || k==7) crest_ns = crest_ns && n->max_elevation < cell->max_elevation;
+				if (k==3 || k==5) crest_ew = crest_ew && n->max_elevation < cell->max_elevation;
+			}
+			DWORD flags = 0;
+			if (cell->slope >= RIDGE_MIN_SLOPE) flags |= RIDGE_FACE;
+			if (crest_ns || crest_ew) flags |= RIDGE_CREST;
+			if (flags==0 || high - low < RIDGE_MIN_RELIEF) continue;
+			if (count==capacity) {
+				capacity *= 2;
+				RidgeCell *grown = new RidgeCell[capacity];
+				memcpy(grown, *cells, count * sizeof(RidgeCell));
+				delete[] *cells;
+				*cells = grown;
+			}
+			RidgeCell rc = { lat0 + r, long0 + c, cell->slope, high - low, flags };
+			(*cells)[count++] = rc;
+		}
+	}
+	delete[] s;
+	return count; // rows then columns, i.e. sorted
+}
+
+// the report on the profiles of a corpus or lattice
+struct RidgeReport {
+	int profiles;
+	int flat;
+	int missed; // flat profiles with more than RIDGE_MISSED_LIFT of lift
+	double flat_lift; // sum of |lift| of the flat profiles
+	double max_flat_lift;
+	double near_lift; // sum of |lift| of the probed profiles
+};
+
+// ridge_report_profile() adds the profile at a position to the report
+void ridge_report_profile(const TerrainGrid *t, RidgeReport *r, double latitude, double longitude,
+						  double altitude, double wind_velocity, double wind_direction) {
+	UserStruct pos = { latitude, longitude, altitude, 0.0, wind_velocity, wind_direction, 0, 0 };
+	if (!terrain_elevation(t, latitude, longitude, &pos.ground_elevation)) return;
+	pos.altitude = max(pos.altitude, pos.ground_elevation);
+	calc_profile_latlongs(&pos);
+	double elevation[PROFILE_COUNT];
+	elevation[0] = pos.ground_elevation;
+	for (int i=1; i<PROFILE_COUNT; i++) {
+		if (!terrain_elevation(t, profile[i].latitude, profile[i].longitude, &elevation[i])) return;
+	}
+	double lift = fabs(lift_model(&pos, elevation, NULL));
+	r->profiles++;
+	if (ridge_near(latitude, longitude, wind_direction)) {
+		r->near_lift += lift;
+		return;
+	}
+	r->flat++;
+	r->flat_lift += lift;
+	r->max_flat_lift = max(r->max_flat_lift, lift);
+	if (lift > RIDGE_MISSED_LIFT) r->missed++;
+}
+
+// ridge_report_igc() adds the profiles at the fixes of an IGC file to the report
+void ridge_report_igc(const TerrainGrid *t, RidgeReport *r, const char *filename) {
+	FILE *f;
+	if (fopen_s(&f, filename, "r") != 0) {
+		printf("Error: couldn't open IGC file %s\n", filename);
+		return;
+	}
+	char line[400], i_record[200] = "I00";
+	bool has_wind = false;
+	igc_b fix;
+	while (fgets(line, sizeof(line), f)) {
+		size_t length = strcspn(line, "\r\n");
+		if (line[0]=='I' && length<sizeof(i_record)) {
+			memcpy(i_record, line, length);
+			i_record[length] = 0;
+			has_wind = strstr(i_record, "WDI")!=NULL && strstr(i_record, "WVE")!=NULL;
+		}
+		if (!igc_parse_b_record(line, length, &fix)) continue;
+		igc_parse_extensions(i_record, line, length, &fix);
+		if (has_wind) {
+			ridge_report_profile(t, r, fix.latitude, fix.longitude, fix.altitude, fix.wind_velocity, fix.wind_direction);
+			continue;
+		}
+		for (int w=0; w<SWEEP_WIND_DIRECTIONS; w++) {
+			ridge_report_profile(t, r, fix.latitude, fix.longitude, fix.altitude, SWEEP_WIND_VELOCITY, 360.0 * w / SWEEP_WIND_DIRECTIONS);
+		}
+	}
+	fclose(f);
+}
+
+int run_ridges(const char *terrain_file, const char *index_file, char **igc_files, int igc_count) {
+	TerrainGrid terrain;
+	if (strcmp(terrain_file, "synthetic")==0) terrain_synthetic(&terrain);
+	else if (!terrain_load(&terrain, terrain_file)) return 1;
+	LONGLONG start = perf_now();
+	ridge_cell_count = DWORD(ridge_extract(&terrain, &ridge_cells));
+	double seconds = double(perf_now() - start) / double(perf_frequency);
+	int faces = 0, crests = 0;
+	for (DWORD k=0; k<ridge_cell_count; k++) {
+		if (ridge_cells[k].flags & RIDGE_FACE) faces++;
+		if (ridge_cells[k].flags & RIDGE_CREST) crests++;
+	}
+	if (index_file[0]==0) index_file = "sim_probe.rdg";
+	FILE *f;
+	if (fopen_s(&f, index_file, "wb") != 0) {
+		printf("Error: couldn't write ridge index %s\n", index_file);
+		delete[] terrain.z;
+		return 1;
+	}
+	RidgeIndexHeader h = { {'S','P','R','I'}, RIDGE_INDEX_VERSION, ridge_cell_count, float(RIDGE_INDEX_CELL),
+						   float(RIDGE_MIN_SLOPE), float(RIDGE_MIN_RELIEF) };
+	fwrite(&h, sizeof(h), 1, f);
+	fwrite(ridge_cells, sizeof(RidgeCell), ridge_cell_count, f);
+	fclose(f);
+	printf("Ridge index: %d cells (%d with a face, %d with a crest), %.2f seconds -> %s (%d bytes)\n",
+		   ridge_cell_count, faces, crests, seconds, index_file, int(sizeof(h) + ridge_cell_count * sizeof(RidgeCell)));
+
+	RidgeReport r;
+	memset(&r, 0, sizeof(r));
+	for (int k=0; k<igc_count; k++) ridge_report_igc(&terrain, &r, igc_files[k]);
+	if (igc_count==0) {
+		// lattice over the terrain, every wind direction
+		double lat_step = RIDGE_LATTICE_SPACING / 111120.0;
+		for (double latitude=terrain.yll + lat_step; latitude<terrain.yll + terrain.nrows * terrain.cellsize; latitude+=lat_step) {
+			double long_step = lat_step / cos(deg2rad(latitude));
+			for (double longitude=terrain.xll + long_step; longitude<terrain.xll + terrain.ncols * terrain.cellsize; longitude+=long_step) {
+				double ground;
+				if (!terrain_elevation(&terrain, latitude, longitude, &ground)) continue;
+				for (int w=0; w<SWEEP_WIND_DIRECTIONS; w++) {
+					ridge_report_profile(&terrain, &r, latitude, longitude, ground + RIDGE_LATTICE_AGL,
+										 SWEEP_WIND_VELOCITY, 360.0 * w / SWEEP_WIND_DIRECTIONS);
+				}
+			}
+		}
+	}
+	if (r.profiles>0) {
+		int probed = r.profiles - r.flat;
+		printf("\n%d profiles (%s): %d near a ridge, %d flat\n", r.profiles, igc_count>0 ? "IGC fixes" : "lattice", probed, r.flat);
+		printf("Probe moves eliminated: %.1f%%\n", 100.0 * r.flat / r.profiles);
+		printf("Probe moves with the user sampled every %d ms near a ridge: %.1f%% of sampling everywhere once a second\n",
+			   RIDGE_FAST_INTERVAL_MS, 100.0 * probed * (1000.0 / RIDGE_FAST_INTERVAL_MS) / r.profiles);
+		printf("Mean |lift| near a ridge %.3f m/s, of the flat profiles %.3f m/s (max %.2f, %d over %.1f m/s)\n",
+			   probed>0 ? r.near_lift / probed : 0.0, r.flat>0 ? r.flat_lift / r.flat : 0.0,
+			   r.max_flat_lift, r.missed, RIDGE_MISSED_LIFT);
+	}
+	delete[] terrain.z;
+	return 0;
+}
+
+// END OF RIDGE EXTRACTION
+//*********************************************************************************************
+
+int main(int argc, char* argv[])
+{
+	const char *sweep_file = ""; // terrain snapshot for the parameter sweep
+	char *igc_files[64]; // flight corpus
+	int igc_count = 0;
+	int threads = 0; // parameter sweep worker threads, 0 => one per processor
+	const char *report_file = "";
+	const char *evaluate_file = ""; // terrain snapshot (or "synthetic") for the stencil evaluation
+	double budget = 0.0; // stencil evaluation error budget, m/s
+	const char *ridges_file = ""; // terrain snapshot to extract the ridge index from
+	const char *ridge_index_file = "";
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i],"debug")==0)          debug = true;
+		else if (strncmp(argv[i],"sweep=",6)==0) sweep_file = argv[i]+6;
+		else if (strncmp(argv[i],"igc=",4)==0) {
+			if (igc_count<64) igc_files[igc_count++] = argv[i]+4;
+		}
+		else if (strncmp(argv[i],"threads=",8)==0) threads = atoi(argv[i]+8);
+		else if (strncmp(argv[i],"report=",7)==0) report_file = argv[i]+7;
+		else if (strncmp(argv[i],"evaluate=",9)==0) evaluate_file = argv[i]+9;
+		else if (strncmp(argv[i],"budget=",7)==0) budget = atof(argv[i]+7);
+		else if (strncmp(argv[i],"stencil=",8)==0) {
+			if (!select_stencil(argv[i]+8)) printf("Unknown stencil %s, using ridge\n", argv[i]+8);
+		}
+		else if (strncmp(argv[i],"ridges=",7)==0) ridges_file = argv[i]+7;
+		else if (strncmp(argv[i],"ridgeindex=",11)==0) ridge_index_file = argv[i]+11;
+	}
+	perf_init();
+
+	if (ridges_file[0]!=0) return run_ridges(ridges_file, ridge_index_file, igc_files, igc_count);
+	if (sweep_file[0]!=0) return run_sweep(sweep_file, igc_files, igc_count, threads, report_file);
+	if (evaluate_file[0]!=0) return run_evaluation(evaluate_file, igc_files, igc_count, budget);
+	printf("usage: sim_probe_sweep sweep=<terrain.asc> igc=<file> ... | evaluate=<terrain.asc> | ridges=<terrain.asc>\n");
+	return 1;
+}
@@ -0,0 +1,117 @@
+//------------------------------------------------------------------------------
+//
+//  sim_probe_track: converts between binary track files and IGC files, no FSX connection
+//
+//  Command line:
+//              export=<file.spt>   writes <file>.igc
+//              pack=<file.igc>     writes <file>.spt
+//------------------------------------------------------------------------------
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_probe_lib.h"
+
+//**********************************************************************************
+// TRACK LOG conversion (see TRACK LOG in sim_probe_lib.h for the format)
+
+long file_size(const char *fn) {
+	FILE *f;
+	if (fopen_s(&f, fn, "rb") != 0) return 0;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fclose(f);
+	return size;
+}
+
+// track_export() converts track file fn to IGC, written alongside it
+int track_export(const char *fn) {
+	TrackHeader h;
+	int bad_blocks;
+	if (!track_read(fn, &h, &bad_blocks)) return 1;
+	strcpy_s(igc_startup.atc_id, h.atc_id);
+	strcpy_s(igc_startup.atc_type, h.atc_type);
+	struct tm date;
+	memset(&date, 0, sizeof(date));
+	date.tm_year = h.year - 1900;
+	date.tm_mon = h.month - 1;
+	date.tm_mday = h.day;
+	char out[1000];
+	strcpy_s(out, fn);
+	char *ext = strrchr(out, '.');
+	if (ext!=NULL && _stricmp(ext, ".spt")==0) *ext = 0;
+	strcat_s(out, ".igc");
+	if (!igc_write_igc(out, &date)) return 1;
+	long track_size = file_size(fn), igc_size = file_size(out);
+	printf("%s: %d fixes, %d bad blocks, %ld bytes -> %s %ld bytes\n",
+		   fn, igc_record_count, bad_blocks, track_size, out, igc_size);
+	return bad_blocks>0 ? 1 : 0;
+}
+
+// track_pack() converts IGC file fn to a track file, written alongside it
+int track_pack(const char *fn) {
+	FILE *f;
+	if (fopen_s(&f, fn, "r") != 0) {
+		printf("Error: couldn't open IGC file %s\n", fn);
+		return 1;
+	}
+	char line[200];
+	char i_record[200] = "I00";
+	struct tm date;
+	memset(&date, 0, sizeof(date));
+	igc_record_count = 0;
+	while (fgets(line, sizeof(line), f)) {
+		int field;
+		if (line[0]=='I') {
+			strcpy_s(i_record, line);
+			continue;
+		}
+		if (strncmp(line, "HFDTE", 5)==0 && (field = igc_field(line+5, 6))>=0) {
+			date.tm_mday = field / 10000;
+			date.tm_mon = field / 100 % 100 - 1;
+			date.tm_year = field % 100 + 100;
+		} else if (strncmp(line, "HFGIDGLIDERID:", 14)==0) {
+			strcpy_s(igc_startup.atc_id, line+14);
+			igc_startup.atc_id[strcspn(igc_startup.atc_id, "\r\n")] = 0;
+		} else if (strncmp(line, "HFGTYGLIDERTYPE:", 16)==0) {
+			strcpy_s(igc_startup.atc_type, line+16);
+			igc_startup.atc_type[strcspn(igc_startup.atc_type, "\r\n")] = 0;
+		} else if (igc_record_count<IGC_MAX_RECORDS && igc_parse_b_record(line, strlen(line), &igc_pos[igc_record_count])) {
+			igc_parse_extensions(i_record, line, strlen(line), &igc_pos[igc_record_count]);
+			igc_record_count++;
+		}
+	}
+	fclose(f);
+	char out[1000];
+	strcpy_s(out, fn);
+	char *ext = strrchr(out, '.');
+	if (ext!=NULL && _stricmp(ext, ".igc")==0) *ext = 0;
+	strcat_s(out, ".spt");
+	if (!track_write(out, &date)) return 1;
+	long igc_size = file_size(fn), track_size = file_size(out);
+	printf("%s: %d fixes, %ld bytes -> %s %ld bytes (%.1f x smaller)\n",
+		   fn, igc_record_count, igc_size, out, track_size, double(igc_size) / max(track_size, 1L));
+	return 0;
+}
+
+// END OF TRACK LOG conversion
+//**********************************************************************************
+
+int main(int argc, char* argv[])
+{
+	const char *export_file = ""; // track file to convert to IGC
+	const char *pack_file = ""; // IGC file to convert to a track file
+	for (int i=1; i<argc; i++) {
+		if (strncmp(argv[i],"export=",7)==0)     export_file = argv[i]+7;
+		else if (strncmp(argv[i],"pack=",5)==0)  pack_file = argv[i]+5;
+	}
+	perf_init();
+	igc_extension_init();
+
+	if (export_file[0]!=0) return track_export(export_file);
+	if (pack_file[0]!=0) return track_pack(pack_file);
+	printf("usage: sim_probe_track export=<file.spt> | pack=<file.igc>\n");
+	return 1;
+}
@@ -0,0 +1,113 @@
+// Stand-in for the FSX SimConnect.h: the types, constants and calls sim_probe.cpp uses, with the
+// same message layouts.  The calls are implemented by fake_fsx.cpp.
+#pragma once
+#include <windows.h>
+
+typedef DWORD SIMCONNECT_OBJECT_ID;
+typedef DWORD SIMCONNECT_CLIENT_DATA_ID;
+typedef DWORD SIMCONNECT_DATA_REQUEST_ID;
+typedef DWORD SIMCONNECT_DATA_DEFINITION_ID;
+typedef DWORD SIMCONNECT_CLIENT_EVENT_ID;
+typedef DWORD SIMCONNECT_NOTIFICATION_GROUP_ID;
+typedef DWORD SIMCONNECT_INPUT_GROUP_ID;
+typedef DWORD SIMCONNECT_DATA_SET_FLAG;
+typedef DWORD SIMCONNECT_EVENT_FLAG;
+typedef DWORD SIMCONNECT_DATA_REQUEST_FLAG;
+typedef DWORD SIMCONNECT_CREATE_CLIENT_DATA_FLAG;
+typedef DWORD SIMCONNECT_CLIENT_DATA_DEFINITION_ID;
+
+const DWORD SIMCONNECT_OBJECT_ID_USER = 0;
+const DWORD SIMCONNECT_GROUP_PRIORITY_HIGHEST = 1;
+const DWORD SIMCONNECT_EVENT_FLAG_GROUPID_IS_PRIORITY = 0x10;
+const DWORD SIMCONNECT_DATA_SET_FLAG_DEFAULT = 0;
+const DWORD SIMCONNECT_CLIENTDATAOFFSET_AUTO = (DWORD)-1;
+const DWORD SIMCONNECT_CREATE_CLIENT_DATA_FLAG_READ_ONLY = 1;
+const DWORD SIMCONNECT_DATA_REQUEST_FLAG_DEFAULT = 0;
+const DWORD SIMCONNECT_DATA_REQUEST_FLAG_CHANGED = 1;
+const DWORD SIMCONNECT_DATA_REQUEST_FLAG_TAGGED = 2;
+const DWORD SIMCONNECT_UNUSED = (DWORD)-1;
+
+enum SIMCONNECT_DATATYPE {
+	SIMCONNECT_DATATYPE_INVALID,
+	SIMCONNECT_DATATYPE_INT32,
+	SIMCONNECT_DATATYPE_INT64,
+	SIMCONNECT_DATATYPE_FLOAT32,
+	SIMCONNECT_DATATYPE_FLOAT64,
+	SIMCONNECT_DATATYPE_STRING8,
+	SIMCONNECT_DATATYPE_STRING32
+};
+
+enum SIMCONNECT_PERIOD {
+	SIMCONNECT_PERIOD_NEVER,
+	SIMCONNECT_PERIOD_ONCE,
+	SIMCONNECT_PERIOD_VISUAL_FRAME,
+	SIMCONNECT_PERIOD_SIM_FRAME,
+	SIMCONNECT_PERIOD_SECOND
+};
+
+enum SIMCONNECT_SIMOBJECT_TYPE { SIMCONNECT_SIMOBJECT_TYPE_USER, SIMCONNECT_SIMOBJECT_TYPE_ALL, SIMCONNECT_SIMOBJECT_TYPE_AIRCRAFT };
+enum SIMCONNECT_STATE { SIMCONNECT_STATE_OFF, SIMCONNECT_STATE_ON };
+enum SIMCONNECT_TEXT_TYPE { SIMCONNECT_TEXT_TYPE_PRINT_RED };
+
+enum SIMCONNECT_EXCEPTION {
+	SIMCONNECT_EXCEPTION_NONE,
+	SIMCONNECT_EXCEPTION_UNRECOGNIZED_ID = 3,
+	SIMCONNECT_EXCEPTION_CREATE_OBJECT_FAILED = 29
+};
+
+enum SIMCONNECT_RECV_ID {
+	SIMCONNECT_RECV_ID_NULL,
+	SIMCONNECT_RECV_ID_EXCEPTION,
+	SIMCONNECT_RECV_ID_OPEN,
+	SIMCONNECT_RECV_ID_QUIT,
+	SIMCONNECT_RECV_ID_EVENT,
+	SIMCONNECT_RECV_ID_EVENT_OBJECT_ADDREMOVE,
+	SIMCONNECT_RECV_ID_EVENT_FILENAME,
+	SIMCONNECT_RECV_ID_SIMOBJECT_DATA = 8,
+	SIMCONNECT_RECV_ID_SIMOBJECT_DATA_BYTYPE,
+	SIMCONNECT_RECV_ID_ASSIGNED_OBJECT_ID = 12
+};
+
+struct SIMCONNECT_DATA_INITPOSITION { double Latitude, Longitude, Altitude, Pitch, Bank, Heading; DWORD OnGround, Airspeed; };
+
+struct SIMCONNECT_RECV { DWORD dwSize, dwVersion, dwID; };
+struct SIMCONNECT_RECV_EXCEPTION : SIMCONNECT_RECV { DWORD dwException, dwSendID, dwIndex; };
+struct SIMCONNECT_RECV_OPEN : SIMCONNECT_RECV { char szApplicationName[256]; DWORD dwApplicationVersionMajor, dwApplicationVersionMinor; };
+struct SIMCONNECT_RECV_QUIT : SIMCONNECT_RECV {};
+struct SIMCONNECT_RECV_EVENT : SIMCONNECT_RECV { DWORD uGroupID, uEventID, dwData; };
+struct SIMCONNECT_RECV_EVENT_FILENAME : SIMCONNECT_RECV_EVENT { char szFileName[260]; DWORD dwFlags; };
+struct SIMCONNECT_RECV_EVENT_OBJECT_ADDREMOVE : SIMCONNECT_RECV_EVENT { SIMCONNECT_SIMOBJECT_TYPE eObjType; };
+struct SIMCONNECT_RECV_SIMOBJECT_DATA : SIMCONNECT_RECV {
+	DWORD dwRequestID, dwObjectID, dwDefineID, dwFlags, dwentrynumber, dwoutof, dwDefineCount, dwData;
+};
+struct SIMCONNECT_RECV_SIMOBJECT_DATA_BYTYPE : SIMCONNECT_RECV_SIMOBJECT_DATA {};
+struct SIMCONNECT_RECV_ASSIGNED_OBJECT_ID : SIMCONNECT_RECV { DWORD dwRequestID, dwObjectID; };
+
+typedef void (CALLBACK *DispatchProc)(SIMCONNECT_RECV *, DWORD, void *);
+
+HRESULT SimConnect_Open(HANDLE *, const char *, void *, DWORD, HANDLE, DWORD);
+HRESULT SimConnect_Close(HANDLE);
+HRESULT SimConnect_CallDispatch(HANDLE, DispatchProc, void *);
+HRESULT SimConnect_GetNextDispatch(HANDLE, SIMCONNECT_RECV **, DWORD *);
+HRESULT SimConnect_MapClientEventToSimEvent(HANDLE, DWORD, const char * = "");
+HRESULT SimConnect_MapInputEventToClientEvent(HANDLE, DWORD, const char *, DWORD, DWORD = 0, DWORD = (DWORD)-1, DWORD = 0, BOOL = 0);
+HRESULT SimConnect_SetInputGroupState(HANDLE, DWORD, DWORD);
+HRESULT SimConnect_AddClientEventToNotificationGroup(HANDLE, DWORD, DWORD, BOOL = 0);
+HRESULT SimConnect_SetNotificationGroupPriority(HANDLE, DWORD, DWORD);
+HRESULT SimConnect_MenuAddItem(HANDLE, const char *, DWORD, DWORD);
+HRESULT SimConnect_MenuAddSubItem(HANDLE, DWORD, const char *, DWORD, DWORD);
+HRESULT SimConnect_AddToDataDefinition(HANDLE, DWORD, const char *, const char *,
+                                       SIMCONNECT_DATATYPE = SIMCONNECT_DATATYPE_FLOAT64, float = 0, DWORD = SIMCONNECT_UNUSED);
+HRESULT SimConnect_AddToClientDataDefinition(HANDLE, DWORD, DWORD, DWORD, float = 0, DWORD = SIMCONNECT_UNUSED);
+HRESULT SimConnect_MapClientDataNameToID(HANDLE, const char *, DWORD);
+HRESULT SimConnect_CreateClientData(HANDLE, DWORD, DWORD, DWORD);
+HRESULT SimConnect_SetClientData(HANDLE, DWORD, DWORD, DWORD, DWORD, DWORD, void *);
+HRESULT SimConnect_SubscribeToSystemEvent(HANDLE, DWORD, const char *);
+HRESULT SimConnect_RequestDataOnSimObject(HANDLE, DWORD, DWORD, DWORD, SIMCONNECT_PERIOD, DWORD = 0, DWORD = 0, DWORD = 0, DWORD = 0);
+HRESULT SimConnect_RequestDataOnSimObjectType(HANDLE, DWORD, DWORD, DWORD, SIMCONNECT_SIMOBJECT_TYPE);
+HRESULT SimConnect_SetDataOnSimObject(HANDLE, DWORD, DWORD, DWORD, DWORD, DWORD, void *);
+HRESULT SimConnect_AICreateSimulatedObject(HANDLE, const char *, SIMCONNECT_DATA_INITPOSITION, DWORD);
+HRESULT SimConnect_AIRemoveObject(HANDLE, DWORD, DWORD);
+HRESULT SimConnect_AIReleaseControl(HANDLE, DWORD, DWORD);
+HRESULT SimConnect_TransmitClientEvent(HANDLE, DWORD, DWORD, DWORD, DWORD, DWORD);
+HRESULT SimConnect_Text(HANDLE, SIMCONNECT_TEXT_TYPE, float, DWORD, DWORD, void *);
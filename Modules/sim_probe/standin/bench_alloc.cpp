@@ -0,0 +1,27 @@
+// bench_alloc.cpp: the allocation counter of sim_probe_bench (see BENCHMARKS in
+// sim_probe_bench.cpp).  It replaces the global operator new and delete, so it is linked into
+// the bench alone and never into sim_probe or the other tools.
+#include <windows.h>
+#include <new>
+
+volatile LONG bench_allocs = 0; // count of operator new calls, reported as allocations per op
+bool bench_counting = false; // only set by run_benchmarks(), so the setup isn't counted
+
+void *operator new(size_t size) {
+	if (bench_counting) InterlockedIncrement(&bench_allocs);
+	void *p = malloc(size ? size : 1);
+	if (p==NULL) throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void *p) throw() {
+	free(p);
+}
+
+void operator delete[](void *p) throw() {
+	free(p);
+}
@@ -0,0 +1,19 @@
+#!/bin/sh
+# build.sh: builds sim_probe and its offline tools against the stand-in Win32/SimConnect headers
+# and the fake FSX in this folder.  ./sim_probe_standin takes the same options as sim_probe.exe,
+# e.g.
+#   FAKE_SECONDS=60 FAKE_UPWIND=1 ./sim_probe_standin info
+# and ./sim_probe_replay, ./sim_probe_sweep, ./sim_probe_index, ./sim_probe_serve and
+# ./sim_probe_track are the tools of the same names.  ./sim_probe_bench is only built here, with
+# the allocation counter of bench_alloc.cpp.
+cd "$(dirname "$0")" || exit 1
+CXX="g++ -std=c++11 -O2 -Wall -Wextra -I."
+LIB=../sim_probe_lib.cpp
+ADDON="../sim_probe.cpp $LIB fake_fsx.cpp"
+$CXX ../sim_probe_main.cpp $ADDON -o sim_probe_standin -lpthread || exit 1
+$CXX ../sim_probe_replay.cpp $ADDON -o sim_probe_replay -lpthread || exit 1
+$CXX ../sim_probe_bench.cpp bench_alloc.cpp $ADDON -o sim_probe_bench -lpthread || exit 1
+$CXX ../sim_probe_sweep.cpp $LIB -o sim_probe_sweep -lpthread || exit 1
+$CXX ../sim_probe_index.cpp $LIB -o sim_probe_index -lpthread || exit 1
+$CXX ../sim_probe_serve.cpp $LIB -o sim_probe_serve -lpthread || exit 1
+$CXX ../sim_probe_track.cpp $LIB -o sim_probe_track -lpthread || exit 1
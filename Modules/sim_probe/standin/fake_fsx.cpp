@@ -0,0 +1,323 @@
+// fake_fsx.cpp: a stand-in FSX behind the SimConnect calls used by sim_probe.cpp, so its message
+// flow can be run, timed and counted without FSX.
+// Build with build.sh in this folder.
+//
+// The terrain is a north-south ridge 300 m high (gaussian, 800 m wide) 1500 m east of 47N 122W,
+// the wind 10 m/s from 270.  Replies come back after a few ms of simulated latency, delivered by
+// SimConnect_CallDispatch().  The user aircraft flies north at 25 m/s, hopping east every second
+// over a 20 step cycle, unless one of the environment variables below picks another pattern.
+//
+// FAKE_SECONDS=n       send QUIT n.75 seconds in, between two user positions (default 6)
+// FAKE_BEAT=1          beat north and south along the ridge, 1000 m each way
+// FAKE_UPWIND=1        fly west into wind from 4000 m east of the ridge
+// FAKE_WINDFIELD=1     wind stronger with height and weaker to the west, 2 m/s minimum
+// FAKE_DROP=pct        drop pct% of the probe replies
+// FAKE_CREATE_DELAY=ms delay before a created probe's object id is assigned (default 20)
+// FAKE_MOVE_DELAY=ms   delay before a probe move takes effect (default 0)
+// FAKE_REPLY_DELAY=ms  delay of every probe reply (default 3 to 22 for a move, 5 to 24 for a request)
+// FAKE_STALE=1         each moved probe first reports from where it was, then from its new position
+// FAKE_AI=n            n AI aircraft near the user aircraft
+// FAKE_AI_AWAY=a,b     the AI aircraft are out of range from a to b seconds
+
+#include <math.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <map>
+#include "SimConnect.h"
+
+const DWORD FAKE_DEFINITION_STARTUP = 4; // sim_probe's DEFINITION_STARTUP
+
+struct FakeMessage { DWORD due; std::vector<char> data; };
+struct FakeMove { DWORD due, object_id; double latitude, longitude; };
+// layout of sim_probe's DEFINITION_USER_POS and DEFINITION_PROBE_POS
+struct FakeUserPos { double latitude, longitude, altitude, ground_elevation, wind_velocity, wind_direction; INT32 on_ground, zulu_time; };
+struct FakeProbePos { double ground_elevation, latitude, longitude; };
+
+static std::vector<FakeMessage> queue; // messages waiting for their due time
+static std::vector<FakeMove> pending_moves;
+static std::map<std::string, DWORD> system_events; // event name -> client event id
+static std::map<DWORD, std::pair<double, double> > object_pos;
+static std::map<DWORD, double> object_alt;
+static std::map<DWORD, DWORD> subscriptions; // probe object id -> request id
+static DWORD start_tick = 0;
+static DWORD next_object_id = 1000;
+static DWORD last_4s = 0, last_second = 0;
+static DWORD user_request = (DWORD)-1, user_definition = 0;
+static bool sim_started = false;
+static int next_define_count = 0;
+static double user_lat = 47.0, user_lon = -122.0;
+
+static const double METRES_PER_DEGREE_EAST = 111000 * cos(47 * 4.0 * atan(1.0) / 180); // at 47N
+
+static DWORD now() { return GetTickCount() - start_tick; }
+
+static int env_int(const char *name, int value) {
+	const char *e = getenv(name);
+	return e ? atoi(e) : value;
+}
+
+// probe_reply_delay() is FAKE_REPLY_DELAY if set, else a random delay from least to least+spread-1
+static DWORD probe_reply_delay(int least, int spread) {
+	return (DWORD)env_int("FAKE_REPLY_DELAY", least + rand() % spread);
+}
+
+static double east_metres(double lon) { return (lon + 122.0) * METRES_PER_DEGREE_EAST; }
+static double lon_from_east(double x) { return -122.0 + x / METRES_PER_DEGREE_EAST; }
+
+static double terrain(double, double lon) {
+	double x = east_metres(lon);
+	return 200 + 300 * exp(-pow((x - 1500) / 800, 2));
+}
+
+static double wind_velocity(double lon, double alt) {
+	if (!getenv("FAKE_WINDFIELD")) return 10;
+	return max(2.0, 10 + (alt - 300) / 100 + east_metres(lon) / 400);
+}
+
+// push() queues message m, delivered after delay ms; extra (n bytes) replaces its last DWORD,
+// which is the dwData of a SIMOBJECT_DATA message
+template<class T> static void push(DWORD delay, const T &m, const void *extra = 0, size_t n = 0) {
+	FakeMessage x;
+	x.due = now() + delay;
+	x.data.resize(sizeof(T) + n);
+	memcpy(&x.data[0], &m, sizeof(T));
+	if (n) memcpy(&x.data[0] + sizeof(T) - sizeof(DWORD), extra, n);
+	queue.push_back(x);
+}
+
+static void push_data(DWORD delay, DWORD id, DWORD request, DWORD object_id, const void *data, size_t n) {
+	SIMCONNECT_RECV_SIMOBJECT_DATA m;
+	memset(&m, 0, sizeof(m));
+	m.dwID = id;
+	m.dwRequestID = request;
+	m.dwObjectID = object_id;
+	m.dwentrynumber = 1;
+	m.dwoutof = 1;
+	m.dwDefineCount = next_define_count ? next_define_count : (n == 36) ? 3 : n / 8;
+	next_define_count = 0;
+	push(delay, m, data, n);
+}
+
+static FakeUserPos user_pos(double agl) {
+	FakeUserPos u;
+	u.latitude = user_lat;
+	u.longitude = user_lon;
+	u.ground_elevation = terrain(user_lat, user_lon);
+	u.altitude = u.ground_elevation + agl;
+	u.wind_velocity = 10;
+	u.wind_direction = 270;
+	u.on_ground = 0;
+	u.zulu_time = (INT32)(now() / 1000) + 36000;
+	return u;
+}
+
+static void push_names(DWORD delay, DWORD id, DWORD request, DWORD object_id, const char *atc_id, const char *atc_type) {
+	char b[72];
+	memset(b, 0, sizeof(b));
+	strcpy(b, atc_id);
+	strcpy(b + 32, atc_type);
+	push_data(delay, id, request, object_id, b, sizeof(b));
+}
+
+// send_tagged() sends the tagged datums of a probe's SIM_FRAME subscription after a move
+static void send_tagged(DWORD object_id) {
+	if (!subscriptions.count(object_id)) return;
+	if (rand() % 100 < env_int("FAKE_DROP", 0)) return;
+	std::pair<double, double> pos = object_pos[object_id];
+	double alt = object_alt[object_id];
+	double v[6] = { terrain(pos.first, pos.second), pos.first, pos.second, alt, wind_velocity(pos.second, alt), 270 };
+	char buf[6 * 12];
+	for (DWORD t = 0; t < 6; t++) {
+		memcpy(buf + t * 12, &t, 4);
+		memcpy(buf + t * 12 + 4, &v[t], 8);
+	}
+	next_define_count = 6;
+	push_data(probe_reply_delay(3, 20), SIMCONNECT_RECV_ID_SIMOBJECT_DATA, subscriptions[object_id], object_id, buf, sizeof(buf));
+}
+
+static void apply_moves() {
+	for (size_t i = 0; i < pending_moves.size(); ) {
+		if (pending_moves[i].due <= now()) {
+			DWORD object_id = pending_moves[i].object_id;
+			if (getenv("FAKE_STALE")) send_tagged(object_id);
+			object_pos[object_id] = std::make_pair(pending_moves[i].latitude, pending_moves[i].longitude);
+			pending_moves.erase(pending_moves.begin() + i);
+			send_tagged(object_id);
+		} else i++;
+	}
+}
+
+// move_user() advances the user aircraft by one second of the chosen pattern
+static void move_user(DWORD n) {
+	if (getenv("FAKE_BEAT")) {
+		static double y = 0, dir = 1;
+		y += 25 * dir;
+		if (fabs(y) >= 1000) dir = -dir;
+		user_lat = 47.0 + y / 111000;
+		user_lon = lon_from_east(1300 + 30 * sin(y / 200));
+	} else if (getenv("FAKE_UPWIND")) {
+		static double x = 4000;
+		x -= 25;
+		user_lon = lon_from_east(x);
+	} else {
+		user_lat += 25.0 / 111000;
+		user_lon = -122.0 + (n / 1000 % 20) * 0.002;
+	}
+}
+
+HRESULT SimConnect_Open(HANDLE *h, const char *, void *, DWORD, HANDLE, DWORD) {
+	*h = (HANDLE)1;
+	start_tick = GetTickCount();
+	SIMCONNECT_RECV_OPEN o;
+	memset(&o, 0, sizeof(o));
+	o.dwID = SIMCONNECT_RECV_ID_OPEN;
+	push(0, o);
+	return 0;
+}
+
+HRESULT SimConnect_Close(HANDLE) { return 0; }
+
+HRESULT SimConnect_SubscribeToSystemEvent(HANDLE, DWORD e, const char *name) {
+	system_events[name] = e;
+	return 0;
+}
+
+HRESULT SimConnect_AICreateSimulatedObject(HANDLE, const char *, SIMCONNECT_DATA_INITPOSITION, DWORD request) {
+	SIMCONNECT_RECV_ASSIGNED_OBJECT_ID m;
+	memset(&m, 0, sizeof(m));
+	m.dwID = SIMCONNECT_RECV_ID_ASSIGNED_OBJECT_ID;
+	m.dwRequestID = request;
+	m.dwObjectID = next_object_id++;
+	push(env_int("FAKE_CREATE_DELAY", 20), m);
+	return 0;
+}
+
+HRESULT SimConnect_SetDataOnSimObject(HANDLE, DWORD, DWORD object_id, DWORD, DWORD, DWORD, void *data) {
+	double *p = (double *)data;
+	FakeMove m = { now() + env_int("FAKE_MOVE_DELAY", 0), object_id, p[0], p[1] };
+	pending_moves.push_back(m);
+	object_alt[object_id] = p[2];
+	apply_moves();
+	return 0;
+}
+
+HRESULT SimConnect_RequestDataOnSimObject(HANDLE, DWORD request, DWORD definition, DWORD object_id, SIMCONNECT_PERIOD period,
+                                          DWORD, DWORD, DWORD, DWORD) {
+	if (object_id == SIMCONNECT_OBJECT_ID_USER) {
+		if (period == SIMCONNECT_PERIOD_SECOND) {
+			// the 1Hz user position, sent by SimConnect_CallDispatch()
+			user_request = request;
+			user_definition = definition;
+		} else if (period == SIMCONNECT_PERIOD_ONCE && user_request != (DWORD)-1 && definition == user_definition) {
+			FakeUserPos u = user_pos(60);
+			push_data(3, SIMCONNECT_RECV_ID_SIMOBJECT_DATA, request, 1, &u, sizeof(u));
+		} else {
+			push_names(5, SIMCONNECT_RECV_ID_SIMOBJECT_DATA, request, 1, "B21", "DG808S");
+		}
+		return 0;
+	}
+	if (period == SIMCONNECT_PERIOD_SIM_FRAME) {
+		subscriptions[object_id] = request;
+		return 0;
+	}
+	if (rand() % 100 < env_int("FAKE_DROP", 0)) return 0;
+	apply_moves();
+	std::pair<double, double> pos = object_pos[object_id];
+	FakeProbePos p = { terrain(pos.first, pos.second), pos.first, pos.second };
+	push_data(probe_reply_delay(5, 20), SIMCONNECT_RECV_ID_SIMOBJECT_DATA, request, object_id, &p, sizeof(p));
+	return 0;
+}
+
+// ai_count() is the number of AI aircraft in range now
+static int ai_count() {
+	const char *away = getenv("FAKE_AI_AWAY");
+	int from, to;
+	if (away && sscanf(away, "%d,%d", &from, &to)==2 && now() >= (DWORD)from * 1000 && now() < (DWORD)to * 1000) return 0;
+	return env_int("FAKE_AI", 0);
+}
+
+HRESULT SimConnect_RequestDataOnSimObjectType(HANDLE, DWORD request, DWORD definition, DWORD, SIMCONNECT_SIMOBJECT_TYPE type) {
+	int ai_count = ::ai_count();
+	if (definition == FAKE_DEFINITION_STARTUP) {
+		push_names(5, SIMCONNECT_RECV_ID_SIMOBJECT_DATA_BYTYPE, request, 1, "B21", "DG808S");
+		for (int k = 0; k < ai_count; k++) {
+			char id[32];
+			sprintf(id, "AI%d", k);
+			push_names(6, SIMCONNECT_RECV_ID_SIMOBJECT_DATA_BYTYPE, request, 500 + k, id, "LS8");
+		}
+		return 0;
+	}
+	FakeUserPos u = user_pos(100);
+	push_data(5, SIMCONNECT_RECV_ID_SIMOBJECT_DATA_BYTYPE, request, 1, &u, sizeof(u));
+	if (type == SIMCONNECT_SIMOBJECT_TYPE_AIRCRAFT) {
+		for (int k = 0; k < ai_count; k++) {
+			FakeUserPos a = u;
+			a.latitude += 0.001 * k;
+			a.longitude += 0.002 * k;
+			a.ground_elevation = terrain(a.latitude, a.longitude);
+			a.altitude = a.ground_elevation + 80;
+			push_data(6, SIMCONNECT_RECV_ID_SIMOBJECT_DATA_BYTYPE, request, 500 + k, &a, sizeof(a));
+		}
+	}
+	return 0;
+}
+
+HRESULT SimConnect_CallDispatch(HANDLE, DispatchProc proc, void *context) {
+	DWORD n = now();
+	if (!sim_started && n > 10) {
+		sim_started = true;
+		SIMCONNECT_RECV_EVENT e;
+		memset(&e, 0, sizeof(e));
+		e.dwID = SIMCONNECT_RECV_ID_EVENT;
+		e.uEventID = system_events["SimStart"];
+		push(0, e);
+	}
+	if (n - last_4s >= 4000) {
+		last_4s = n;
+		SIMCONNECT_RECV_EVENT e;
+		memset(&e, 0, sizeof(e));
+		e.dwID = SIMCONNECT_RECV_ID_EVENT;
+		e.uEventID = system_events["4sec"];
+		push(0, e);
+	}
+	if (user_request != (DWORD)-1 && n - last_second >= 1000) {
+		last_second = n;
+		move_user(n);
+		FakeUserPos u = user_pos(60);
+		push_data(0, SIMCONNECT_RECV_ID_SIMOBJECT_DATA, user_request, 1, &u, sizeof(u));
+	}
+	if (n > (DWORD)env_int("FAKE_SECONDS", 6) * 1000 + 750) {
+		SIMCONNECT_RECV m;
+		memset(&m, 0, sizeof(m));
+		m.dwID = SIMCONNECT_RECV_ID_QUIT;
+		push(0, m);
+	}
+	apply_moves();
+	for (size_t i = 0; i < queue.size(); ) {
+		if (queue[i].due <= n) {
+			std::vector<char> d = queue[i].data;
+			queue.erase(queue.begin() + i);
+			proc((SIMCONNECT_RECV *)&d[0], (DWORD)d.size(), context);
+		} else i++;
+	}
+	return 0;
+}
+
+HRESULT SimConnect_GetNextDispatch(HANDLE, SIMCONNECT_RECV **, DWORD *) { return -1; }
+HRESULT SimConnect_MapClientEventToSimEvent(HANDLE, DWORD, const char *) { return 0; }
+HRESULT SimConnect_MapInputEventToClientEvent(HANDLE, DWORD, const char *, DWORD, DWORD, DWORD, DWORD, BOOL) { return 0; }
+HRESULT SimConnect_SetInputGroupState(HANDLE, DWORD, DWORD) { return 0; }
+HRESULT SimConnect_AddClientEventToNotificationGroup(HANDLE, DWORD, DWORD, BOOL) { return 0; }
+HRESULT SimConnect_SetNotificationGroupPriority(HANDLE, DWORD, DWORD) { return 0; }
+HRESULT SimConnect_MenuAddItem(HANDLE, const char *, DWORD, DWORD) { return 0; }
+HRESULT SimConnect_MenuAddSubItem(HANDLE, DWORD, const char *, DWORD, DWORD) { return 0; }
+HRESULT SimConnect_AddToDataDefinition(HANDLE, DWORD, const char *, const char *, SIMCONNECT_DATATYPE, float, DWORD) { return 0; }
+HRESULT SimConnect_AddToClientDataDefinition(HANDLE, DWORD, DWORD, DWORD, float, DWORD) { return 0; }
+HRESULT SimConnect_MapClientDataNameToID(HANDLE, const char *, DWORD) { return 0; }
+HRESULT SimConnect_CreateClientData(HANDLE, DWORD, DWORD, DWORD) { return 0; }
+HRESULT SimConnect_SetClientData(HANDLE, DWORD, DWORD, DWORD, DWORD, DWORD, void *) { return 0; }
+HRESULT SimConnect_AIRemoveObject(HANDLE, DWORD, DWORD) { return 0; }
+HRESULT SimConnect_AIReleaseControl(HANDLE, DWORD, DWORD) { return 0; }
+HRESULT SimConnect_TransmitClientEvent(HANDLE, DWORD, DWORD, DWORD, DWORD, DWORD) { return 0; }
+HRESULT SimConnect_Text(HANDLE, SIMCONNECT_TEXT_TYPE, float, DWORD, DWORD, void *) { return 0; }
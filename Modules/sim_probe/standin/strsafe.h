@@ -0,0 +1 @@
+// Stand-in: sim_probe.cpp includes <strsafe.h> but uses nothing from it.
@@ -0,0 +1 @@
+// Stand-in: sim_probe.cpp includes <tchar.h> but uses nothing from it.
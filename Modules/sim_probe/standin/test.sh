@@ -0,0 +1,156 @@
+#!/bin/bash
+# test.sh: checks run against the stand-in FSX, after build.sh.  Each check runs
+# ./sim_probe_standin (or one of the tools) with fixed FAKE_ settings and compares values from its
+# output with the expected ones.  A failed check prints what was expected and what came out, and
+# the exit code is the number of failed checks.  Run with bash (the query service check uses
+# /dev/tcp).  Every FSX run is FAKE_SECONDS=10, i.e. 10 lift samples.
+cd "$(dirname "$0")" || exit 1
+failed=0
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+# expect <what> <expected> <actual>
+expect() {
+	if [ "$2" = "$3" ]; then
+		echo "ok    $1 = $3"
+	else
+		echo "FAIL  $1: expected '$2', got '$3'"
+		failed=$((failed+1))
+	fi
+}
+
+# expect_one_of <what> <actual> <value>... passes if actual is any of the values
+expect_one_of() {
+	what=$1
+	actual=$2
+	shift 2
+	for v in "$@"; do
+		if [ "$v" = "$actual" ]; then
+			echo "ok    $what = $actual"
+			return
+		fi
+	done
+	echo "FAIL  $what: expected one of '$*', got '$actual'"
+	failed=$((failed+1))
+}
+
+# line <output> <start> prints the line of output that starts with start
+line() {
+	echo "$1" | grep "^$2" | head -1
+}
+
+# field <line> <name> prints the value after "name=" in line
+field() {
+	echo "$1" | sed -n "s/.* $2= *\([^ ]*\).*/\1/p"
+}
+
+#*******************************************************************************
+# LATENCY HISTOGRAMS
+# every probe reply comes FAKE_REPLY_DELAY=66 ms after the move, so the PROBE_MOVE turnaround is
+# 66 ms plus the dispatch loop's few ms and falls in the 65.54 ms bucket (65536 to 73727 us).
+# A reply held up a little longer by the scheduler lands in the next bucket, 73.73 ms, so p90
+# and p99 may be either.
+
+out=$(FAKE_SECONDS=10 FAKE_REPLY_DELAY=66 ./sim_probe_standin info)
+move=$(line "$out" "PROBE_MOVE ")
+expect "PROBE_MOVE p50" 65.54 "$(field "$move" p50)"
+expect_one_of "PROBE_MOVE p90" "$(field "$move" p90)" 65.54 73.73
+expect_one_of "PROBE_MOVE p99" "$(field "$move" p99)" 65.54 73.73
+
+# END OF LATENCY HISTOGRAMS
+#*******************************************************************************
+
+#*******************************************************************************
+# PROBE DEADLINES
+# every probe reply comes 600 ms after the move, past the 500 ms deadline, so every lift is sent
+# degraded with all four elevations substituted
+
+out=$(FAKE_SECONDS=10 FAKE_REPLY_DELAY=600 ./sim_probe_standin info)
+expect "lift values" "Lift values sent = 10, degraded = 10" "$(line "$out" "Lift values")"
+expect "deadline misses" "Probe deadline misses: probe[1]=10 probe[2]=10 probe[3]=10 probe[4]=10" \
+	"$(line "$out" "Probe deadline misses")"
+expect "substitutions" "Substituted from cache = 6, from terrain pyramid = 8, from previous sample = 26" \
+	"$(line "$out" "Substituted")"
+expect "degraded lifts printed" 10 "$(echo "$out" | grep -c 'degraded: 4 probe(s) late')"
+
+# END OF PROBE DEADLINES
+#*******************************************************************************
+
+#*******************************************************************************
+# STALE PROBE READS
+# FAKE_STALE=1 has each moved probe report from its old position first, so every move gives one
+# stale read, and the read from the new position still completes the profile in time
+
+out=$(FAKE_SECONDS=10 FAKE_STALE=1 FAKE_REPLY_DELAY=10 ./sim_probe_standin info)
+expect "stale reads" "Stale probe reads: probe[1]=10 probe[2]=10 probe[3]=10 probe[4]=10" \
+	"$(line "$out" "Stale probe reads")"
+expect "lift values" "Lift values sent = 10, degraded = 0" "$(line "$out" "Lift values")"
+
+# END OF STALE PROBE READS
+#*******************************************************************************
+
+#*******************************************************************************
+# MESSAGE COUNTS AND CAPTURE REPLAY
+# a lift sample costs 4 probe moves, the user position request and the client data write, and
+# the replies are the user position and the 4 tagged probe elevations.  The same run is
+# captured, and its replay must make exactly the recorded calls.
+
+out=$(FAKE_SECONDS=10 FAKE_REPLY_DELAY=10 ./sim_probe_standin info record="$tmp/run.cap")
+expect "messages" "Messages per lift sample: 6.00 sent, 6.00 received" "$(line "$out" "Messages per")"
+expect "PROBE_MOVE n" 40 "$(field "$(line "$out" "PROBE_MOVE ")" n)"
+out=$(./sim_probe_replay replay="$tmp/run.cap" fast)
+expect "replay" "0 call(s) differ from the recording" "$(echo "$out" | tail -1)"
+
+# END OF MESSAGE COUNTS AND CAPTURE REPLAY
+#*******************************************************************************
+
+#*******************************************************************************
+# TRACK FILES
+# an IGC file packed to a track file and exported back has the same I and B records
+
+cat > "$tmp/t.igc" <<END
+AXXXtest
+HFDTE160809
+HFGIDGLIDERID:F0
+I093638FXA3943XLF4448XGE4951WDI5254WVE5559XP16064XP26569XP37074XP4
+B1415553241261N10330541WA0080000800000+00880060027002200600006000060000600
+B1415593241285N10330541WA0080200802000-00860060027002200600006000060000600
+B1416033241309N10330539WA0080500805000-02040060027002200600006000060000600
+B1416073241333N10330536WA0080800808000+01990060027002200600006000060000600
+B1416113241357N10330532WA0081100811000-02710060027002200600006000060000600
+B1416153241380N10330528WA0081400814000+00990060027002200600006000060000600
+END
+grep '^[IB]' "$tmp/t.igc" > "$tmp/expected"
+./sim_probe_track pack="$tmp/t.igc" > /dev/null
+rm "$tmp/t.igc"
+out=$(./sim_probe_track export="$tmp/t.spt")
+expect "export" "$tmp/t.spt: 6 fixes, 0 bad blocks" "$(echo "$out" | sed 's/, [0-9]* bytes.*//')"
+expect "I and B records" same "$(grep '^[IB]' "$tmp/t.igc" | cmp -s - "$tmp/expected" && echo same)"
+
+# END OF TRACK FILES
+#*******************************************************************************
+
+#*******************************************************************************
+# QUERY SERVICE
+# the synthetic terrain has ridges 300 m high every 4 km between 45.067N and 45.133N, peaking
+# at 400 m on 0.127E; the lift query is on the western face of that ridge, with a west wind
+
+./sim_probe_serve serve=47047 terrain=synthetic > /dev/null &
+serve=$!
+sleep 1
+exec 3<>/dev/tcp/127.0.0.1/47047
+printf 'E 45.1 0.127\nL 45.1 0.1144 400 270 10\nE 10 10\n' >&3
+read -r peak <&3
+read -r lift <&3
+read -r outside <&3
+exec 3<&-
+kill $serve
+wait $serve 2> /dev/null
+expect "elevation" "400.0" "$peak"
+expect "lift and elevation" "0.487 175.8" "$lift"
+expect "outside the terrain" "-" "$outside"
+
+# END OF QUERY SERVICE
+#*******************************************************************************
+
+exit $failed
@@ -0,0 +1,269 @@
+// Stand-in for the parts of the Win32 API used by sim_probe.cpp, so it can be built on Linux
+// with g++ against fake_fsx.cpp (see build.sh).  Only what sim_probe needs, no more.
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <strings.h>
+#include <glob.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <math.h>
+#undef M_PI // sim_probe.cpp declares its own
+
+typedef void *HANDLE;
+typedef void *LPVOID;
+typedef uint32_t DWORD;
+typedef long HRESULT;
+typedef int32_t INT32;
+typedef uint32_t UINT32;
+typedef int BOOL;
+typedef int64_t LONGLONG;
+typedef int64_t __int64;
+typedef long LONG;
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef int errno_t;
+typedef union { struct { DWORD LowPart; LONG HighPart; }; LONGLONG QuadPart; } LARGE_INTEGER;
+
+#define CALLBACK
+#define WINAPI
+#define TRUE 1
+#define FALSE 0
+#define INFINITE 0xFFFFFFFF
+#define WAIT_OBJECT_0 0
+#define WAIT_TIMEOUT 258
+#define MAX_PATH 260
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+#define max(a,b) (((a) > (b)) ? (a) : (b))
+#define min(a,b) (((a) < (b)) ? (a) : (b))
+#define __declspec(x) __declspec_##x
+#define __declspec_thread __thread
+#define _ReadWriteBarrier() ((void)0)
+#define _stricmp strcasecmp
+#define _mkgmtime timegm
+#define sscanf_s sscanf
+
+//*******************************************************************************
+// time
+
+inline void Sleep(DWORD ms) { usleep(ms * 1000); }
+inline BOOL FreeConsole() { return 1; }
+
+inline DWORD GetTickCount() {
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (DWORD)(t.tv_sec * 1000 + t.tv_nsec / 1000000);
+}
+
+inline BOOL QueryPerformanceCounter(LARGE_INTEGER *p) {
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	p->QuadPart = (LONGLONG)t.tv_sec * 1000000000LL + t.tv_nsec;
+	return 1;
+}
+
+inline BOOL QueryPerformanceFrequency(LARGE_INTEGER *p) { p->QuadPart = 1000000000LL; return 1; }
+
+inline errno_t _localtime64_s(struct tm *t, const time_t *l) { localtime_r(l, t); return 0; }
+inline errno_t _gmtime64_s(struct tm *t, const time_t *l) { gmtime_r(l, t); return 0; }
+
+//*******************************************************************************
+// threads, events and interlocked operations
+
+typedef DWORD (WINAPI *LPTHREAD_START_ROUTINE)(void *);
+
+// a HANDLE is either an auto-reset event or a thread (WaitForSingleObject() joins a thread)
+struct StandinHandle { pthread_mutex_t m; pthread_cond_t c; bool set; bool is_thread; pthread_t t; };
+struct StandinThreadArg { LPTHREAD_START_ROUTINE fn; void *p; };
+
+inline void *standin_thread_main(void *a) {
+	StandinThreadArg x = *(StandinThreadArg *)a;
+	delete (StandinThreadArg *)a;
+	x.fn(x.p);
+	return 0;
+}
+
+inline HANDLE CreateThread(void *, size_t, LPTHREAD_START_ROUTINE fn, void *p, DWORD, DWORD *) {
+	StandinHandle *h = new StandinHandle();
+	h->is_thread = true;
+	StandinThreadArg *a = new StandinThreadArg;
+	a->fn = fn;
+	a->p = p;
+	pthread_create(&h->t, 0, standin_thread_main, a);
+	return h;
+}
+
+inline HANDLE CreateEvent(void *, BOOL, BOOL, const char *) {
+	StandinHandle *h = new StandinHandle();
+	pthread_mutex_init(&h->m, 0);
+	pthread_cond_init(&h->c, 0);
+	h->set = false;
+	h->is_thread = false;
+	return h;
+}
+
+inline BOOL SetEvent(HANDLE handle) {
+	StandinHandle *h = (StandinHandle *)handle;
+	pthread_mutex_lock(&h->m);
+	h->set = true;
+	pthread_cond_signal(&h->c);
+	pthread_mutex_unlock(&h->m);
+	return 1;
+}
+
+inline DWORD WaitForSingleObject(HANDLE handle, DWORD ms) {
+	StandinHandle *h = (StandinHandle *)handle;
+	if (h->is_thread) {
+		pthread_join(h->t, 0);
+		return WAIT_OBJECT_0;
+	}
+	pthread_mutex_lock(&h->m);
+	timespec t;
+	clock_gettime(CLOCK_REALTIME, &t);
+	t.tv_nsec += (ms % 1000) * 1000000L;
+	t.tv_sec += ms / 1000 + t.tv_nsec / 1000000000L;
+	t.tv_nsec %= 1000000000L;
+	while (!h->set) {
+		if (pthread_cond_timedwait(&h->c, &h->m, &t) != 0) break;
+	}
+	DWORD r = h->set ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
+	h->set = false;
+	pthread_mutex_unlock(&h->m);
+	return r;
+}
+
+inline BOOL CloseHandle(HANDLE) { return 1; }
+inline LONG InterlockedIncrement(volatile LONG *p) { return __sync_add_and_fetch(p, 1); }
+inline LONG InterlockedExchange(volatile LONG *p, LONG v) { return __sync_lock_test_and_set(p, v); }
+inline LONG InterlockedCompareExchange(volatile LONG *p, LONG x, LONG c) { return __sync_val_compare_and_swap(p, c, x); }
+inline void MemoryBarrier() { __sync_synchronize(); }
+
+typedef struct { DWORD dwNumberOfProcessors; } SYSTEM_INFO;
+inline void GetSystemInfo(SYSTEM_INFO *s) { s->dwNumberOfProcessors = (DWORD)sysconf(_SC_NPROCESSORS_ONLN); }
+
+//*******************************************************************************
+// the _s string and file functions
+
+inline errno_t fopen_s(FILE **f, const char *n, const char *m) { *f = fopen(n, m); return *f ? 0 : 1; }
+// strcpy_s() truncates where the real one fails, the copies in sim_probe always fit
+inline errno_t strcpy_s(char *d, size_t n, const char *s) {
+	size_t k = strlen(s);
+	if (k > n-1) k = n-1;
+	memcpy(d, s, k);
+	d[k] = 0;
+	return 0;
+}
+template<size_t N> errno_t strcpy_s(char (&d)[N], const char *s) { return strcpy_s(d, N, s); }
+template<size_t N> errno_t strcat_s(char (&d)[N], const char *s) { strncat(d, s, N - strlen(d) - 1); return 0; }
+inline errno_t strcat_s(char *d, size_t n, const char *s) { strncat(d, s, n - strlen(d) - 1); return 0; }
+
+template<size_t N> int sprintf_s(char (&d)[N], const char *f, ...) {
+	va_list a;
+	va_start(a, f);
+	int r = vsnprintf(d, N, f, a);
+	va_end(a);
+	return r;
+}
+
+inline int sprintf_s(char *d, size_t n, const char *f, ...) {
+	va_list a;
+	va_start(a, f);
+	int r = vsnprintf(d, n, f, a);
+	va_end(a);
+	return r;
+}
+
+inline int _snprintf_s(char *d, size_t n, size_t, const char *f, ...) {
+	va_list a;
+	va_start(a, f);
+	int r = vsnprintf(d, n, f, a);
+	va_end(a);
+	return r;
+}
+
+inline int _fseeki64(FILE *f, long long o, int w) { return fseek(f, o, w); }
+inline long long _ftelli64(FILE *f) { return ftell(f); }
+
+// fscanf_s() takes a buffer size after each %s argument, fscanf() doesn't
+#define fscanf_s(f, fmt, ...) standin_fscanf_s(f, fmt, __VA_ARGS__)
+inline int standin_fscanf_s(FILE *f, const char *fmt, double *a) { return fscanf(f, fmt, a); }
+inline int standin_fscanf_s(FILE *f, const char *fmt, char *a, unsigned, double *b) { return fscanf(f, fmt, a, b); }
+template<class A, class B> int standin_fscanf_s(FILE *f, const char *fmt, A a, unsigned, B b) { return fscanf(f, fmt, a, b); }
+
+//*******************************************************************************
+// file mapping and directory listing
+
+#define GENERIC_READ 0x80000000
+#define FILE_SHARE_READ 1
+#define OPEN_EXISTING 3
+#define FILE_ATTRIBUTE_NORMAL 0x80
+#define PAGE_READONLY 2
+#define FILE_MAP_READ 4
+#define INVALID_HANDLE_VALUE ((HANDLE)(intptr_t)-1)
+
+struct StandinFile { int fd; size_t size; };
+
+inline HANDLE CreateFileA(const char *n, DWORD, DWORD, void *, DWORD, DWORD, HANDLE) {
+	int fd = open(n, O_RDONLY);
+	if (fd < 0) return INVALID_HANDLE_VALUE;
+	StandinFile *f = new StandinFile;
+	f->fd = fd;
+	struct stat st;
+	fstat(fd, &st);
+	f->size = st.st_size;
+	return f;
+}
+
+inline DWORD GetFileSize(HANDLE h, DWORD *hi) { if (hi) *hi = 0; return (DWORD)((StandinFile *)h)->size; }
+inline HANDLE CreateFileMappingA(HANDLE h, void *, DWORD, DWORD, DWORD, const char *) { return h; }
+
+inline void *MapViewOfFile(HANDLE h, DWORD, DWORD, DWORD, size_t) {
+	StandinFile *f = (StandinFile *)h;
+	void *p = mmap(0, f->size, PROT_READ, MAP_PRIVATE, f->fd, 0);
+	return p == MAP_FAILED ? 0 : p;
+}
+
+inline BOOL UnmapViewOfFile(const void *) { return 1; }
+
+typedef struct { char cFileName[MAX_PATH]; DWORD nFileSizeLow; } WIN32_FIND_DATAA;
+struct StandinFind { glob_t g; size_t next; };
+
+inline void standin_find_name(WIN32_FIND_DATAA *d, const char *path) {
+	const char *n = strrchr(path, '/');
+	strncpy(d->cFileName, n ? n + 1 : path, MAX_PATH - 1);
+	d->cFileName[MAX_PATH-1] = 0;
+}
+
+inline HANDLE FindFirstFileA(const char *pattern, WIN32_FIND_DATAA *d) {
+	StandinFind *f = new StandinFind;
+	if (glob(pattern, 0, 0, &f->g) != 0 || f->g.gl_pathc == 0) {
+		delete f;
+		return INVALID_HANDLE_VALUE;
+	}
+	f->next = 1;
+	standin_find_name(d, f->g.gl_pathv[0]);
+	return f;
+}
+
+inline BOOL FindNextFileA(HANDLE h, WIN32_FIND_DATAA *d) {
+	StandinFind *f = (StandinFind *)h;
+	if (f->next >= f->g.gl_pathc) return 0;
+	standin_find_name(d, f->g.gl_pathv[f->next++]);
+	return 1;
+}
+
+inline BOOL FindClose(HANDLE h) {
+	globfree(&((StandinFind *)h)->g);
+	delete (StandinFind *)h;
+	return 1;
+}
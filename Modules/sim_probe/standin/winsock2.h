@@ -0,0 +1,23 @@
+// Stand-in for the Winsock calls used by the loopback query service, on BSD sockets.
+#pragma once
+#include "windows.h"
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+typedef int SOCKET;
+typedef struct { int unused; } WSADATA;
+
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define closesocket close
+#define MAKEWORD(a,b) ((WORD)(((BYTE)(a))|(((WORD)((BYTE)(b)))<<8)))
+
+inline int WSAStartup(WORD, WSADATA *) { return 0; }
+inline int WSACleanup() { return 0; }
+
+// Winsock ignores the first select() argument, BSD sockets need the highest descriptor + 1
+inline int standin_select(int, fd_set *r, fd_set *w, fd_set *e, timeval *t) { return ::select(FD_SETSIZE, r, w, e, t); }
+#define select standin_select